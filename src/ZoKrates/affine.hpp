@@ -0,0 +1,78 @@
+/**
+ * @file affine.hpp
+ *
+ * Batch conversion of Jacobian points to affine coordinates.
+ *
+ * to_affine_coordinates() costs one field inversion per point. With
+ * Montgomery's simultaneous inversion trick a whole vector of points needs a
+ * single inversion plus three multiplications per point, which is what makes
+ * exporting a verification key with a large IC query cheap.
+ */
+
+#ifndef ZOKRATES_AFFINE_HPP_
+#define ZOKRATES_AFFINE_HPP_
+
+#include <vector>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+
+#include "field_kernels.hpp"
+
+// Replaces each values[i] by its inverse, with one inversion for the whole
+// vector. Zero entries are skipped and stay zero.
+template<typename FieldT>
+void batchInvertSkippingZeros(std::vector<FieldT> &values)
+{
+  std::vector<FieldT> prefix;
+  prefix.reserve(values.size());
+
+  FieldT acc = FieldT::one();
+  for (const FieldT &v : values) {
+    prefix.emplace_back(acc);
+    if (!v.is_zero()) {
+      acc = fieldMul(acc, v);
+    }
+  }
+
+  FieldT inv = acc.inverse();
+  for (size_t i = values.size(); i-- > 0; ) {
+    if (values[i].is_zero()) {
+      continue;
+    }
+    const FieldT v_inv = fieldMul(inv, prefix[i]);
+    inv = fieldMul(inv, values[i]);
+    values[i] = v_inv;
+  }
+}
+
+// Same result as calling to_affine_coordinates() on every point, for
+// alt_bn128_G1 and alt_bn128_G2 (Jacobian coordinates).
+template<typename GroupT>
+void batchToAffineCoordinates(std::vector<GroupT> &points)
+{
+  typedef decltype(points[0].Z) FieldT;
+
+  std::vector<FieldT> Z_inv;
+  Z_inv.reserve(points.size());
+  for (const GroupT &p : points) {
+    Z_inv.emplace_back(p.Z);
+  }
+  batchInvertSkippingZeros(Z_inv);
+
+  for (size_t i = 0; i < points.size(); ++i) {
+    GroupT &p = points[i];
+    if (p.is_zero()) {
+      p.X = FieldT::zero();
+      p.Y = FieldT::one();
+      p.Z = FieldT::zero();
+      continue;
+    }
+    const FieldT Z2_inv = fieldSqr(Z_inv[i]);
+    const FieldT Z3_inv = fieldMul(Z2_inv, Z_inv[i]);
+    p.X = fieldMul(p.X, Z2_inv);
+    p.Y = fieldMul(p.Y, Z3_inv);
+    p.Z = FieldT::one();
+  }
+}
+
+#endif // ZOKRATES_AFFINE_HPP_
@@ -0,0 +1,107 @@
+/**
+ * @file batch_prover.hpp
+ *
+ * Proves many witnesses for the same proving key on a pool of worker threads.
+ *
+ * The key is shared read-only between the workers (it may be a memory mapped
+ * binary key, see pk_binary.hpp). Each worker owns a prover_scratch that is
+ * reused for all the proofs it computes. Witnesses are handed out through an
+ * atomic counter and every proof is stored at the index of its witness, so
+ * the result comes back in input order however the work was interleaved.
+ *
+ * libff's profiling (enter_block/leave_block) keeps global state that is not
+ * thread safe, so libff::inhibit_profiling_counters has to be set before
+ * proving on several threads; initCurveParameters does so. The flags are
+ * left alone here, since other threads may be proving at the same time.
+ */
+
+#ifndef ZOKRATES_BATCH_PROVER_HPP_
+#define ZOKRATES_BATCH_PROVER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
+#include "prover.hpp"
+#include "threads.hpp"
+
+struct prover_witness {
+  libsnark::r1cs_ppzksnark_primary_input<prover_pp> primary_input;
+  libsnark::r1cs_ppzksnark_auxiliary_input<prover_pp> auxiliary_input;
+};
+
+// 0 means proverThreads() workers
+inline size_t batchProverThreads(size_t num_threads, size_t num_witnesses)
+{
+  if (num_threads == 0) {
+    num_threads = proverThreads();
+  }
+  return std::max<size_t>(1, std::min(num_threads, num_witnesses));
+}
+
+inline std::vector<libsnark::r1cs_ppzksnark_proof<prover_pp>> proveBatch(const proving_key_view &pk,
+                                                                       const std::vector<prover_witness> &witnesses,
+                                                                       size_t num_threads = 0)
+{
+  std::vector<libsnark::r1cs_ppzksnark_proof<prover_pp>> proofs(witnesses.size());
+  if (witnesses.empty()) {
+    return proofs;
+  }
+  num_threads = batchProverThreads(num_threads, witnesses.size());
+
+  std::atomic<size_t> next(0);
+  std::vector<std::exception_ptr> errors(num_threads);
+
+  auto worker = [&](size_t t) {
+#ifdef MULTICORE
+    // parallelism comes from the pool, don't start an OpenMP team per worker
+    if (num_threads > 1) {
+      omp_set_num_threads(1);
+    }
+#endif
+    prover_scratch scratch;
+    try {
+      for (size_t i = next++; i < witnesses.size(); i = next++) {
+        proofs[i] = proveWithKeyView(pk, witnesses[i].primary_input, witnesses[i].auxiliary_input, scratch);
+      }
+    } catch (...) {
+      errors[t] = std::current_exception();
+      next = witnesses.size();
+    }
+  };
+
+  if (num_threads == 1) {
+    worker(0);
+  } else {
+    std::vector<std::thread> pool;
+    pool.reserve(num_threads);
+    for (size_t t = 0; t < num_threads; ++t) {
+      pool.emplace_back(worker, t);
+    }
+    for (std::thread &thread : pool) {
+      thread.join();
+    }
+  }
+
+  for (const std::exception_ptr &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  return proofs;
+}
+
+inline std::vector<libsnark::r1cs_ppzksnark_proof<prover_pp>> proveBatch(const libsnark::r1cs_ppzksnark_proving_key<prover_pp> &pk,
+                                                                       const std::vector<prover_witness> &witnesses,
+                                                                       size_t num_threads = 0)
+{
+  return proveBatch(viewOfProvingKey(pk), witnesses, num_threads);
+}
+
+#endif // ZOKRATES_BATCH_PROVER_HPP_
@@ -0,0 +1,259 @@
+/**
+ * @file batch_verifier.hpp
+ *
+ * Verifies many r1cs_ppzksnark proofs against one verification key at once.
+ *
+ * Each proof has to satisfy five pairing product equations (three knowledge
+ * commitment checks, the QAP divisibility check and the same coefficient
+ * check). Every equation of every proof is raised to an independent random
+ * 128 bit scalar and all of them are multiplied together. Pairings against the
+ * same vk element are merged by summing their G1 arguments, so a batch of N
+ * proofs costs N + 6 Miller loops, evaluated in one shared loop, and a single
+ * final exponentiation, instead of 10 Miller loops and 5 final
+ * exponentiations per proof. A batch containing an invalid proof passes only
+ * with probability about 2^-128.
+ *
+ * When a batch fails, findInvalidProofs bisects it to locate the bad proofs.
+ */
+
+#ifndef ZOKRATES_BATCH_VERIFIER_HPP_
+#define ZOKRATES_BATCH_VERIFIER_HPP_
+
+#include <random>
+#include <vector>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
+
+typedef libff::alt_bn128_pp verifier_pp;
+typedef libff::bigint<2> batch_scalar;
+
+// prod_i e(P_i, Q_i) before the final exponentiation, sharing the squarings
+// of one Miller loop between all pairs. Same steps as
+// alt_bn128_ate_double_miller_loop, for any number of pairs.
+inline libff::alt_bn128_Fq12 multiMillerLoop(const std::vector<libff::alt_bn128_ate_G1_precomp> &P,
+                                             const std::vector<const libff::alt_bn128_ate_G2_precomp*> &Q)
+{
+  assert(P.size() == Q.size());
+  libff::alt_bn128_Fq12 f = libff::alt_bn128_Fq12::one();
+
+  size_t idx = 0;
+  auto addLines = [&]() {
+    for (size_t k = 0; k < P.size(); ++k) {
+      const libff::alt_bn128_ate_ell_coeffs &c = Q[k]->coeffs[idx];
+      f = f.mul_by_024(c.ell_0, P[k].PY * c.ell_VW, P[k].PX * c.ell_VV);
+    }
+    ++idx;
+  };
+
+  const auto &loop_count = libff::alt_bn128_ate_loop_count;
+  bool found_one = false;
+  for (long i = loop_count.max_bits(); i >= 0; --i) {
+    const bool bit = loop_count.test_bit(i);
+    if (!found_one) {
+      // this skips the MSB itself
+      found_one |= bit;
+      continue;
+    }
+
+    f = f.squared();
+    addLines();
+    if (bit) {
+      addLines();
+    }
+  }
+
+  if (libff::alt_bn128_ate_is_loop_count_neg) {
+    f = f.inverse();
+  }
+
+  addLines();
+  addLines();
+  return f;
+}
+
+class batch_pairing_product {
+public:
+  void add(const libff::alt_bn128_G1 &P, const libff::alt_bn128_ate_G2_precomp &Q)
+  {
+    // e(0, Q) = 1
+    if (P.is_zero()) {
+      return;
+    }
+    g1.emplace_back(verifier_pp::precompute_G1(P));
+    g2.emplace_back(&Q);
+  }
+
+  bool isOne() const
+  {
+    return libff::alt_bn128_final_exponentiation(multiMillerLoop(g1, g2)) == libff::alt_bn128_GT::one();
+  }
+
+private:
+  std::vector<libff::alt_bn128_ate_G1_precomp> g1;
+  std::vector<const libff::alt_bn128_ate_G2_precomp*> g2;
+};
+
+// The processed vk only keeps the pairing precomputation of its G1 elements,
+// the batch check also needs the points themselves.
+struct batch_verification_key {
+  libsnark::r1cs_ppzksnark_processed_verification_key<verifier_pp> pvk;
+  libff::alt_bn128_G1 alphaB_g1;
+  libff::alt_bn128_G1 gamma_beta_g1;
+
+  // filled in by readProcessedVerificationKeyFile
+  batch_verification_key() = default;
+
+  explicit batch_verification_key(const libsnark::r1cs_ppzksnark_verification_key<verifier_pp> &vk) :
+    pvk(libsnark::r1cs_ppzksnark_verifier_process_vk<verifier_pp>(vk)),
+    alphaB_g1(vk.alphaB_g1),
+    gamma_beta_g1(vk.gamma_beta_g1) {}
+};
+
+inline batch_scalar randomBatchScalar(std::random_device &rd)
+{
+  batch_scalar r;
+  do {
+    for (size_t i = 0; i < batch_scalar::N; ++i) {
+      r.data[i] = (mp_limb_t(rd()) << 32) | rd();
+    }
+  } while (r.is_zero());
+  return r;
+}
+
+// true iff all proofs[i] verify for primary_inputs[i], checked together as
+// a random linear combination. Same acceptance as
+// r1cs_ppzksnark_online_verifier_strong_IC up to a 2^-128 error.
+inline bool batchVerifyProofs(const batch_verification_key &bvk,
+                              const std::vector<libsnark::r1cs_ppzksnark_primary_input<verifier_pp>> &primary_inputs,
+                              const std::vector<libsnark::r1cs_ppzksnark_proof<verifier_pp>> &proofs,
+                              const std::vector<size_t> &batch)
+{
+  typedef libff::alt_bn128_G1 G1;
+  const libsnark::r1cs_ppzksnark_processed_verification_key<verifier_pp> &pvk = bvk.pvk;
+
+  libff::enter_block("Call to batchVerifyProofs");
+
+  std::random_device rd;
+  G1 sum_A = G1::zero(), sum_C = G1::zero(), sum_H = G1::zero(), sum_K = G1::zero();
+  G1 sum_gamma_beta = G1::zero(), sum_one = G1::zero();
+  std::vector<G1> B_partners;
+  B_partners.reserve(batch.size());
+
+  for (size_t i : batch) {
+    const libsnark::r1cs_ppzksnark_proof<verifier_pp> &proof = proofs[i];
+    const libsnark::r1cs_ppzksnark_primary_input<verifier_pp> &input = primary_inputs[i];
+    if (input.size() != pvk.encoded_IC_query.domain_size() || !proof.is_well_formed()) {
+      libff::leave_block("Call to batchVerifyProofs");
+      return false;
+    }
+
+    const libsnark::accumulation_vector<G1> accumulated_IC = pvk.encoded_IC_query.template accumulate_chunk<libff::alt_bn128_Fr>(input.begin(), input.end(), 0);
+    assert(accumulated_IC.is_fully_accumulated());
+    const G1 A_acc = proof.g_A.g + accumulated_IC.first;
+
+    batch_scalar r[5];
+    for (batch_scalar &r_k : r) {
+      r_k = randomBatchScalar(rd);
+    }
+
+    // e(A, alphaA) = e(A_p, g2)
+    sum_A = sum_A + r[0] * proof.g_A.g;
+    sum_one = sum_one + r[0] * proof.g_A.h;
+    // e(alphaB, B) = e(B_p, g2)
+    sum_one = sum_one + r[1] * proof.g_B.h;
+    // e(C, alphaC) = e(C_p, g2)
+    sum_C = sum_C + r[2] * proof.g_C.g;
+    sum_one = sum_one + r[2] * proof.g_C.h;
+    // e(A + acc, B) = e(H, rC_Z) e(C, g2)
+    sum_H = sum_H + r[3] * proof.g_H;
+    sum_one = sum_one + r[3] * proof.g_C.g;
+    // e(K, gamma) = e(A + acc + C, gamma_beta2) e(gamma_beta1, B)
+    sum_K = sum_K + r[4] * proof.g_K;
+    sum_gamma_beta = sum_gamma_beta + r[4] * (A_acc + proof.g_C.g);
+
+    // the three equations pairing with the proof's own B
+    B_partners.emplace_back(r[1] * bvk.alphaB_g1 + r[3] * A_acc - r[4] * bvk.gamma_beta_g1);
+  }
+
+  libff::enter_block("Multi-pairing");
+  batch_pairing_product product;
+  product.add(sum_A, pvk.vk_alphaA_g2_precomp);
+  product.add(sum_C, pvk.vk_alphaC_g2_precomp);
+  product.add(-sum_H, pvk.vk_rC_Z_g2_precomp);
+  product.add(sum_K, pvk.vk_gamma_g2_precomp);
+  product.add(-sum_gamma_beta, pvk.vk_gamma_beta_g2_precomp);
+  product.add(-sum_one, pvk.pp_G2_one_precomp);
+
+  std::vector<libff::alt_bn128_ate_G2_precomp> B_precomp;
+  B_precomp.reserve(batch.size());
+  for (size_t k = 0; k < batch.size(); ++k) {
+    B_precomp.emplace_back(verifier_pp::precompute_G2(proofs[batch[k]].g_B.g));
+    product.add(B_partners[k], B_precomp.back());
+  }
+  const bool ok = product.isOne();
+  libff::leave_block("Multi-pairing");
+
+  libff::leave_block("Call to batchVerifyProofs");
+  return ok;
+}
+
+inline bool batchVerifyProofs(const batch_verification_key &bvk,
+                              const std::vector<libsnark::r1cs_ppzksnark_primary_input<verifier_pp>> &primary_inputs,
+                              const std::vector<libsnark::r1cs_ppzksnark_proof<verifier_pp>> &proofs)
+{
+  assert(primary_inputs.size() == proofs.size());
+  std::vector<size_t> batch(proofs.size());
+  for (size_t i = 0; i < batch.size(); ++i) {
+    batch[i] = i;
+  }
+  return batch.empty() || batchVerifyProofs(bvk, primary_inputs, proofs, batch);
+}
+
+inline void bisectInvalidProofs(const batch_verification_key &bvk,
+                                const std::vector<libsnark::r1cs_ppzksnark_primary_input<verifier_pp>> &primary_inputs,
+                                const std::vector<libsnark::r1cs_ppzksnark_proof<verifier_pp>> &proofs,
+                                const std::vector<size_t> &batch,
+                                std::vector<size_t> &invalid)
+{
+  if (batchVerifyProofs(bvk, primary_inputs, proofs, batch)) {
+    return;
+  }
+  if (batch.size() == 1) {
+    invalid.push_back(batch[0]);
+    return;
+  }
+  const std::vector<size_t> lower(batch.begin(), batch.begin() + batch.size() / 2);
+  const std::vector<size_t> upper(batch.begin() + batch.size() / 2, batch.end());
+  bisectInvalidProofs(bvk, primary_inputs, proofs, lower, invalid);
+  bisectInvalidProofs(bvk, primary_inputs, proofs, upper, invalid);
+}
+
+// indices of the proofs that do not verify, in increasing order. Costs one
+// batch check when all proofs are valid and O(k log N) batch checks of
+// shrinking size for k invalid proofs.
+inline std::vector<size_t> findInvalidProofs(const batch_verification_key &bvk,
+                                             const std::vector<libsnark::r1cs_ppzksnark_primary_input<verifier_pp>> &primary_inputs,
+                                             const std::vector<libsnark::r1cs_ppzksnark_proof<verifier_pp>> &proofs)
+{
+  assert(primary_inputs.size() == proofs.size());
+  std::vector<size_t> batch(proofs.size());
+  for (size_t i = 0; i < batch.size(); ++i) {
+    batch[i] = i;
+  }
+
+  std::vector<size_t> invalid;
+  if (!batch.empty()) {
+    bisectInvalidProofs(bvk, primary_inputs, proofs, batch, invalid);
+  }
+  return invalid;
+}
+
+inline std::vector<size_t> findInvalidProofs(const libsnark::r1cs_ppzksnark_verification_key<verifier_pp> &vk,
+                                             const std::vector<libsnark::r1cs_ppzksnark_primary_input<verifier_pp>> &primary_inputs,
+                                             const std::vector<libsnark::r1cs_ppzksnark_proof<verifier_pp>> &proofs)
+{
+  return findInvalidProofs(batch_verification_key(vk), primary_inputs, proofs);
+}
+
+#endif // ZOKRATES_BATCH_VERIFIER_HPP_
@@ -0,0 +1,255 @@
+/**
+ * @file field_conversion.hpp
+ *
+ * Bulk conversion of field element vectors to and from packed 32 byte big
+ * endian values and to and from hex.
+ *
+ * A 32 byte big endian value is the four limbs in reverse order, each byte
+ * swapped, so a conversion is four loads and four bswaps instead of 32 shifts.
+ * Hex digits are produced eight at a time within a 64 bit word (nibbles
+ * spread to bytes, then mapped to '0'-'9' / 'a'-'f' without branches), and
+ * parsed the same way backwards: eight digits are range checked and mapped
+ * to nibbles in one word, then packed. None of it needs instruction set
+ * extensions. The vector functions write into
+ * buffers sized by the caller, allocate nothing per element and convert the
+ * elements in parallel.
+ */
+
+#ifndef ZOKRATES_FIELD_CONVERSION_HPP_
+#define ZOKRATES_FIELD_CONVERSION_HPP_
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+
+static_assert(libff::alt_bn128_r_limbs == 4 && libff::alt_bn128_q_limbs == 4, "conversions assume 4 limb fields");
+
+const size_t field_bytes = 32;
+const size_t field_hex_digits = 64;
+
+inline uint64_t loadBigEndian64(const uint8_t* in)
+{
+  uint64_t w;
+  memcpy(&w, in, 8);
+  return __builtin_bswap64(w);
+}
+
+inline void storeBigEndian64(uint64_t w, uint8_t* out)
+{
+  w = __builtin_bswap64(w);
+  memcpy(out, &w, 8);
+}
+
+// 32 bytes big endian to a bigint, no range check
+inline libff::bigint<4> bigintFromBytes32(const uint8_t* in)
+{
+  libff::bigint<4> x;
+  for (int i = 0; i < 4; ++i) {
+    x.data[3 - i] = loadBigEndian64(in + 8 * i);
+  }
+  return x;
+}
+
+inline void bigintToBytes32(const libff::bigint<4> &x, uint8_t* out)
+{
+  for (int i = 0; i < 4; ++i) {
+    storeBigEndian64(x.data[3 - i], out + 8 * i);
+  }
+}
+
+// the 8 hex digits of a 32 bit value, most significant first
+inline uint64_t hexDigits32(uint32_t x)
+{
+  // nibble k to byte k
+  uint64_t v = x;
+  v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+  v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+  v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  // 1 in every byte holding 10 or more
+  const uint64_t letters = ((v + 0x0606060606060606ULL) >> 4) & 0x0101010101010101ULL;
+  v += 0x3030303030303030ULL + letters * ('a' - '0' - 10);
+  // most significant nibble to the lowest address
+  return __builtin_bswap64(v);
+}
+
+// bytes of v that are >= c, or > c, as 0x80 per byte; bytes must be < 0x80
+inline uint64_t bytesAtLeast(uint64_t v, uint8_t c)
+{
+  return (v + 0x0101010101010101ULL * (0x80 - c)) & 0x8080808080808080ULL;
+}
+
+inline uint64_t bytesAbove(uint64_t v, uint8_t c)
+{
+  return (v + 0x0101010101010101ULL * (0x7f - c)) & 0x8080808080808080ULL;
+}
+
+// the value of 8 hex digits (either case), most significant first; false if
+// one of them is not a hex digit
+inline bool hexValue32(const char* in, uint32_t &x)
+{
+  uint64_t v;
+  memcpy(&v, in, 8);
+  // digit k (from the right) to byte k
+  v = __builtin_bswap64(v);
+  if (v & 0x8080808080808080ULL) {
+    return false;
+  }
+  const uint64_t digits = bytesAtLeast(v, '0') & ~bytesAbove(v, '9');
+  const uint64_t lower = v | 0x2020202020202020ULL;
+  const uint64_t letters = bytesAtLeast(lower, 'a') & ~bytesAbove(lower, 'f');
+  if ((digits | letters) != 0x8080808080808080ULL) {
+    return false;
+  }
+  // '0' and 'a' / 'A' end in 0 and 1
+  v = (v & 0x0f0f0f0f0f0f0f0fULL) + (letters >> 7) * 9;
+  // byte k to nibble k
+  v = (v | (v >> 4)) & 0x00ff00ff00ff00ffULL;
+  v = (v | (v >> 8)) & 0x0000ffff0000ffffULL;
+  v = (v | (v >> 16)) & 0x00000000ffffffffULL;
+  x = uint32_t(v);
+  return true;
+}
+
+// 64 hex digits to a bigint, no range check; false on a bad digit
+inline bool bigintFromHex(const char* in, libff::bigint<4> &x)
+{
+  for (int i = 0; i < 4; ++i) {
+    uint32_t hi, lo;
+    if (!hexValue32(in + 16 * i, hi) || !hexValue32(in + 16 * i + 8, lo)) {
+      return false;
+    }
+    x.data[3 - i] = (uint64_t(hi) << 32) | lo;
+  }
+  return true;
+}
+
+// 64 hex digits with leading zeros
+inline void bigintToHex(const libff::bigint<4> &x, char* out)
+{
+  for (int i = 0; i < 4; ++i) {
+    const uint64_t limb = x.data[3 - i];
+    const uint64_t hi = hexDigits32(uint32_t(limb >> 32)), lo = hexDigits32(uint32_t(limb));
+    memcpy(out + 16 * i, &hi, 8);
+    memcpy(out + 16 * i + 8, &lo, 8);
+  }
+}
+
+// number of leading zero digits in bigintToHex(x), keeping at least one digit
+inline size_t hexLeadingZeros(const libff::bigint<4> &x)
+{
+  for (int i = 3; i >= 0; --i) {
+    if (x.data[i] != 0) {
+      return 16 * (3 - i) + __builtin_clzll(x.data[i]) / 4;
+    }
+  }
+  return field_hex_digits - 1;
+}
+
+// digits of x without leading zeros, like HexStringFromLibsnarkBigint
+inline size_t bigintToShortHex(const libff::bigint<4> &x, char* out)
+{
+  char digits[field_hex_digits];
+  bigintToHex(x, digits);
+  const size_t skip = hexLeadingZeros(x);
+  memcpy(out, digits + skip, field_hex_digits - skip);
+  return field_hex_digits - skip;
+}
+
+// out[i] = the field element of the i-th 32 byte value, reduced like
+// FieldT(bigint); out is resized to count
+template<typename FieldT>
+void fieldsFromBytes(const uint8_t* in, size_t count, std::vector<FieldT> &out)
+{
+  out.resize(count);
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static, 1024)
+#endif
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = FieldT(bigintFromBytes32(in + field_bytes * i));
+  }
+}
+
+// out needs field_bytes * values.size() bytes
+template<typename FieldT>
+void fieldsToBytes(const std::vector<FieldT> &values, uint8_t* out)
+{
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static, 1024)
+#endif
+  for (size_t i = 0; i < values.size(); ++i) {
+    bigintToBytes32(values[i].as_bigint(), out + field_bytes * i);
+  }
+}
+
+// out[i] = the field element of the i-th field_hex_digits digits in in, as
+// fieldsToHex writes them, reduced like FieldT(bigint); out is resized to
+// count. Throws std::invalid_argument naming the first value with a
+// character that is not a hex digit.
+template<typename FieldT>
+void fieldsFromHex(const char* in, size_t count, std::vector<FieldT> &out)
+{
+  out.resize(count);
+  size_t bad = count;
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static, 1024)
+#endif
+  for (size_t i = 0; i < count; ++i) {
+    libff::bigint<4> x;
+    if (bigintFromHex(in + field_hex_digits * i, x)) {
+      out[i] = FieldT(x);
+    } else {
+#ifdef MULTICORE
+#pragma omp critical
+#endif
+      bad = std::min(bad, i);
+    }
+  }
+  if (bad != count) {
+    throw std::invalid_argument("value " + std::to_string(bad) + " is not " + std::to_string(field_hex_digits) + " hex digits");
+  }
+}
+
+// field_hex_digits per value with leading zeros, no separators; out needs
+// field_hex_digits * values.size() chars
+template<typename FieldT>
+void fieldsToHex(const std::vector<FieldT> &values, char* out)
+{
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static, 1024)
+#endif
+  for (size_t i = 0; i < values.size(); ++i) {
+    bigintToHex(values[i].as_bigint(), out + field_hex_digits * i);
+  }
+}
+
+// packed hex of all values; digits(i) is value i without leading zeros,
+// length(i) digits long. The buffers are reused across calls.
+struct field_hex_buffer {
+  std::vector<char> hex;
+  std::vector<uint8_t> offsets;
+
+  template<typename FieldT>
+  void assign(const std::vector<FieldT> &values)
+  {
+    hex.resize(field_hex_digits * values.size());
+    offsets.resize(values.size());
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static, 1024)
+#endif
+    for (size_t i = 0; i < values.size(); ++i) {
+      const libff::bigint<4> x = values[i].as_bigint();
+      bigintToHex(x, hex.data() + field_hex_digits * i);
+      offsets[i] = uint8_t(hexLeadingZeros(x));
+    }
+  }
+
+  size_t size() const { return offsets.size(); }
+  const char* digits(size_t i) const { return hex.data() + field_hex_digits * i + offsets[i]; }
+  size_t length(size_t i) const { return field_hex_digits - offsets[i]; }
+};
+
+#endif // ZOKRATES_FIELD_CONVERSION_HPP_
@@ -0,0 +1,511 @@
+/**
+ * @file field_kernels.hpp
+ *
+ * 4 limb Montgomery multiplication for alt_bn128's Fr and Fq, with a kernel
+ * picked at runtime.
+ *
+ * On x86-64 CPUs with BMI2 and ADX the multiplication runs as inline assembly:
+ * MULX leaves the flags alone, so the low and the high halves of the partial
+ * products are added in two independent carry chains, one on CF (ADCX) and
+ * one on OF (ADOX), interleaved with the reduction (CIOS). Everything else
+ * runs a portable version of the same algorithm on unsigned __int128. The
+ * assembly needs no compiler flags, so a build without -march=native (see the
+ * PORTABLE option) still gets it wherever the CPU has it; builds for a target
+ * with BMI2 and ADX skip cpuid. ZOKRATES_FIELD_KERNEL=portable forces the
+ * portable kernel.
+ *
+ * Both keep the operands below the modulus and produce the same Montgomery
+ * representation as libff, so fieldMul and operator* are interchangeable.
+ * They rely on the top limb of the modulus being below 2^63 - 1, which lets
+ * the intermediate result stay in four limbs. Squaring has kernels of its
+ * own, which compute each cross product once and double it before the
+ * reduction.
+ *
+ * Only arithmetic in this repository goes through the kernels (the FFTs and
+ * the constraint evaluation of the H step, batch affine conversion and the
+ * point additions of multiexp.hpp); libff's own group arithmetic, and so key
+ * generation, keeps its field code.
+ */
+
+#ifndef ZOKRATES_FIELD_KERNELS_HPP_
+#define ZOKRATES_FIELD_KERNELS_HPP_
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ZOKRATES_FIELD_KERNEL_ADX 1
+#include <cpuid.h>
+#endif
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+
+static_assert(sizeof(mp_limb_t) == 8 && libff::alt_bn128_r_limbs == 4 && libff::alt_bn128_q_limbs == 4,
+              "field kernels assume 4 limbs of 64 bits");
+
+struct montgomery_modulus {
+  uint64_t p[4];
+  // -p^-1 mod 2^64
+  uint64_t inv;
+};
+
+// the limbs of libff::alt_bn128_modulus_r and _q, which libff only sets in
+// init_alt_bn128_params(); bench_field checks that they match
+const montgomery_modulus alt_bn128_r_kernel_modulus = {
+  { 0x43e1f593f0000001ULL, 0x2833e84879b97091ULL, 0xb85045b68181585dULL, 0x30644e72e131a029ULL },
+  0xc2e1f593efffffffULL
+};
+const montgomery_modulus alt_bn128_q_kernel_modulus = {
+  { 0x3c208c16d87cfd47ULL, 0x97816a916871ca8dULL, 0xb85045b68181585dULL, 0x30644e72e131a029ULL },
+  0x87d20782e4866389ULL
+};
+
+// out = t - p if t >= p, else t
+inline void montReduceOnce(uint64_t* out, const uint64_t* t, const uint64_t* p)
+{
+  typedef unsigned __int128 u128;
+  uint64_t s[4];
+  uint64_t borrow = 0;
+  for (int j = 0; j < 4; ++j) {
+    const u128 d = u128(t[j]) - p[j] - borrow;
+    s[j] = uint64_t(d);
+    borrow = uint64_t(d >> 64) & 1;
+  }
+  memcpy(out, borrow ? t : s, 32);
+}
+
+// out = a * b / 2^256 mod p; out may alias a or b
+inline void montMulPortable(uint64_t* out, const uint64_t* a, const uint64_t* b, const montgomery_modulus &mod)
+{
+  typedef unsigned __int128 u128;
+  uint64_t t[4] = { 0, 0, 0, 0 };
+  for (int i = 0; i < 4; ++i) {
+    // t += a * b[i] and t = (t + m * p) / 2^64 in one pass
+    u128 x = u128(a[0]) * b[i] + t[0];
+    uint64_t A = uint64_t(x >> 64);
+    const uint64_t m = uint64_t(x) * mod.inv;
+    u128 y = u128(m) * mod.p[0] + uint64_t(x);
+    uint64_t C = uint64_t(y >> 64);
+    for (int j = 1; j < 4; ++j) {
+      x = u128(a[j]) * b[i] + t[j] + A;
+      A = uint64_t(x >> 64);
+      y = u128(m) * mod.p[j] + uint64_t(x) + C;
+      C = uint64_t(y >> 64);
+      t[j - 1] = uint64_t(y);
+    }
+    t[3] = A + C;
+  }
+  montReduceOnce(out, t, mod.p);
+}
+
+// t[0..7] = (t + m * p) / 2^256 with m chosen limb by limb (SOS reduction),
+// then reduced once; the result is in out. t < p * 2^256 keeps every
+// partial sum within eight limbs.
+inline void montReducePortable(uint64_t* out, uint64_t* t, const montgomery_modulus &mod)
+{
+  typedef unsigned __int128 u128;
+  // carry of round i into t[i + 5], picked up by round i + 1
+  uint64_t top = 0;
+#pragma GCC unroll 8
+  for (int i = 0; i < 4; ++i) {
+    const uint64_t m = t[i] * mod.inv;
+    uint64_t carry = 0;
+#pragma GCC unroll 8
+    for (int j = 0; j < 4; ++j) {
+      const u128 x = u128(m) * mod.p[j] + t[i + j] + carry;
+      t[i + j] = uint64_t(x);
+      carry = uint64_t(x >> 64);
+    }
+    const u128 x = u128(t[i + 4]) + carry + top;
+    t[i + 4] = uint64_t(x);
+    top = uint64_t(x >> 64);
+  }
+  montReduceOnce(out, t + 4, mod.p);
+}
+
+// out = a^2 / 2^256 mod p; out may alias a. The cross products a[i] * a[j],
+// i < j, are computed once and doubled, 10 multiplications instead of 16
+// before the reduction. The loops are unrolled so that t stays in registers,
+// which -O2 does not do on its own.
+inline void montSqrPortable(uint64_t* out, const uint64_t* a, const montgomery_modulus &mod)
+{
+  typedef unsigned __int128 u128;
+  uint64_t t[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+#pragma GCC unroll 8
+  for (int i = 0; i < 3; ++i) {
+    uint64_t carry = 0;
+#pragma GCC unroll 8
+    for (int j = i + 1; j < 4; ++j) {
+      const u128 x = u128(a[i]) * a[j] + t[i + j] + carry;
+      t[i + j] = uint64_t(x);
+      carry = uint64_t(x >> 64);
+    }
+    t[i + 4] = carry;
+  }
+  // double the cross products and add the squares a[i]^2 at limb 2 i
+  t[7] = t[6] >> 63;
+#pragma GCC unroll 8
+  for (int k = 6; k > 0; --k) {
+    t[k] = (t[k] << 1) | (t[k - 1] >> 63);
+  }
+  uint64_t carry = 0;
+#pragma GCC unroll 8
+  for (int i = 0; i < 4; ++i) {
+    const u128 square = u128(a[i]) * a[i];
+    const u128 lo = u128(t[2 * i]) + uint64_t(square) + carry;
+    t[2 * i] = uint64_t(lo);
+    const u128 hi = u128(t[2 * i + 1]) + uint64_t(square >> 64) + uint64_t(lo >> 64);
+    t[2 * i + 1] = uint64_t(hi);
+    carry = uint64_t(hi >> 64);
+  }
+  montReducePortable(out, t, mod);
+}
+
+#ifdef ZOKRATES_FIELD_KERNEL_ADX
+
+// t += a * b[i]: low halves on OF into t0..t3, high halves on CF into t1..t3,
+// the top limb into A
+#define ZOKRATES_MULX_ROUND(b_offset)             \
+  "movq " #b_offset "(%[b]), %%rdx\n\t"           \
+  "xorl %k[z], %k[z]\n\t"                         \
+  "mulxq 0(%[a]), %[lo], %[hi]\n\t"               \
+  "adoxq %[lo], %[t0]\n\t"                        \
+  "adcxq %[hi], %[t1]\n\t"                        \
+  "mulxq 8(%[a]), %[lo], %[hi]\n\t"               \
+  "adoxq %[lo], %[t1]\n\t"                        \
+  "adcxq %[hi], %[t2]\n\t"                        \
+  "mulxq 16(%[a]), %[lo], %[hi]\n\t"              \
+  "adoxq %[lo], %[t2]\n\t"                        \
+  "adcxq %[hi], %[t3]\n\t"                        \
+  "mulxq 24(%[a]), %[lo], %[A]\n\t"               \
+  "adoxq %[lo], %[t3]\n\t"                        \
+  "adcxq %[z], %[A]\n\t"                          \
+  "adoxq %[z], %[A]\n\t"
+
+// t = (t + m * p) / 2^64 with m = t0 * inv: low halves on CF, high halves
+// on OF, then the limbs shift down by one
+#define ZOKRATES_MULX_REDUCE                      \
+  "movq %[t0], %%rdx\n\t"                         \
+  "imulq %[inv], %%rdx\n\t"                       \
+  "xorl %k[z], %k[z]\n\t"                         \
+  "mulxq 0(%[p]), %[lo], %[hi]\n\t"               \
+  "adcxq %[lo], %[t0]\n\t"                        \
+  "adoxq %[hi], %[t1]\n\t"                        \
+  "mulxq 8(%[p]), %[lo], %[hi]\n\t"               \
+  "adcxq %[lo], %[t1]\n\t"                        \
+  "adoxq %[hi], %[t2]\n\t"                        \
+  "mulxq 16(%[p]), %[lo], %[hi]\n\t"              \
+  "adcxq %[lo], %[t2]\n\t"                        \
+  "adoxq %[hi], %[t3]\n\t"                        \
+  "mulxq 24(%[p]), %[lo], %[hi]\n\t"              \
+  "adcxq %[lo], %[t3]\n\t"                        \
+  "adcxq %[z], %[hi]\n\t"                         \
+  "adoxq %[A], %[hi]\n\t"                         \
+  "movq %[t1], %[t0]\n\t"                         \
+  "movq %[t2], %[t1]\n\t"                         \
+  "movq %[t3], %[t2]\n\t"                         \
+  "movq %[hi], %[t3]\n\t"
+
+// same result as montMulPortable; only to be called when the CPU has BMI2
+// and ADX
+inline void montMulAdx(uint64_t* out, const uint64_t* a, const uint64_t* b, const montgomery_modulus &mod)
+{
+  uint64_t t0, t1, t2, t3, lo, hi, A, z;
+  __asm__(
+    // the first round starts from t = 0, one carry chain is enough
+    "movq 0(%[b]), %%rdx\n\t"
+    "xorl %k[z], %k[z]\n\t"
+    "mulxq 0(%[a]), %[t0], %[t1]\n\t"
+    "mulxq 8(%[a]), %[lo], %[t2]\n\t"
+    "adcxq %[lo], %[t1]\n\t"
+    "mulxq 16(%[a]), %[lo], %[t3]\n\t"
+    "adcxq %[lo], %[t2]\n\t"
+    "mulxq 24(%[a]), %[lo], %[A]\n\t"
+    "adcxq %[lo], %[t3]\n\t"
+    "adcxq %[z], %[A]\n\t"
+    ZOKRATES_MULX_REDUCE
+    ZOKRATES_MULX_ROUND(8)
+    ZOKRATES_MULX_REDUCE
+    ZOKRATES_MULX_ROUND(16)
+    ZOKRATES_MULX_REDUCE
+    ZOKRATES_MULX_ROUND(24)
+    ZOKRATES_MULX_REDUCE
+    // t < 2p, subtract p unless that borrows
+    "movq %[t0], %[lo]\n\t"
+    "subq 0(%[p]), %[lo]\n\t"
+    "movq %[t1], %[hi]\n\t"
+    "sbbq 8(%[p]), %[hi]\n\t"
+    "movq %[t2], %[A]\n\t"
+    "sbbq 16(%[p]), %[A]\n\t"
+    "movq %[t3], %[z]\n\t"
+    "sbbq 24(%[p]), %[z]\n\t"
+    "cmovncq %[lo], %[t0]\n\t"
+    "cmovncq %[hi], %[t1]\n\t"
+    "cmovncq %[A], %[t2]\n\t"
+    "cmovncq %[z], %[t3]\n\t"
+    : [t0] "=&r" (t0), [t1] "=&r" (t1), [t2] "=&r" (t2), [t3] "=&r" (t3),
+      [lo] "=&r" (lo), [hi] "=&r" (hi), [A] "=&r" (A), [z] "=&r" (z)
+    : [a] "r" (a), [b] "r" (b), [p] "r" (mod.p), [inv] "rm" (mod.inv)
+    // "memory" for the limbs behind a and b; array operands for them would
+    // need more registers than an unoptimized build has left
+    : "rdx", "cc", "memory");
+  out[0] = t0;
+  out[1] = t1;
+  out[2] = t2;
+  out[3] = t3;
+}
+
+#undef ZOKRATES_MULX_ROUND
+#undef ZOKRATES_MULX_REDUCE
+
+// t[i..7] += m * p * 2^(64 i) with m = t[i] * inv, zeroing t[i]: low halves
+// on CF, high halves on OF, both carried up to t7
+#define ZOKRATES_MULX_SQR_REDUCE(ti, t1, t2, t3, t4) \
+  "movq %[" #ti "], %%rdx\n\t"                     \
+  "imulq %[inv], %%rdx\n\t"                        \
+  "xorl %k[z], %k[z]\n\t"                          \
+  "mulxq 0(%[p]), %[lo], %[hi]\n\t"                \
+  "adcxq %[lo], %[" #ti "]\n\t"                    \
+  "adoxq %[hi], %[" #t1 "]\n\t"                    \
+  "mulxq 8(%[p]), %[lo], %[hi]\n\t"                \
+  "adcxq %[lo], %[" #t1 "]\n\t"                    \
+  "adoxq %[hi], %[" #t2 "]\n\t"                    \
+  "mulxq 16(%[p]), %[lo], %[hi]\n\t"               \
+  "adcxq %[lo], %[" #t2 "]\n\t"                    \
+  "adoxq %[hi], %[" #t3 "]\n\t"                    \
+  "mulxq 24(%[p]), %[lo], %[hi]\n\t"               \
+  "adcxq %[lo], %[" #t3 "]\n\t"                    \
+  "adoxq %[hi], %[" #t4 "]\n\t"                    \
+  "adcxq %[z], %[" #t4 "]\n\t"
+
+#define ZOKRATES_MULX_CARRY(tk)                   \
+  "adcxq %[z], %[" #tk "]\n\t"                     \
+  "adoxq %[z], %[" #tk "]\n\t"
+
+// same result as montSqrPortable; only to be called when the CPU has BMI2
+// and ADX. Two blocks, the 512 bit square and its reduction, so that neither
+// needs more registers than an unoptimized build has left.
+inline void montSqrAdx(uint64_t* out, const uint64_t* a, const montgomery_modulus &mod)
+{
+  uint64_t t0, t1, t2, t3, t4, t5, t6, t7, lo, hi, z;
+  __asm__(
+    // cross products a0 * a1..a3 into t1..t4
+    "movq 0(%[a]), %%rdx\n\t"
+    "xorl %k[z], %k[z]\n\t"
+    "mulxq 8(%[a]), %[t1], %[t2]\n\t"
+    "mulxq 16(%[a]), %[lo], %[t3]\n\t"
+    "adcxq %[lo], %[t2]\n\t"
+    "mulxq 24(%[a]), %[lo], %[t4]\n\t"
+    "adcxq %[lo], %[t3]\n\t"
+    "adcxq %[z], %[t4]\n\t"
+    // a1 * a2..a3 into t3..t5
+    "movq 8(%[a]), %%rdx\n\t"
+    "xorl %k[z], %k[z]\n\t"
+    "mulxq 16(%[a]), %[lo], %[hi]\n\t"
+    "adoxq %[lo], %[t3]\n\t"
+    "adcxq %[hi], %[t4]\n\t"
+    "mulxq 24(%[a]), %[lo], %[t5]\n\t"
+    "adoxq %[lo], %[t4]\n\t"
+    "adcxq %[z], %[t5]\n\t"
+    "adoxq %[z], %[t5]\n\t"
+    // a2 * a3 into t5..t6
+    "movq 16(%[a]), %%rdx\n\t"
+    "xorl %k[z], %k[z]\n\t"
+    "mulxq 24(%[a]), %[lo], %[t6]\n\t"
+    "adcxq %[lo], %[t5]\n\t"
+    "adcxq %[z], %[t6]\n\t"
+    // doubled on CF, the top bit into t7
+    "xorl %k[z], %k[z]\n\t"
+    "movq %[z], %[t7]\n\t"
+    "adcxq %[t1], %[t1]\n\t"
+    "adcxq %[t2], %[t2]\n\t"
+    "adcxq %[t3], %[t3]\n\t"
+    "adcxq %[t4], %[t4]\n\t"
+    "adcxq %[t5], %[t5]\n\t"
+    "adcxq %[t6], %[t6]\n\t"
+    "adcxq %[z], %[t7]\n\t"
+    // the squares a[i]^2 at limb 2 i, on OF
+    "movq 0(%[a]), %%rdx\n\t"
+    "mulxq %%rdx, %[t0], %[hi]\n\t"
+    "adoxq %[hi], %[t1]\n\t"
+    "movq 8(%[a]), %%rdx\n\t"
+    "mulxq %%rdx, %[lo], %[hi]\n\t"
+    "adoxq %[lo], %[t2]\n\t"
+    "adoxq %[hi], %[t3]\n\t"
+    "movq 16(%[a]), %%rdx\n\t"
+    "mulxq %%rdx, %[lo], %[hi]\n\t"
+    "adoxq %[lo], %[t4]\n\t"
+    "adoxq %[hi], %[t5]\n\t"
+    "movq 24(%[a]), %%rdx\n\t"
+    "mulxq %%rdx, %[lo], %[hi]\n\t"
+    "adoxq %[lo], %[t6]\n\t"
+    "adoxq %[hi], %[t7]\n\t"
+    : [t0] "=&r" (t0), [t1] "=&r" (t1), [t2] "=&r" (t2), [t3] "=&r" (t3),
+      [t4] "=&r" (t4), [t5] "=&r" (t5), [t6] "=&r" (t6), [t7] "=&r" (t7),
+      [lo] "=&r" (lo), [hi] "=&r" (hi), [z] "=&r" (z)
+    : [a] "r" (a)
+    : "rdx", "cc", "memory");
+  __asm__(
+    ZOKRATES_MULX_SQR_REDUCE(t0, t1, t2, t3, t4)
+    ZOKRATES_MULX_CARRY(t5)
+    ZOKRATES_MULX_CARRY(t6)
+    ZOKRATES_MULX_CARRY(t7)
+    ZOKRATES_MULX_SQR_REDUCE(t1, t2, t3, t4, t5)
+    ZOKRATES_MULX_CARRY(t6)
+    ZOKRATES_MULX_CARRY(t7)
+    ZOKRATES_MULX_SQR_REDUCE(t2, t3, t4, t5, t6)
+    ZOKRATES_MULX_CARRY(t7)
+    ZOKRATES_MULX_SQR_REDUCE(t3, t4, t5, t6, t7)
+    // t4..t7 < 2p, subtract p unless that borrows
+    "movq %[t4], %[t0]\n\t"
+    "subq 0(%[p]), %[t0]\n\t"
+    "movq %[t5], %[t1]\n\t"
+    "sbbq 8(%[p]), %[t1]\n\t"
+    "movq %[t6], %[t2]\n\t"
+    "sbbq 16(%[p]), %[t2]\n\t"
+    "movq %[t7], %[t3]\n\t"
+    "sbbq 24(%[p]), %[t3]\n\t"
+    "cmovncq %[t0], %[t4]\n\t"
+    "cmovncq %[t1], %[t5]\n\t"
+    "cmovncq %[t2], %[t6]\n\t"
+    "cmovncq %[t3], %[t7]\n\t"
+    : [t0] "+r" (t0), [t1] "+r" (t1), [t2] "+r" (t2), [t3] "+r" (t3),
+      [t4] "+r" (t4), [t5] "+r" (t5), [t6] "+r" (t6), [t7] "+r" (t7),
+      [lo] "=&r" (lo), [hi] "=&r" (hi), [z] "=&r" (z)
+    : [p] "r" (mod.p), [inv] "rm" (mod.inv)
+    : "rdx", "cc", "memory");
+  out[0] = t4;
+  out[1] = t5;
+  out[2] = t6;
+  out[3] = t7;
+}
+
+#undef ZOKRATES_MULX_SQR_REDUCE
+#undef ZOKRATES_MULX_CARRY
+
+inline bool cpuHasBmi2Adx()
+{
+  unsigned eax, ebx, ecx, edx;
+  if (__get_cpuid_max(0, nullptr) < 7 || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return (ebx & bit_BMI2) != 0 && (ebx & bit_ADX) != 0;
+}
+
+#endif // ZOKRATES_FIELD_KERNEL_ADX
+
+enum field_kernel_type {
+  field_kernel_portable,
+  field_kernel_adx
+};
+
+inline const char* fieldKernelName(field_kernel_type kernel)
+{
+  return kernel == field_kernel_adx ? "adx" : "portable";
+}
+
+inline field_kernel_type detectFieldKernel()
+{
+  const char* env = getenv("ZOKRATES_FIELD_KERNEL");
+  if (env != nullptr && strcmp(env, "portable") == 0) {
+    return field_kernel_portable;
+  }
+#if defined(ZOKRATES_FIELD_KERNEL_ADX) && defined(__BMI2__) && defined(__ADX__)
+  return field_kernel_adx;
+#elif defined(ZOKRATES_FIELD_KERNEL_ADX)
+  return cpuHasBmi2Adx() ? field_kernel_adx : field_kernel_portable;
+#else
+  return field_kernel_portable;
+#endif
+}
+
+// decided on first use
+inline field_kernel_type fieldKernel()
+{
+  static const field_kernel_type kernel = detectFieldKernel();
+  return kernel;
+}
+
+inline void montMul(uint64_t* out, const uint64_t* a, const uint64_t* b, const montgomery_modulus &mod)
+{
+#ifdef ZOKRATES_FIELD_KERNEL_ADX
+  if (fieldKernel() == field_kernel_adx) {
+    montMulAdx(out, a, b, mod);
+    return;
+  }
+#endif
+  montMulPortable(out, a, b, mod);
+}
+
+inline void montSqr(uint64_t* out, const uint64_t* a, const montgomery_modulus &mod)
+{
+#ifdef ZOKRATES_FIELD_KERNEL_ADX
+  if (fieldKernel() == field_kernel_adx) {
+    montSqrAdx(out, a, mod);
+    return;
+  }
+#endif
+  montSqrPortable(out, a, mod);
+}
+
+// libff's operator* for everything without a kernel
+template<typename FieldT>
+FieldT fieldMul(const FieldT &a, const FieldT &b)
+{
+  return a * b;
+}
+
+template<typename FieldT>
+FieldT fieldSqr(const FieldT &a)
+{
+  return a.squared();
+}
+
+inline libff::alt_bn128_Fr fieldMul(const libff::alt_bn128_Fr &a, const libff::alt_bn128_Fr &b)
+{
+  libff::alt_bn128_Fr r;
+  montMul(r.mont_repr.data, a.mont_repr.data, b.mont_repr.data, alt_bn128_r_kernel_modulus);
+  return r;
+}
+
+inline libff::alt_bn128_Fr fieldSqr(const libff::alt_bn128_Fr &a)
+{
+  libff::alt_bn128_Fr r;
+  montSqr(r.mont_repr.data, a.mont_repr.data, alt_bn128_r_kernel_modulus);
+  return r;
+}
+
+inline libff::alt_bn128_Fq fieldMul(const libff::alt_bn128_Fq &a, const libff::alt_bn128_Fq &b)
+{
+  libff::alt_bn128_Fq r;
+  montMul(r.mont_repr.data, a.mont_repr.data, b.mont_repr.data, alt_bn128_q_kernel_modulus);
+  return r;
+}
+
+inline libff::alt_bn128_Fq fieldSqr(const libff::alt_bn128_Fq &a)
+{
+  libff::alt_bn128_Fq r;
+  montSqr(r.mont_repr.data, a.mont_repr.data, alt_bn128_q_kernel_modulus);
+  return r;
+}
+
+// Karatsuba, as libff's Fp2_model::operator*
+inline libff::alt_bn128_Fq2 fieldMul(const libff::alt_bn128_Fq2 &x, const libff::alt_bn128_Fq2 &y)
+{
+  const libff::alt_bn128_Fq aA = fieldMul(x.c0, y.c0);
+  const libff::alt_bn128_Fq bB = fieldMul(x.c1, y.c1);
+  return libff::alt_bn128_Fq2(aA + fieldMul(libff::alt_bn128_Fq2::non_residue, bB),
+                              fieldMul(x.c0 + x.c1, y.c0 + y.c1) - aA - bB);
+}
+
+// complex squaring, as libff's Fp2_model::squared
+inline libff::alt_bn128_Fq2 fieldSqr(const libff::alt_bn128_Fq2 &x)
+{
+  const libff::alt_bn128_Fq ab = fieldMul(x.c0, x.c1);
+  const libff::alt_bn128_Fq nr_b = fieldMul(libff::alt_bn128_Fq2::non_residue, x.c1);
+  const libff::alt_bn128_Fq nr_ab = fieldMul(libff::alt_bn128_Fq2::non_residue, ab);
+  return libff::alt_bn128_Fq2(fieldMul(x.c0 + x.c1, x.c0 + nr_b) - ab - nr_ab, ab + ab);
+}
+
+#endif // ZOKRATES_FIELD_KERNELS_HPP_
@@ -0,0 +1,311 @@
+/**
+ * @file flat_r1cs.hpp
+ *
+ * Flat constraint storage: per matrix (A, B, C) one array of row offsets and
+ * one array of (index, coefficient) terms, instead of a heap allocated
+ * linear_combination per matrix and row.
+ *
+ * flat_r1cs owns its arrays, carved out of a single allocation; a
+ * flat_r1cs_view only points to them, which also lets it point straight into
+ * the constraint system section of a mapped binary proving key (the term
+ * layout is the same, see pk_binary.hpp). Building a flat_r1cs costs one
+ * allocation however many constraints there are, and since every row's
+ * position is known up front it can be filled in parallel.
+ *
+ * flatQapWitnessMap is r1cs_to_qap_witness_map over a flat view and returns
+ * the same QAP witness, with the FFTs run by a qap_domain that can be shared
+ * between proofs. Key generation still needs libsnark's
+ * r1cs_constraint_system, which the proving key embeds;
+ * constraintSystemFromFlat builds it with exactly sized rows.
+ */
+
+#ifndef ZOKRATES_FLAT_R1CS_HPP_
+#define ZOKRATES_FLAT_R1CS_HPP_
+
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+#include <libfqfft/evaluation_domain/get_evaluation_domain.hpp>
+#include <libsnark/reductions/r1cs_to_qap/r1cs_to_qap.hpp>
+#include <libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp>
+
+#include "field_kernels.hpp"
+#include "qap_domain.hpp"
+
+struct flat_term {
+  uint64_t index;
+  libff::alt_bn128_Fr coeff;
+};
+
+static_assert(sizeof(flat_term) == 8 + sizeof(libff::alt_bn128_Fr), "flat_term has to match the binary key's term layout");
+
+// terms[offsets[row]] .. terms[offsets[row + 1] - 1] make up a row
+struct flat_matrix_view {
+  const uint64_t* offsets = nullptr;
+  const flat_term* terms = nullptr;
+
+  size_t numTerms(size_t num_constraints) const { return offsets[num_constraints]; }
+
+  // the row's linear combination at full_assignment, full_assignment[0] being ~one
+  libff::alt_bn128_Fr evaluate(size_t row, const libff::alt_bn128_Fr* full_assignment) const
+  {
+    libff::alt_bn128_Fr acc = libff::alt_bn128_Fr::zero();
+    for (uint64_t k = offsets[row]; k < offsets[row + 1]; ++k) {
+      acc += fieldMul(terms[k].coeff, full_assignment[terms[k].index]);
+    }
+    return acc;
+  }
+};
+
+struct flat_r1cs_view {
+  size_t primary_input_size = 0;
+  size_t auxiliary_input_size = 0;
+  size_t num_constraints = 0;
+  flat_matrix_view matrices[3];
+
+  size_t num_inputs() const { return primary_input_size; }
+  size_t num_variables() const { return primary_input_size + auxiliary_input_size; }
+  size_t domainMinSize() const { return qapDomainMinSize(num_constraints, primary_input_size); }
+};
+
+class flat_r1cs {
+public:
+  // allocates room for num_terms[m] terms in matrix m; offsets[m][0] is 0,
+  // the rest has to be filled in together with the terms
+  flat_r1cs(size_t primary_input_size, size_t auxiliary_input_size, size_t num_constraints, const size_t num_terms[3])
+  {
+    v.primary_input_size = primary_input_size;
+    v.auxiliary_input_size = auxiliary_input_size;
+    v.num_constraints = num_constraints;
+
+    const size_t offset_words = num_constraints + 1;
+    size_t words = 3 * offset_words;
+    for (int m = 0; m < 3; ++m) {
+      words += num_terms[m] * (sizeof(flat_term) / 8);
+    }
+    arena.reset(new uint64_t[words]);
+
+    uint64_t* p = arena.get();
+    for (int m = 0; m < 3; ++m) {
+      offsets_[m] = p;
+      offsets_[m][0] = 0;
+      p += offset_words;
+    }
+    for (int m = 0; m < 3; ++m) {
+      terms_[m] = reinterpret_cast<flat_term*>(p);
+      p += num_terms[m] * (sizeof(flat_term) / 8);
+      v.matrices[m].offsets = offsets_[m];
+      v.matrices[m].terms = terms_[m];
+    }
+  }
+
+  flat_r1cs(const flat_r1cs&) = delete;
+  flat_r1cs& operator=(const flat_r1cs&) = delete;
+
+  uint64_t* offsets(int m) { return offsets_[m]; }
+  flat_term* terms(int m) { return terms_[m]; }
+
+  const flat_r1cs_view& view() const { return v; }
+
+private:
+  std::unique_ptr<uint64_t[]> arena;
+  uint64_t* offsets_[3];
+  flat_term* terms_[3];
+  flat_r1cs_view v;
+};
+
+inline const libsnark::linear_combination<libff::alt_bn128_Fr>& matrixRow(const libsnark::r1cs_constraint<libff::alt_bn128_Fr> &constraint, int m)
+{
+  return m == 0 ? constraint.a : m == 1 ? constraint.b : constraint.c;
+}
+
+inline std::unique_ptr<flat_r1cs> flatR1csFromConstraintSystem(const libsnark::r1cs_constraint_system<libff::alt_bn128_Fr> &cs)
+{
+  size_t num_terms[3] = { 0, 0, 0 };
+  for (const libsnark::r1cs_constraint<libff::alt_bn128_Fr> &constraint : cs.constraints) {
+    for (int m = 0; m < 3; ++m) {
+      num_terms[m] += matrixRow(constraint, m).terms.size();
+    }
+  }
+
+  std::unique_ptr<flat_r1cs> flat(new flat_r1cs(cs.primary_input_size, cs.auxiliary_input_size, cs.num_constraints(), num_terms));
+  for (int m = 0; m < 3; ++m) {
+    uint64_t* offsets = flat->offsets(m);
+    flat_term* terms = flat->terms(m);
+    uint64_t k = 0;
+    for (size_t row = 0; row < cs.constraints.size(); ++row) {
+      for (const libsnark::linear_term<libff::alt_bn128_Fr> &lt : matrixRow(cs.constraints[row], m).terms) {
+        terms[k].index = lt.index;
+        terms[k].coeff = lt.coeff;
+        ++k;
+      }
+      offsets[row + 1] = k;
+    }
+  }
+  return flat;
+}
+
+// Checks offsets and variable indices, so that evaluate() stays in bounds
+// for a view that was read from a file.
+inline void checkFlatR1cs(const flat_r1cs_view &flat)
+{
+  const size_t n = flat.num_constraints;
+  for (int m = 0; m < 3; ++m) {
+    const flat_matrix_view &matrix = flat.matrices[m];
+    if (matrix.offsets[0] != 0) {
+      throw std::runtime_error("flat r1cs: corrupted constraint offsets");
+    }
+    for (size_t row = 0; row < n; ++row) {
+      if (matrix.offsets[row] > matrix.offsets[row + 1]) {
+        throw std::runtime_error("flat r1cs: corrupted constraint offsets");
+      }
+    }
+    for (uint64_t k = 0; k < matrix.numTerms(n); ++k) {
+      if (matrix.terms[k].index > flat.num_variables()) {
+        throw std::runtime_error("flat r1cs: variable index " + std::to_string(matrix.terms[k].index) + " out of range");
+      }
+    }
+  }
+}
+
+// libsnark constraint system with the same constraints, rows sized exactly
+inline libsnark::r1cs_constraint_system<libff::alt_bn128_Fr> constraintSystemFromFlat(const flat_r1cs_view &flat)
+{
+  typedef libff::alt_bn128_Fr Fr;
+
+  libsnark::r1cs_constraint_system<Fr> cs;
+  cs.primary_input_size = flat.primary_input_size;
+  cs.auxiliary_input_size = flat.auxiliary_input_size;
+  cs.constraints.resize(flat.num_constraints);
+
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static, 4096)
+#endif
+  for (size_t row = 0; row < flat.num_constraints; ++row) {
+    libsnark::r1cs_constraint<Fr> &constraint = cs.constraints[row];
+    for (int m = 0; m < 3; ++m) {
+      const flat_matrix_view &matrix = flat.matrices[m];
+      libsnark::linear_combination<Fr> &lc = (m == 0 ? constraint.a : m == 1 ? constraint.b : constraint.c);
+      lc.terms.reserve(matrix.offsets[row + 1] - matrix.offsets[row]);
+      for (uint64_t k = matrix.offsets[row]; k < matrix.offsets[row + 1]; ++k) {
+        lc.terms.emplace_back(libsnark::variable<Fr>(matrix.terms[k].index), matrix.terms[k].coeff);
+      }
+    }
+  }
+  return cs;
+}
+
+// r1cs_to_qap_witness_map for a flat constraint system, step for step;
+// domain has to be qap_domain(flat.domainMinSize())
+inline libsnark::qap_witness<libff::alt_bn128_Fr> flatQapWitnessMap(const flat_r1cs_view &flat,
+                                                                   const qap_domain &domain,
+                                                                   const libsnark::r1cs_primary_input<libff::alt_bn128_Fr> &primary_input,
+                                                                   const libsnark::r1cs_auxiliary_input<libff::alt_bn128_Fr> &auxiliary_input,
+                                                                   const libff::alt_bn128_Fr &d1,
+                                                                   const libff::alt_bn128_Fr &d2,
+                                                                   const libff::alt_bn128_Fr &d3)
+{
+  typedef libff::alt_bn128_Fr Fr;
+
+  const size_t n = flat.num_constraints;
+  const size_t num_inputs = flat.num_inputs();
+  if (primary_input.size() != num_inputs || primary_input.size() + auxiliary_input.size() != flat.num_variables()) {
+    throw std::invalid_argument("witness does not match the constraint system");
+  }
+  if (domain.m < flat.domainMinSize()) {
+    throw std::invalid_argument("qap domain is too small for the constraint system");
+  }
+
+  // ~one followed by the assignment, so that terms index it directly
+  std::vector<Fr> full(1 + flat.num_variables());
+  full[0] = Fr::one();
+  std::copy(primary_input.begin(), primary_input.end(), full.begin() + 1);
+  std::copy(auxiliary_input.begin(), auxiliary_input.end(), full.begin() + 1 + num_inputs);
+  const Fr* s = full.data();
+
+  std::vector<Fr> aA(domain.m, Fr::zero()), aB(domain.m, Fr::zero());
+  // the additional constraints input_i * 0 = 0
+  for (size_t i = 0; i <= num_inputs; ++i) {
+    aA[i + n] = s[i];
+  }
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+  for (size_t row = 0; row < n; ++row) {
+    aA[row] += flat.matrices[0].evaluate(row, s);
+    aB[row] += flat.matrices[1].evaluate(row, s);
+  }
+
+  domain.iFFT(aA);
+  domain.iFFT(aB);
+
+  std::vector<Fr> coefficients_for_H(domain.m + 1, Fr::zero());
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+  for (size_t i = 0; i < domain.m; ++i) {
+    coefficients_for_H[i] = fieldMul(d2, aA[i]) + fieldMul(d1, aB[i]);
+  }
+  coefficients_for_H[0] -= d3;
+  domain.add_poly_Z(d1 * d2, coefficients_for_H);
+
+  domain.cosetFFT(aA, Fr::multiplicative_generator);
+  domain.cosetFFT(aB, Fr::multiplicative_generator);
+
+  std::vector<Fr> &H_tmp = aA;
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+  for (size_t i = 0; i < domain.m; ++i) {
+    H_tmp[i] = fieldMul(aA[i], aB[i]);
+  }
+  std::vector<Fr>().swap(aB);
+
+  std::vector<Fr> aC(domain.m, Fr::zero());
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+  for (size_t row = 0; row < n; ++row) {
+    aC[row] += flat.matrices[2].evaluate(row, s);
+  }
+
+  domain.iFFT(aC);
+  domain.cosetFFT(aC, Fr::multiplicative_generator);
+
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+  for (size_t i = 0; i < domain.m; ++i) {
+    H_tmp[i] = H_tmp[i] - aC[i];
+  }
+
+  domain.divide_by_Z_on_coset(H_tmp);
+  domain.icosetFFT(H_tmp, Fr::multiplicative_generator);
+
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+  for (size_t i = 0; i < domain.m; ++i) {
+    coefficients_for_H[i] += H_tmp[i];
+  }
+
+  full.erase(full.begin());
+  return libsnark::qap_witness<Fr>(flat.num_variables(), domain.m, num_inputs, d1, d2, d3, std::move(full), std::move(coefficients_for_H));
+}
+
+inline libsnark::qap_witness<libff::alt_bn128_Fr> flatQapWitnessMap(const flat_r1cs_view &flat,
+                                                                   const libsnark::r1cs_primary_input<libff::alt_bn128_Fr> &primary_input,
+                                                                   const libsnark::r1cs_auxiliary_input<libff::alt_bn128_Fr> &auxiliary_input,
+                                                                   const libff::alt_bn128_Fr &d1,
+                                                                   const libff::alt_bn128_Fr &d2,
+                                                                   const libff::alt_bn128_Fr &d3)
+{
+  const qap_domain domain(flat.domainMinSize());
+  return flatQapWitnessMap(flat, domain, primary_input, auxiliary_input, d1, d2, d3);
+}
+
+#endif // ZOKRATES_FLAT_R1CS_HPP_
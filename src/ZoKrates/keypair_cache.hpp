@@ -0,0 +1,280 @@
+/**
+ * @file keypair_cache.hpp
+ *
+ * Content addressed store for r1cs_ppzksnark keypairs.
+ *
+ * A keypair is filed under the SHA-256 of a canonical encoding of its
+ * constraint system (curve, input sizes, and every constraint with its terms
+ * sorted by variable and merged), so the generator only has to run for
+ * circuits that have not been seen before. On a hit the constraint system
+ * stored in the proving key is hashed again, so a key is never returned for
+ * a circuit it was not generated for.
+ *
+ * The generator stores the constraint system with A and B swapped when B
+ * touches more variables (r1cs_constraint_system::swap_AB_if_beneficial), so
+ * the encoding swaps them under the same rule: a circuit and the copy kept
+ * in its proving key hash the same.
+ *
+ * Layout: <dir>/<hash>.pk (binary format of pk_binary.hpp) and
+ * <dir>/<hash>.vk (libsnark's operator<<). Entries are written to temporary
+ * files, unique per process and store() call, and renamed into place, so
+ * concurrent writers, processes or threads, never expose a partially
+ * written key.
+ */
+
+#ifndef ZOKRATES_KEYPAIR_CACHE_HPP_
+#define ZOKRATES_KEYPAIR_CACHE_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
+
+#include "pk_binary.hpp"
+#include "sha256.hpp"
+#include "trace.hpp"
+
+typedef std::pair<size_t, libff::alt_bn128_Fr> canonical_term;
+
+// The constraints of a libsnark constraint system or of a flat one, as the
+// hash reads them: forEachTerm(row, m, f) calls f(index, coeff) for every
+// term of A (m = 0), B (1) or C (2) of a row.
+struct nested_constraint_rows {
+  const libsnark::r1cs_ppzksnark_constraint_system<prover_pp> &cs;
+
+  size_t primary_input_size() const { return cs.primary_input_size; }
+  size_t auxiliary_input_size() const { return cs.auxiliary_input_size; }
+  size_t num_constraints() const { return cs.num_constraints(); }
+
+  template<typename F>
+  void forEachTerm(size_t row, int m, F f) const
+  {
+    for (const libsnark::linear_term<libff::alt_bn128_Fr> &lt : matrixRow(cs.constraints[row], m).terms) {
+      f(lt.index, lt.coeff);
+    }
+  }
+};
+
+struct flat_constraint_rows {
+  const flat_r1cs_view &flat;
+
+  size_t primary_input_size() const { return flat.primary_input_size; }
+  size_t auxiliary_input_size() const { return flat.auxiliary_input_size; }
+  size_t num_constraints() const { return flat.num_constraints; }
+
+  template<typename F>
+  void forEachTerm(size_t row, int m, F f) const
+  {
+    const flat_matrix_view &matrix = flat.matrices[m];
+    for (uint64_t k = matrix.offsets[row]; k < matrix.offsets[row + 1]; ++k) {
+      f(matrix.terms[k].index, matrix.terms[k].coeff);
+    }
+  }
+};
+
+// terms of matrix m of a row sorted by variable index, duplicates merged,
+// zeros dropped
+template<typename Rows>
+void canonicalTerms(const Rows &rows, size_t row, int m, std::vector<canonical_term> &terms)
+{
+  terms.clear();
+  rows.forEachTerm(row, m, [&](size_t index, const libff::alt_bn128_Fr &coeff) { terms.emplace_back(index, coeff); });
+  std::stable_sort(terms.begin(), terms.end(), [](const canonical_term &x, const canonical_term &y) { return x.first < y.first; });
+
+  size_t out = 0;
+  for (size_t i = 0; i < terms.size(); ++i) {
+    if (out > 0 && terms[out - 1].first == terms[i].first) {
+      terms[out - 1].second += terms[i].second;
+    } else {
+      terms[out++] = terms[i];
+    }
+  }
+  terms.resize(out);
+  terms.erase(std::remove_if(terms.begin(), terms.end(), [](const canonical_term &t) { return t.second.is_zero(); }), terms.end());
+}
+
+// whether swap_AB_if_beneficial() swaps A and B: B touches more variables
+// than A, counting terms with a zero coefficient like libsnark does
+template<typename Rows>
+bool swapsAB(const Rows &rows)
+{
+  const size_t size = rows.primary_input_size() + rows.auxiliary_input_size() + 1;
+  std::vector<bool> touched[2] = { std::vector<bool>(size, false), std::vector<bool>(size, false) };
+  for (size_t row = 0; row < rows.num_constraints(); ++row) {
+    for (int m = 0; m < 2; ++m) {
+      rows.forEachTerm(row, m, [&](size_t index, const libff::alt_bn128_Fr&) {
+        if (index < size) {
+          touched[m][index] = true;
+        }
+      });
+    }
+  }
+  return std::count(touched[1].begin(), touched[1].end(), true) > std::count(touched[0].begin(), touched[0].end(), true);
+}
+
+// feeds the canonical encoding of the constraints to h, with A and B in the
+// order the generator keeps them. Annotations do not contribute.
+template<typename Rows>
+void hashConstraintRows(const Rows &rows, sha256_hasher &h)
+{
+  static const char tag[] = "r1cs_ppzksnark/alt_bn128/v1";
+  h.update(tag, sizeof(tag));
+  for (size_t i = 0; i < libff::alt_bn128_r_limbs; ++i) {
+    h.updateU64(libff::alt_bn128_modulus_r.data[i]);
+  }
+  h.updateU64(rows.primary_input_size());
+  h.updateU64(rows.auxiliary_input_size());
+  h.updateU64(rows.num_constraints());
+
+  const bool swap = swapsAB(rows);
+  std::vector<canonical_term> terms;
+  for (size_t row = 0; row < rows.num_constraints(); ++row) {
+    for (int m : { swap ? 1 : 0, swap ? 0 : 1, 2 }) {
+      canonicalTerms(rows, row, m, terms);
+      h.updateU64(terms.size());
+      for (const canonical_term &t : terms) {
+        h.updateU64(t.first);
+        const libff::bigint<libff::alt_bn128_r_limbs> coeff = t.second.as_bigint();
+        for (size_t i = 0; i < libff::alt_bn128_r_limbs; ++i) {
+          h.updateU64(coeff.data[i]);
+        }
+      }
+    }
+  }
+}
+
+inline void hashConstraintSystem(const libsnark::r1cs_ppzksnark_constraint_system<prover_pp> &cs, sha256_hasher &h)
+{
+  hashConstraintRows(nested_constraint_rows{ cs }, h);
+}
+
+// the same encoding for the flat constraint system of a binary key
+inline void hashConstraintSystem(const flat_r1cs_view &flat, sha256_hasher &h)
+{
+  hashConstraintRows(flat_constraint_rows{ flat }, h);
+}
+
+// hex SHA-256 identifying the circuit
+template<typename ConstraintSystem>
+std::string constraintSystemHash(const ConstraintSystem &cs)
+{
+  sha256_hasher h;
+  hashConstraintSystem(cs, h);
+  return h.finishHex();
+}
+
+// the same hash as raw bytes, used as circuit id in proof bundles
+template<typename ConstraintSystem>
+void constraintSystemDigest(const ConstraintSystem &cs, uint8_t digest[sha256_hasher::digest_size])
+{
+  sha256_hasher h;
+  hashConstraintSystem(cs, h);
+  h.finish(digest);
+}
+
+class keypair_cache {
+public:
+  explicit keypair_cache(const std::string &dir) : dir(dir)
+  {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+      throw std::runtime_error("cannot create key cache directory " + dir);
+    }
+  }
+
+  std::string provingKeyPath(const std::string &hash) const { return dir + "/" + hash + ".pk"; }
+  std::string verificationKeyPath(const std::string &hash) const { return dir + "/" + hash + ".vk"; }
+
+  // the keypair for cs, running the generator only if none is stored yet
+  libsnark::r1cs_ppzksnark_keypair<prover_pp> get(const libsnark::r1cs_ppzksnark_constraint_system<prover_pp> &cs, bool* hit = nullptr)
+  {
+    const std::string hash = constraintSystemHash(cs);
+
+    libsnark::r1cs_ppzksnark_keypair<prover_pp> keypair;
+    bool found;
+    {
+      trace_span span("keypair_cache/load");
+      found = load(hash, keypair);
+    }
+    if (hit != nullptr) {
+      *hit = found;
+    }
+    if (found) {
+      return keypair;
+    }
+
+    {
+      trace_span span("keygen");
+      keypair = libsnark::r1cs_ppzksnark_generator<prover_pp>(cs);
+    }
+    trace_span span("keypair_cache/store");
+    store(hash, keypair);
+    return keypair;
+  }
+
+private:
+  bool load(const std::string &hash, libsnark::r1cs_ppzksnark_keypair<prover_pp> &keypair) const
+  {
+    const std::string pk_path = provingKeyPath(hash), vk_path = verificationKeyPath(hash);
+    if (access(pk_path.c_str(), R_OK) != 0 || access(vk_path.c_str(), R_OK) != 0) {
+      return false;
+    }
+
+    try {
+      const mapped_proving_key mapped(pk_path.c_str(), true);
+      if (constraintSystemHash(*mapped.view().flat_constraints) != hash) {
+        std::cerr << "key cache: " << pk_path << " belongs to a different circuit, regenerating" << std::endl;
+        return false;
+      }
+
+      std::ifstream fh(vk_path, std::ios::binary);
+      libsnark::r1cs_ppzksnark_verification_key<prover_pp> vk;
+      fh >> vk;
+      if (!fh) {
+        return false;
+      }
+      keypair = libsnark::r1cs_ppzksnark_keypair<prover_pp>(mapped.materialize(), std::move(vk));
+      return true;
+    } catch (const std::exception &e) {
+      std::cerr << "key cache: cannot load " << pk_path << ": " << e.what() << std::endl;
+      return false;
+    }
+  }
+
+  void store(const std::string &hash, const libsnark::r1cs_ppzksnark_keypair<prover_pp> &keypair) const
+  {
+    // the pid tells processes apart, the counter threads of one process
+    static std::atomic<uint64_t> stores(0);
+    const std::string suffix = ".tmp" + std::to_string(getpid()) + "." + std::to_string(stores++);
+    const std::string pk_path = provingKeyPath(hash), vk_path = verificationKeyPath(hash);
+
+    serializeProvingKeyToBinaryFile(keypair.pk, (pk_path + suffix).c_str());
+    {
+      std::ofstream fh(vk_path + suffix, std::ios::binary);
+      fh << keypair.vk;
+      if (!fh) {
+        throw std::runtime_error("error writing " + vk_path + suffix);
+      }
+    }
+
+    // vk first: an entry only counts as present once its pk is in place
+    if (std::rename((vk_path + suffix).c_str(), vk_path.c_str()) != 0 ||
+        std::rename((pk_path + suffix).c_str(), pk_path.c_str()) != 0) {
+      throw std::runtime_error("cannot move keypair into " + dir);
+    }
+  }
+
+  std::string dir;
+};
+
+#endif // ZOKRATES_KEYPAIR_CACHE_HPP_
@@ -0,0 +1,295 @@
+/**
+ * @file multiexp.hpp
+ *
+ * Pippenger (bucket method) multi-exponentiation over raw point arrays.
+ *
+ * libff::multi_exp only accepts std::vector iterators, so it cannot run over
+ * points that live in a memory mapped proving key. The routines below take a
+ * base pointer and a stride instead, which covers plain query vectors as well
+ * as the g/h halves of a knowledge commitment vector.
+ *
+ * The point additions and doublings are libff's Jacobian formulas with the
+ * field multiplications going through the kernels of field_kernels.hpp.
+ */
+
+#ifndef ZOKRATES_MULTIEXP_HPP_
+#define ZOKRATES_MULTIEXP_HPP_
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+
+#include "field_kernels.hpp"
+
+typedef libff::bigint<libff::alt_bn128_r_limbs> multiexp_scalar;
+
+// points[i] lives at base + i*stride
+template<typename T>
+struct strided_points {
+  const uint8_t* base;
+  size_t stride;
+  size_t size;
+
+  strided_points(const T* first, size_t stride, size_t size) :
+    base(reinterpret_cast<const uint8_t*>(first)), stride(stride), size(size) {}
+
+  const T& operator[](size_t i) const
+  {
+    return *reinterpret_cast<const T*>(base + i * stride);
+  }
+};
+
+// 2p, dbl-2009-l as in libff's dbl()
+template<typename T>
+T pointDbl(const T &p)
+{
+  typedef decltype(p.X) field;
+  if (p.is_zero()) {
+    return p;
+  }
+
+  const field A = fieldSqr(p.X);
+  const field B = fieldSqr(p.Y);
+  const field C = fieldSqr(B);
+  field D = fieldSqr(p.X + B) - A - C;
+  D = D + D;
+  const field E = A + A + A;
+  const field X3 = fieldSqr(E) - (D + D);
+  field C8 = C + C;
+  C8 = C8 + C8;
+  C8 = C8 + C8;
+  const field Y3 = fieldMul(E, D - X3) - C8;
+  const field YZ = fieldMul(p.Y, p.Z);
+  return T(X3, Y3, YZ + YZ);
+}
+
+// p + q, add-2007-bl as in libff's operator+
+template<typename T>
+T pointAdd(const T &p, const T &q)
+{
+  typedef decltype(p.X) field;
+  if (p.is_zero()) {
+    return q;
+  }
+  if (q.is_zero()) {
+    return p;
+  }
+
+  const field Z1Z1 = fieldSqr(p.Z);
+  const field Z2Z2 = fieldSqr(q.Z);
+  const field U1 = fieldMul(p.X, Z2Z2);
+  const field U2 = fieldMul(q.X, Z1Z1);
+  const field S1 = fieldMul(p.Y, fieldMul(q.Z, Z2Z2));
+  const field S2 = fieldMul(q.Y, fieldMul(p.Z, Z1Z1));
+  if (U1 == U2 && S1 == S2) {
+    return pointDbl(p);
+  }
+
+  const field H = U2 - U1;
+  const field I = fieldSqr(H + H);
+  const field J = fieldMul(H, I);
+  const field r = (S2 - S1) + (S2 - S1);
+  const field V = fieldMul(U1, I);
+  const field X3 = fieldSqr(r) - J - (V + V);
+  const field S1J = fieldMul(S1, J);
+  const field Y3 = fieldMul(r, V - X3) - (S1J + S1J);
+  const field Z3 = fieldMul(fieldSqr(p.Z + q.Z) - Z1Z1 - Z2Z2, H);
+  return T(X3, Y3, Z3);
+}
+
+// p + q for q with Z = 1, madd-2007-bl as in libff's mixed_add
+template<typename T>
+T pointMixedAdd(const T &p, const T &q)
+{
+  typedef decltype(p.X) field;
+  if (p.is_zero()) {
+    return q;
+  }
+  if (q.is_zero()) {
+    return p;
+  }
+
+  const field Z1Z1 = fieldSqr(p.Z);
+  const field U2 = fieldMul(q.X, Z1Z1);
+  const field S2 = fieldMul(q.Y, fieldMul(p.Z, Z1Z1));
+  if (p.X == U2 && p.Y == S2) {
+    return pointDbl(p);
+  }
+
+  const field H = U2 - p.X;
+  const field HH = fieldSqr(H);
+  field I = HH + HH;
+  I = I + I;
+  const field J = fieldMul(H, I);
+  const field r = (S2 - p.Y) + (S2 - p.Y);
+  const field V = fieldMul(p.X, I);
+  const field X3 = fieldSqr(r) - J - (V + V);
+  const field YJ = fieldMul(p.Y, J);
+  const field Y3 = fieldMul(r, V - X3) - (YJ + YJ);
+  const field Z3 = fieldSqr(p.Z + H) - Z1Z1 - HH;
+  return T(X3, Y3, Z3);
+}
+
+// window size c ~ ln(n) + 2, the usual sweet spot between bucket
+// accumulation (n per window) and bucket reduction (2^c per window)
+inline size_t pippengerWindowSize(size_t n)
+{
+  if (n < 32) {
+    return 3;
+  }
+  return size_t(std::log2(double(n)) * 0.69) + 2;
+}
+
+// bits [bit, bit + c) of s
+inline size_t scalarWindow(const multiexp_scalar &s, size_t bit, size_t c)
+{
+  const size_t limb = bit / GMP_NUMB_BITS;
+  const size_t shift = bit % GMP_NUMB_BITS;
+  if (limb >= multiexp_scalar::N) {
+    return 0;
+  }
+
+  mp_limb_t w = s.data[limb] >> shift;
+  if (shift + c > GMP_NUMB_BITS && limb + 1 < multiexp_scalar::N) {
+    w |= s.data[limb + 1] << (GMP_NUMB_BITS - shift);
+  }
+  return w & ((mp_limb_t(1) << c) - 1);
+}
+
+// fills scalars, keeping its capacity so that the buffer can be reused
+inline void scalarsFromField(const libff::alt_bn128_Fr* coeffs, size_t n, std::vector<multiexp_scalar> &scalars)
+{
+  scalars.clear();
+  scalars.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    scalars.emplace_back(coeffs[i].as_bigint());
+  }
+}
+
+// sum of the window-th digits of scalars times bases
+template<typename T>
+T pippengerWindow(const strided_points<T> &bases, const std::vector<multiexp_scalar> &scalars, size_t window, size_t c)
+{
+  std::vector<T> buckets((size_t(1) << c) - 1, T::zero());
+  for (size_t i = 0; i < scalars.size(); ++i) {
+    const size_t digit = scalarWindow(scalars[i], window * c, c);
+    if (digit != 0) {
+      buckets[digit - 1] = pointAdd(buckets[digit - 1], bases[i]);
+    }
+  }
+
+  // sum_d d * bucket[d] as a running sum from the top
+  T running = T::zero();
+  T sum = T::zero();
+  for (size_t b = buckets.size(); b-- > 0; ) {
+    running = pointAdd(running, buckets[b]);
+    sum = pointAdd(sum, running);
+  }
+  return sum;
+}
+
+// computes sum_i scalars[i] * bases[i]
+template<typename T>
+T multiExpPippenger(const strided_points<T> &bases, const std::vector<multiexp_scalar> &scalars)
+{
+  assert(bases.size == scalars.size());
+  if (scalars.empty()) {
+    return T::zero();
+  }
+
+  const size_t c = pippengerWindowSize(scalars.size());
+  const size_t num_windows = (libff::alt_bn128_Fr::size_in_bits() + c - 1) / c;
+
+  std::vector<T> window_sums(num_windows, T::zero());
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+  for (size_t w = 0; w < num_windows; ++w) {
+    window_sums[w] = pippengerWindow(bases, scalars, w, c);
+  }
+
+  T result = T::zero();
+  for (size_t w = num_windows; w-- > 0; ) {
+    for (size_t i = 0; i < c; ++i) {
+      result = pointDbl(result);
+    }
+    result = pointAdd(result, window_sums[w]);
+  }
+  return result;
+}
+
+// Precomputed multiples of a fixed set of bases,
+// point(j, i) = 2^(j * shift_bits) * base_i for j < num_shifts, stored with
+// Z = 1 so that buckets can be filled with mixed additions.
+template<typename T>
+struct fixed_base_table {
+  size_t count = 0;
+  size_t num_shifts = 0;
+  size_t shift_bits = 0;
+  const T* points = nullptr;
+
+  const T& point(size_t j, size_t i) const
+  {
+    return points[j * count + i];
+  }
+};
+
+// computes sum_i scalars[i] * base_{first + i} from a fixed_base_table.
+// Every scalar is split into num_shifts digits of shift_bits bits, digit j
+// multiplying point(j, i). This turns the sum into a multi-exponentiation
+// over shift_bits bit scalars: the number of doublings and bucket
+// reductions shrinks by a factor num_shifts, the number of additions stays
+// the same but they are cheaper mixed additions.
+template<typename T>
+T multiExpWithTable(const fixed_base_table<T> &table, size_t first, const std::vector<multiexp_scalar> &scalars)
+{
+  assert(first + scalars.size() <= table.count);
+  assert(table.num_shifts * table.shift_bits >= libff::alt_bn128_Fr::size_in_bits());
+  if (scalars.empty()) {
+    return T::zero();
+  }
+
+  const size_t s = table.shift_bits;
+  const size_t c = std::min(s, pippengerWindowSize(scalars.size() * table.num_shifts));
+  const size_t num_windows = (s + c - 1) / c;
+
+  std::vector<T> window_sums(num_windows, T::zero());
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+  for (size_t w = 0; w < num_windows; ++w) {
+    const size_t width = std::min(c, s - w * c);
+    std::vector<T> buckets((size_t(1) << width) - 1, T::zero());
+    for (size_t j = 0; j < table.num_shifts; ++j) {
+      for (size_t i = 0; i < scalars.size(); ++i) {
+        const size_t digit = scalarWindow(scalars[i], j * s + w * c, width);
+        if (digit != 0) {
+          buckets[digit - 1] = pointMixedAdd(buckets[digit - 1], table.point(j, first + i));
+        }
+      }
+    }
+
+    T running = T::zero();
+    T sum = T::zero();
+    for (size_t b = buckets.size(); b-- > 0; ) {
+      running = pointAdd(running, buckets[b]);
+      sum = pointAdd(sum, running);
+    }
+    window_sums[w] = sum;
+  }
+
+  T result = T::zero();
+  for (size_t w = num_windows; w-- > 0; ) {
+    for (size_t i = 0; i < c; ++i) {
+      result = pointDbl(result);
+    }
+    result = pointAdd(result, window_sums[w]);
+  }
+  return result;
+}
+
+#endif // ZOKRATES_MULTIEXP_HPP_
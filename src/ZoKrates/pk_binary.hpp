@@ -0,0 +1,482 @@
+/**
+ * @file pk_binary.hpp
+ *
+ * Versioned binary proving key format.
+ *
+ * The query vectors are stored exactly as they sit in memory (raw Montgomery
+ * limbs of the Jacobian coordinates), each section 64 byte aligned, so the
+ * file can be mmap'd and used through a proving_key_view without parsing or
+ * copying. The pages are file backed and shared by all processes mapping the
+ * same key. The constraint system is used in place as well, in the flat form
+ * of flat_r1cs.hpp; libsnark's nested form is only built by materialize().
+ *
+ * Layout: pk_binary_header, then the sections listed in its section table.
+ */
+
+#ifndef ZOKRATES_PK_BINARY_HPP_
+#define ZOKRATES_PK_BINARY_HPP_
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
+
+#include "prover.hpp"
+
+static_assert(sizeof(size_t) == sizeof(uint64_t), "binary key format assumes 64 bit size_t");
+static_assert(sizeof(libff::alt_bn128_Fr) == 32, "unexpected alt_bn128_Fr layout");
+static_assert(sizeof(libff::alt_bn128_G1) == 3 * 32, "unexpected alt_bn128_G1 layout");
+static_assert(sizeof(libff::alt_bn128_G2) == 3 * 64, "unexpected alt_bn128_G2 layout");
+
+const char pk_binary_magic[8] = { 'Z', 'K', 'P', 'K', 'B', 'I', 'N', '\0' };
+const uint32_t pk_binary_version = 1;
+const size_t pk_binary_alignment = 64;
+
+enum pk_binary_section_id {
+  PK_SECTION_A_INDICES,
+  PK_SECTION_A_VALUES,
+  PK_SECTION_B_INDICES,
+  PK_SECTION_B_VALUES,
+  PK_SECTION_C_INDICES,
+  PK_SECTION_C_VALUES,
+  PK_SECTION_H_VALUES,
+  PK_SECTION_K_VALUES,
+  PK_SECTION_CONSTRAINT_SYSTEM,
+  PK_SECTION_COUNT
+};
+
+struct pk_binary_section {
+  uint64_t offset;
+  uint64_t length;
+};
+
+struct pk_binary_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  char curve[16];
+  // layout and moduli of the raw Montgomery representation
+  uint64_t fr_size;
+  uint64_t g1_size;
+  uint64_t g2_size;
+  uint64_t modulus_r[4];
+  uint64_t modulus_q[4];
+  uint64_t A_domain_size;
+  uint64_t B_domain_size;
+  uint64_t C_domain_size;
+  pk_binary_section sections[PK_SECTION_COUNT];
+  uint64_t payload_checksum;
+  // over all header bytes before this field
+  uint64_t header_checksum;
+};
+
+// Word-wise multiply/rotate checksum. It detects truncated and corrupted
+// files, not deliberate tampering, and runs at memory bandwidth so it can be
+// applied to multi-GB keys. Lengths have to be multiples of 8.
+struct pk_checksum {
+  uint64_t h = 0x9e3779b97f4a7c15ULL;
+
+  void update(const void* data, size_t len)
+  {
+    assert(len % 8 == 0);
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; i += 8) {
+      uint64_t w;
+      memcpy(&w, p + i, 8);
+      h ^= w * 0xff51afd7ed558ccdULL;
+      h = ((h << 31) | (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+    }
+  }
+};
+
+inline bool isBinaryProvingKeyFile(const char* path)
+{
+  std::ifstream fh(path, std::ios::binary);
+  char magic[sizeof(pk_binary_magic)];
+  return fh.read(magic, sizeof(magic)) && memcmp(magic, pk_binary_magic, sizeof(magic)) == 0;
+}
+
+inline uint64_t alignedSize(uint64_t len)
+{
+  return (len + pk_binary_alignment - 1) / pk_binary_alignment * pk_binary_alignment;
+}
+
+inline uint64_t constraintSystemSectionSize(const libsnark::r1cs_ppzksnark_constraint_system<prover_pp> &cs)
+{
+  uint64_t terms = 0;
+  for (const libsnark::r1cs_constraint<libff::alt_bn128_Fr> &constraint : cs.constraints) {
+    terms += constraint.a.terms.size() + constraint.b.terms.size() + constraint.c.terms.size();
+  }
+  return 3 * 8 + 3 * 8 * (cs.num_constraints() + 1) + terms * (8 + sizeof(libff::alt_bn128_Fr));
+}
+
+// writes sections in order, padding each to pk_binary_alignment
+class pk_binary_writer {
+public:
+  explicit pk_binary_writer(std::ofstream &fh) : fh(fh) {}
+
+  void write(const void* data, size_t len)
+  {
+    fh.write(static_cast<const char*>(data), len);
+    checksum.update(data, len);
+    written += len;
+  }
+
+  void pad()
+  {
+    static const char zeros[pk_binary_alignment] = { 0 };
+    write(zeros, alignedSize(written) - written);
+  }
+
+  std::ofstream &fh;
+  pk_checksum checksum;
+  uint64_t written = 0;
+};
+
+// constraints are stored CSR style: per matrix the row offsets, then per
+// matrix the terms as (index, raw Montgomery coefficient)
+inline void writeConstraintSystemSection(pk_binary_writer &out, const libsnark::r1cs_ppzksnark_constraint_system<prover_pp> &cs)
+{
+  const uint64_t sizes[3] = { cs.primary_input_size, cs.auxiliary_input_size, cs.num_constraints() };
+  out.write(sizes, sizeof(sizes));
+
+  for (int m = 0; m < 3; ++m) {
+    uint64_t offset = 0;
+    out.write(&offset, 8);
+    for (const libsnark::r1cs_constraint<libff::alt_bn128_Fr> &constraint : cs.constraints) {
+      const libsnark::linear_combination<libff::alt_bn128_Fr> &lc = (m == 0 ? constraint.a : m == 1 ? constraint.b : constraint.c);
+      offset += lc.terms.size();
+      out.write(&offset, 8);
+    }
+  }
+
+  for (int m = 0; m < 3; ++m) {
+    for (const libsnark::r1cs_constraint<libff::alt_bn128_Fr> &constraint : cs.constraints) {
+      const libsnark::linear_combination<libff::alt_bn128_Fr> &lc = (m == 0 ? constraint.a : m == 1 ? constraint.b : constraint.c);
+      for (const libsnark::linear_term<libff::alt_bn128_Fr> &lt : lc.terms) {
+        const uint64_t index = lt.index;
+        out.write(&index, 8);
+        out.write(&lt.coeff, sizeof(lt.coeff));
+      }
+    }
+  }
+}
+
+// flat view into a constraint system section; data has to be 8 byte aligned
+// and outlive the view
+inline flat_r1cs_view flatViewOfConstraintSystemSection(const uint8_t* data, uint64_t length)
+{
+  uint64_t sizes[3];
+  if (length < sizeof(sizes)) {
+    throw std::runtime_error("binary proving key: truncated constraint system");
+  }
+  assert(reinterpret_cast<uintptr_t>(data) % 8 == 0);
+  memcpy(sizes, data, sizeof(sizes));
+  const uint64_t num_constraints = sizes[2];
+  if (num_constraints > length / (3 * 8)) {
+    throw std::runtime_error("binary proving key: truncated constraint system");
+  }
+
+  const uint64_t* offsets = reinterpret_cast<const uint64_t*>(data + sizeof(sizes));
+  const uint8_t* terms = data + sizeof(sizes) + 3 * 8 * (num_constraints + 1);
+  if (uint64_t(terms - data) > length) {
+    throw std::runtime_error("binary proving key: truncated constraint system");
+  }
+
+  flat_r1cs_view flat;
+  flat.primary_input_size = sizes[0];
+  flat.auxiliary_input_size = sizes[1];
+  flat.num_constraints = num_constraints;
+  uint64_t matrix_start = 0;
+  for (int m = 0; m < 3; ++m) {
+    flat.matrices[m].offsets = offsets + m * (num_constraints + 1);
+    flat.matrices[m].terms = reinterpret_cast<const flat_term*>(terms) + matrix_start;
+    matrix_start += flat.matrices[m].numTerms(num_constraints);
+    if (uint64_t(terms - data) + matrix_start * sizeof(flat_term) > length) {
+      throw std::runtime_error("binary proving key: truncated constraint system");
+    }
+  }
+  checkFlatR1cs(flat);
+  return flat;
+}
+
+inline libsnark::r1cs_ppzksnark_constraint_system<prover_pp> readConstraintSystemSection(const uint8_t* data, uint64_t length)
+{
+  return constraintSystemFromFlat(flatViewOfConstraintSystemSection(data, length));
+}
+
+inline void serializeProvingKeyToBinaryFile(const libsnark::r1cs_ppzksnark_proving_key<prover_pp> &pk, const char* pk_path)
+{
+  pk_binary_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, pk_binary_magic, sizeof(pk_binary_magic));
+  header.version = pk_binary_version;
+  header.header_size = sizeof(header);
+  strncpy(header.curve, "alt_bn128", sizeof(header.curve) - 1);
+  header.fr_size = sizeof(libff::alt_bn128_Fr);
+  header.g1_size = sizeof(libff::alt_bn128_G1);
+  header.g2_size = sizeof(libff::alt_bn128_G2);
+  memcpy(header.modulus_r, libff::alt_bn128_modulus_r.data, sizeof(header.modulus_r));
+  memcpy(header.modulus_q, libff::alt_bn128_modulus_q.data, sizeof(header.modulus_q));
+  header.A_domain_size = pk.A_query.domain_size();
+  header.B_domain_size = pk.B_query.domain_size();
+  header.C_domain_size = pk.C_query.domain_size();
+
+  const uint64_t lengths[PK_SECTION_COUNT] = {
+    8 * pk.A_query.indices.size(), sizeof(pk.A_query.values[0]) * pk.A_query.values.size(),
+    8 * pk.B_query.indices.size(), sizeof(pk.B_query.values[0]) * pk.B_query.values.size(),
+    8 * pk.C_query.indices.size(), sizeof(pk.C_query.values[0]) * pk.C_query.values.size(),
+    sizeof(libff::alt_bn128_G1) * pk.H_query.size(),
+    sizeof(libff::alt_bn128_G1) * pk.K_query.size(),
+    constraintSystemSectionSize(pk.constraint_system)
+  };
+  uint64_t offset = alignedSize(sizeof(header));
+  for (int i = 0; i < PK_SECTION_COUNT; ++i) {
+    header.sections[i].offset = offset;
+    header.sections[i].length = lengths[i];
+    offset += alignedSize(lengths[i]);
+  }
+
+  std::ofstream fh(pk_path, std::ios::binary);
+  if (!fh.is_open()) {
+    throw std::runtime_error(std::string("cannot open ") + pk_path);
+  }
+
+  // header is written last, once the payload checksum is known
+  fh.seekp(header.sections[0].offset);
+  pk_binary_writer out(fh);
+  out.written = header.sections[0].offset;
+
+  out.write(pk.A_query.indices.data(), lengths[PK_SECTION_A_INDICES]); out.pad();
+  out.write(pk.A_query.values.data(), lengths[PK_SECTION_A_VALUES]); out.pad();
+  out.write(pk.B_query.indices.data(), lengths[PK_SECTION_B_INDICES]); out.pad();
+  out.write(pk.B_query.values.data(), lengths[PK_SECTION_B_VALUES]); out.pad();
+  out.write(pk.C_query.indices.data(), lengths[PK_SECTION_C_INDICES]); out.pad();
+  out.write(pk.C_query.values.data(), lengths[PK_SECTION_C_VALUES]); out.pad();
+  out.write(pk.H_query.data(), lengths[PK_SECTION_H_VALUES]); out.pad();
+  out.write(pk.K_query.data(), lengths[PK_SECTION_K_VALUES]); out.pad();
+  writeConstraintSystemSection(out, pk.constraint_system); out.pad();
+  assert(out.written == offset);
+
+  header.payload_checksum = out.checksum.h;
+  pk_checksum header_sum;
+  header_sum.update(&header, offsetof(pk_binary_header, header_checksum));
+  header.header_checksum = header_sum.h;
+
+  fh.seekp(0);
+  fh.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  fh.flush();
+  if (!fh) {
+    throw std::runtime_error(std::string("error writing ") + pk_path);
+  }
+}
+
+// validates a header read from a key file of file_size bytes
+inline void checkProvingKeyHeader(const pk_binary_header &header, uint64_t file_size)
+{
+  if (memcmp(header.magic, pk_binary_magic, sizeof(pk_binary_magic)) != 0) {
+    throw std::runtime_error("binary proving key: bad magic");
+  }
+  if (header.version != pk_binary_version || header.header_size != sizeof(pk_binary_header)) {
+    throw std::runtime_error("binary proving key: unsupported version");
+  }
+  pk_checksum header_sum;
+  header_sum.update(&header, offsetof(pk_binary_header, header_checksum));
+  if (header_sum.h != header.header_checksum) {
+    throw std::runtime_error("binary proving key: header checksum mismatch");
+  }
+  if (header.fr_size != sizeof(libff::alt_bn128_Fr) ||
+      header.g1_size != sizeof(libff::alt_bn128_G1) ||
+      header.g2_size != sizeof(libff::alt_bn128_G2) ||
+      memcmp(header.modulus_r, libff::alt_bn128_modulus_r.data, sizeof(header.modulus_r)) != 0 ||
+      memcmp(header.modulus_q, libff::alt_bn128_modulus_q.data, sizeof(header.modulus_q)) != 0) {
+    throw std::runtime_error("binary proving key: written for a different curve or limb layout");
+  }
+  for (int i = 0; i < PK_SECTION_COUNT; ++i) {
+    if (header.sections[i].offset % pk_binary_alignment != 0 ||
+        header.sections[i].offset + header.sections[i].length > file_size) {
+      throw std::runtime_error("binary proving key: truncated file");
+    }
+  }
+}
+
+// kcQueryAt binary searches the indices and the multi-exponentiations walk
+// them in order, both rely on them being strictly increasing and in range
+template<typename T1, typename T2>
+void checkQueryIndices(const kc_query_view<T1, T2> &q, const char* name)
+{
+  for (size_t i = 0; i < q.size; ++i) {
+    if (q.indices[i] >= q.domain_size || (i > 0 && q.indices[i] <= q.indices[i - 1])) {
+      throw std::runtime_error(std::string("binary proving key: corrupted ") + name + " query indices");
+    }
+  }
+}
+
+// The query shapes the prover expects for the key's flat constraint system
+// (see proofFromQapWitness), and the query indices. The H query is only
+// bounded below here; its exact size depends on the domain that is picked.
+inline void checkProvingKeyQueries(const proving_key_view &v)
+{
+  const size_t n = v.flat_constraints->num_variables();
+  if (v.A_query.domain_size != n + 2 || v.B_query.domain_size != n + 2 || v.C_query.domain_size != n + 2 ||
+      v.K_query.size != n + 4 || v.H_query.size < v.flat_constraints->domainMinSize() + 1) {
+    throw std::runtime_error("binary proving key: query sizes do not match the constraint system");
+  }
+  checkQueryIndices(v.A_query, "A");
+  checkQueryIndices(v.B_query, "B");
+  checkQueryIndices(v.C_query, "C");
+}
+
+// read-only, shared mapping of a whole file
+class mapped_file {
+public:
+  explicit mapped_file(const char* path)
+  {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error(std::string("cannot open ") + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      throw std::runtime_error(std::string("cannot stat ") + path);
+    }
+    len = st.st_size;
+    void* p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+      throw std::runtime_error(std::string("cannot mmap ") + path);
+    }
+    ptr = static_cast<const uint8_t*>(p);
+  }
+
+  ~mapped_file()
+  {
+    munmap(const_cast<uint8_t*>(ptr), len);
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  const uint8_t* data() const { return ptr; }
+  size_t size() const { return len; }
+
+private:
+  const uint8_t* ptr;
+  size_t len;
+};
+
+// A binary proving key mapped into memory. The query vectors and the flat
+// constraint system are used in place through view(), whose constraint_system
+// is null. The payload checksum is only verified with verify_checksum, it
+// reads the whole file; query sizes and indices are always checked, so a
+// corrupt key fails to load instead of sending the prover out of bounds.
+class mapped_proving_key {
+public:
+  explicit mapped_proving_key(const char* pk_path, bool verify_checksum = false) : file(pk_path)
+  {
+    if (file.size() < sizeof(pk_binary_header)) {
+      throw std::runtime_error("binary proving key: truncated header");
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    checkHeader();
+
+    if (verify_checksum) {
+      const uint64_t start = header.sections[0].offset;
+      pk_checksum payload_sum;
+      payload_sum.update(file.data() + start, file.size() - start);
+      if (payload_sum.h != header.payload_checksum) {
+        throw std::runtime_error("binary proving key: payload checksum mismatch");
+      }
+    }
+
+    flat = flatViewOfConstraintSystemSection(section(PK_SECTION_CONSTRAINT_SYSTEM), header.sections[PK_SECTION_CONSTRAINT_SYSTEM].length);
+
+    v.A_query = kcSection<libff::alt_bn128_G1, libff::alt_bn128_G1>(PK_SECTION_A_INDICES, PK_SECTION_A_VALUES, header.A_domain_size);
+    v.B_query = kcSection<libff::alt_bn128_G2, libff::alt_bn128_G1>(PK_SECTION_B_INDICES, PK_SECTION_B_VALUES, header.B_domain_size);
+    v.C_query = kcSection<libff::alt_bn128_G1, libff::alt_bn128_G1>(PK_SECTION_C_INDICES, PK_SECTION_C_VALUES, header.C_domain_size);
+    v.H_query.size = header.sections[PK_SECTION_H_VALUES].length / sizeof(libff::alt_bn128_G1);
+    v.H_query.values = reinterpret_cast<const libff::alt_bn128_G1*>(section(PK_SECTION_H_VALUES));
+    v.K_query.size = header.sections[PK_SECTION_K_VALUES].length / sizeof(libff::alt_bn128_G1);
+    v.K_query.values = reinterpret_cast<const libff::alt_bn128_G1*>(section(PK_SECTION_K_VALUES));
+    v.flat_constraints = &flat;
+    checkProvingKeyQueries(v);
+  }
+
+  mapped_proving_key(const mapped_proving_key&) = delete;
+  mapped_proving_key& operator=(const mapped_proving_key&) = delete;
+
+  const proving_key_view& view() const { return v; }
+
+  // identifies the key file, see pk_tables.hpp
+  uint64_t headerChecksum() const { return header.header_checksum; }
+
+  // tables have to outlive the use of view()
+  void attachTables(const proving_key_tables* tables) { v.tables = tables; }
+
+  // owned copy, for code that needs a r1cs_ppzksnark_proving_key
+  libsnark::r1cs_ppzksnark_proving_key<prover_pp> materialize() const
+  {
+    libsnark::knowledge_commitment_vector<libff::alt_bn128_G1, libff::alt_bn128_G1> A_query = copyQuery(v.A_query);
+    libsnark::knowledge_commitment_vector<libff::alt_bn128_G2, libff::alt_bn128_G1> B_query = copyQuery(v.B_query);
+    libsnark::knowledge_commitment_vector<libff::alt_bn128_G1, libff::alt_bn128_G1> C_query = copyQuery(v.C_query);
+    libff::G1_vector<prover_pp> H_query(v.H_query.values, v.H_query.values + v.H_query.size);
+    libff::G1_vector<prover_pp> K_query(v.K_query.values, v.K_query.values + v.K_query.size);
+    libsnark::r1cs_ppzksnark_constraint_system<prover_pp> cs = constraintSystemFromFlat(flat);
+
+    return libsnark::r1cs_ppzksnark_proving_key<prover_pp>(std::move(A_query), std::move(B_query), std::move(C_query),
+                                                           std::move(H_query), std::move(K_query), std::move(cs));
+  }
+
+private:
+  void checkHeader() const
+  {
+    checkProvingKeyHeader(header, file.size());
+  }
+
+  const uint8_t* section(int id) const
+  {
+    return file.data() + header.sections[id].offset;
+  }
+
+  template<typename T1, typename T2>
+  kc_query_view<T1, T2> kcSection(int indices_id, int values_id, uint64_t domain_size) const
+  {
+    kc_query_view<T1, T2> q;
+    q.domain_size = domain_size;
+    q.size = header.sections[indices_id].length / 8;
+    q.indices = reinterpret_cast<const size_t*>(section(indices_id));
+    q.values = reinterpret_cast<const libsnark::knowledge_commitment<T1, T2>*>(section(values_id));
+    if (header.sections[values_id].length != q.size * sizeof(libsnark::knowledge_commitment<T1, T2>)) {
+      throw std::runtime_error("binary proving key: query size mismatch");
+    }
+    return q;
+  }
+
+  template<typename T1, typename T2>
+  static libsnark::knowledge_commitment_vector<T1, T2> copyQuery(const kc_query_view<T1, T2> &q)
+  {
+    libsnark::knowledge_commitment_vector<T1, T2> result;
+    result.domain_size_ = q.domain_size;
+    result.indices.assign(q.indices, q.indices + q.size);
+    result.values.assign(q.values, q.values + q.size);
+    return result;
+  }
+
+  mapped_file file;
+  pk_binary_header header;
+  // points into the mapped constraint system section
+  flat_r1cs_view flat;
+  proving_key_view v;
+};
+
+#endif // ZOKRATES_PK_BINARY_HPP_
@@ -0,0 +1,140 @@
+/**
+ * @file pk_domain.hpp
+ *
+ * The QAP domain's twiddle table for a binary proving key, stored next to it
+ * as <pk_path>.domain, so that loading the key maps the table instead of
+ * computing it.
+ *
+ * Layout: pk_domain_header, then the m / 2 powers of omega as raw Montgomery
+ * limbs, 64 byte aligned. Like pk_tables.hpp the header records the header
+ * checksum of the proving key. Domains without a twiddle table (see
+ * qap_domain.hpp) have no file.
+ */
+
+#ifndef ZOKRATES_PK_DOMAIN_HPP_
+#define ZOKRATES_PK_DOMAIN_HPP_
+
+#include <memory>
+#include <string>
+
+#include "pk_binary.hpp"
+#include "qap_domain.hpp"
+
+const char pk_domain_magic[8] = { 'Z', 'K', 'Q', 'A', 'P', 'D', 'M', '\0' };
+const uint32_t pk_domain_version = 1;
+
+struct pk_domain_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t modulus_r[4];
+  // header_checksum of the proving key
+  uint64_t pk_header_checksum;
+  uint64_t min_size;
+  uint64_t m;
+  pk_binary_section twiddles;
+  uint64_t payload_checksum;
+  // over all header bytes before this field
+  uint64_t header_checksum;
+};
+
+inline std::string provingKeyDomainPath(const char* pk_path)
+{
+  return std::string(pk_path) + ".domain";
+}
+
+// false, and nothing written, when the key's domain has no twiddle table
+inline bool writeProvingKeyDomain(const qap_domain &domain, size_t min_size, uint64_t pk_header_checksum, const char* path)
+{
+  if (!domain.hasTwiddleTable()) {
+    return false;
+  }
+
+  pk_domain_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, pk_domain_magic, sizeof(pk_domain_magic));
+  header.version = pk_domain_version;
+  header.header_size = sizeof(header);
+  memcpy(header.modulus_r, libff::alt_bn128_modulus_r.data, sizeof(header.modulus_r));
+  header.pk_header_checksum = pk_header_checksum;
+  header.min_size = min_size;
+  header.m = domain.m;
+  header.twiddles.offset = alignedSize(sizeof(header));
+  header.twiddles.length = (domain.m / 2) * sizeof(libff::alt_bn128_Fr);
+
+  std::ofstream fh(path, std::ios::binary);
+  if (!fh.is_open()) {
+    throw std::runtime_error(std::string("cannot open ") + path);
+  }
+
+  // header is written last, once the payload checksum is known
+  fh.seekp(header.twiddles.offset);
+  pk_binary_writer out(fh);
+  out.write(domain.twiddleTable(), header.twiddles.length);
+
+  header.payload_checksum = out.checksum.h;
+  pk_checksum header_sum;
+  header_sum.update(&header, offsetof(pk_domain_header, header_checksum));
+  header.header_checksum = header_sum.h;
+
+  fh.seekp(0);
+  fh.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  fh.flush();
+  if (!fh) {
+    throw std::runtime_error(std::string("error writing ") + path);
+  }
+  return true;
+}
+
+// A twiddle table mapped into memory and the domain using it in place,
+// validated against the key it is used with.
+class mapped_proving_key_domain {
+public:
+  mapped_proving_key_domain(const char* path, size_t min_size, uint64_t pk_header_checksum) : file(path)
+  {
+    if (file.size() < sizeof(pk_domain_header)) {
+      throw std::runtime_error("proving key domain: truncated header");
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, pk_domain_magic, sizeof(pk_domain_magic)) != 0) {
+      throw std::runtime_error("proving key domain: bad magic");
+    }
+    if (header.version != pk_domain_version || header.header_size != sizeof(pk_domain_header)) {
+      throw std::runtime_error("proving key domain: unsupported version");
+    }
+    pk_checksum header_sum;
+    header_sum.update(&header, offsetof(pk_domain_header, header_checksum));
+    if (header_sum.h != header.header_checksum) {
+      throw std::runtime_error("proving key domain: header checksum mismatch");
+    }
+    if (header.pk_header_checksum != pk_header_checksum || header.min_size != min_size ||
+        memcmp(header.modulus_r, libff::alt_bn128_modulus_r.data, sizeof(header.modulus_r)) != 0) {
+      throw std::runtime_error("proving key domain: computed for a different proving key");
+    }
+    if (header.twiddles.offset % pk_binary_alignment != 0 ||
+        header.twiddles.length != (header.m / 2) * sizeof(libff::alt_bn128_Fr) ||
+        header.twiddles.offset + header.twiddles.length > file.size()) {
+      throw std::runtime_error("proving key domain: truncated file");
+    }
+    // a corrupted twiddle would silently produce invalid proofs
+    pk_checksum payload_sum;
+    payload_sum.update(file.data() + header.twiddles.offset, header.twiddles.length);
+    if (payload_sum.h != header.payload_checksum) {
+      throw std::runtime_error("proving key domain: payload checksum mismatch");
+    }
+
+    d.reset(new qap_domain(min_size, reinterpret_cast<const libff::alt_bn128_Fr*>(file.data() + header.twiddles.offset), header.m / 2));
+  }
+
+  mapped_proving_key_domain(const mapped_proving_key_domain&) = delete;
+  mapped_proving_key_domain& operator=(const mapped_proving_key_domain&) = delete;
+
+  const qap_domain& domain() const { return *d; }
+
+private:
+  mapped_file file;
+  pk_domain_header header;
+  std::unique_ptr<qap_domain> d;
+};
+
+#endif // ZOKRATES_PK_DOMAIN_HPP_
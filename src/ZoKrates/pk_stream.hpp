@@ -0,0 +1,309 @@
+/**
+ * @file pk_stream.hpp
+ *
+ * Out-of-core proving for binary proving keys that do not fit into memory.
+ *
+ * streamed_proving_key reads the header, the query indices and the
+ * constraint system section of a binary key (see pk_binary.hpp), which is
+ * used in its flat form, and leaves the query values, which make up almost
+ * all of the key, on disk. proveStreamed then reads every query in chunks
+ * with pread and accumulates the partial multi-exponentiations chunk by
+ * chunk. The memory budget the key was opened with covers the resident
+ * sections (constraint system and indices) plus the chunk buffer and its
+ * scalars; the witness and the QAP witness are the same as with a mapped key
+ * and not counted.
+ *
+ * The sum of the partial results is the same group element the in-memory
+ * prover computes, so for the same randomness the proofs are identical.
+ * Unlike a mapped key, the pages read are not kept in the page cache by us;
+ * reads go through a single buffer that is reused for all chunks.
+ */
+
+#ifndef ZOKRATES_PK_STREAM_HPP_
+#define ZOKRATES_PK_STREAM_HPP_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pk_binary.hpp"
+#include "prover.hpp"
+#include "trace.hpp"
+
+// below this the chunks get too small for Pippenger to pay off
+const size_t pk_stream_min_budget = size_t(1) << 20;
+
+class streamed_proving_key {
+public:
+  // memory_budget bounds the resident sections, the chunk buffer and its
+  // scalars, in bytes. Throws if it leaves less than pk_stream_min_budget for
+  // the chunks.
+  streamed_proving_key(const char* pk_path, size_t memory_budget) : path(pk_path), budget(memory_budget), chunk_budget(0)
+  {
+    fd = open(pk_path, O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error(std::string("cannot open ") + pk_path);
+    }
+    try {
+      struct stat st;
+      if (fstat(fd, &st) != 0) {
+        throw std::runtime_error(std::string("cannot stat ") + pk_path);
+      }
+      read(0, &header, sizeof(header));
+      checkProvingKeyHeader(header, st.st_size);
+
+      const uint64_t cs_length = header.sections[PK_SECTION_CONSTRAINT_SYSTEM].length;
+      cs_section.resize((cs_length + 7) / 8);
+      read(header.sections[PK_SECTION_CONSTRAINT_SYSTEM].offset, cs_section.data(), cs_length);
+      flat = flatViewOfConstraintSystemSection(reinterpret_cast<const uint8_t*>(cs_section.data()), cs_length);
+
+      A_indices = readIndices(PK_SECTION_A_INDICES);
+      B_indices = readIndices(PK_SECTION_B_INDICES);
+      C_indices = readIndices(PK_SECTION_C_INDICES);
+
+      const size_t resident = 8 * cs_section.size() + sizeof(size_t) * (A_indices.size() + B_indices.size() + C_indices.size());
+      if (budget < resident || budget - resident < pk_stream_min_budget) {
+        throw std::runtime_error("streamed proving key: a memory budget of " + std::to_string(budget) + " bytes is too small, " +
+                                 std::to_string(resident) + " bytes stay resident and the chunks need " +
+                                 std::to_string(pk_stream_min_budget) + " more");
+      }
+      chunk_budget = budget - resident;
+
+      v.A_query = kcSection<libff::alt_bn128_G1, libff::alt_bn128_G1>(A_indices, PK_SECTION_A_VALUES, header.A_domain_size);
+      v.B_query = kcSection<libff::alt_bn128_G2, libff::alt_bn128_G1>(B_indices, PK_SECTION_B_VALUES, header.B_domain_size);
+      v.C_query = kcSection<libff::alt_bn128_G1, libff::alt_bn128_G1>(C_indices, PK_SECTION_C_VALUES, header.C_domain_size);
+      v.H_query.size = header.sections[PK_SECTION_H_VALUES].length / sizeof(libff::alt_bn128_G1);
+      v.H_query.values = nullptr;
+      v.K_query.size = header.sections[PK_SECTION_K_VALUES].length / sizeof(libff::alt_bn128_G1);
+      v.K_query.values = nullptr;
+      v.flat_constraints = &flat;
+      checkProvingKeyQueries(v);
+    } catch (...) {
+      close(fd);
+      throw;
+    }
+  }
+
+  ~streamed_proving_key()
+  {
+    close(fd);
+  }
+
+  streamed_proving_key(const streamed_proving_key&) = delete;
+  streamed_proving_key& operator=(const streamed_proving_key&) = delete;
+
+  // sizes, indices and flat constraint system; the values pointers and
+  // constraint_system are null
+  const proving_key_view& view() const { return v; }
+
+  size_t memoryBudget() const { return budget; }
+
+  // what is left of the budget for a chunk and its scalars
+  size_t chunkBudget() const { return chunk_budget; }
+
+  // identifies the key file, see pk_tables.hpp
+  uint64_t headerChecksum() const { return header.header_checksum; }
+
+  // element i of a values section
+  template<typename T>
+  T element(int values_id, size_t i) const
+  {
+    T value;
+    read(header.sections[values_id].offset + i * sizeof(T), &value, sizeof(T));
+    return value;
+  }
+
+  // Calls f(values, first, count) for consecutive chunks covering the
+  // elements [begin, end) of a values section, values[0] being element first.
+  // Each chunk fits chunkBudget() together with one scalar per element.
+  template<typename T, typename F>
+  void forEachChunk(int values_id, size_t begin, size_t end, std::vector<uint8_t> &buffer, F f) const
+  {
+    const size_t chunk = std::max<size_t>(1, chunk_budget / (sizeof(T) + sizeof(multiexp_scalar)));
+    for (size_t first = begin; first < end; first += chunk) {
+      const size_t count = std::min(chunk, end - first);
+      buffer.resize(count * sizeof(T));
+      read(header.sections[values_id].offset + first * sizeof(T), buffer.data(), buffer.size());
+      f(reinterpret_cast<const T*>(buffer.data()), first, count);
+    }
+  }
+
+private:
+  void read(uint64_t offset, void* out, size_t len) const
+  {
+    uint8_t* p = static_cast<uint8_t*>(out);
+    while (len > 0) {
+      const ssize_t n = pread(fd, p, len, offset);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        throw std::runtime_error("cannot read " + path);
+      }
+      p += n;
+      offset += n;
+      len -= n;
+    }
+  }
+
+  std::vector<size_t> readIndices(int indices_id) const
+  {
+    std::vector<size_t> indices(header.sections[indices_id].length / 8);
+    read(header.sections[indices_id].offset, indices.data(), 8 * indices.size());
+    return indices;
+  }
+
+  template<typename T1, typename T2>
+  kc_query_view<T1, T2> kcSection(const std::vector<size_t> &indices, int values_id, uint64_t domain_size) const
+  {
+    kc_query_view<T1, T2> q;
+    q.domain_size = domain_size;
+    q.size = indices.size();
+    q.indices = indices.data();
+    q.values = nullptr;
+    if (header.sections[values_id].length != q.size * sizeof(libsnark::knowledge_commitment<T1, T2>)) {
+      throw std::runtime_error("binary proving key: query size mismatch");
+    }
+    return q;
+  }
+
+  std::string path;
+  size_t budget;
+  size_t chunk_budget;
+  int fd;
+  pk_binary_header header;
+  // the constraint system section as read, flat points into it
+  std::vector<uint64_t> cs_section;
+  flat_r1cs_view flat;
+  std::vector<size_t> A_indices, B_indices, C_indices;
+  proving_key_view v;
+};
+
+// kcQueryAt for a streamed key
+template<typename T1, typename T2>
+libsnark::knowledge_commitment<T1, T2> kcStreamedAt(const streamed_proving_key &pk, const kc_query_view<T1, T2> &q, int values_id, size_t idx)
+{
+  const size_t* it = std::lower_bound(q.indices, q.indices + q.size, idx);
+  if (it == q.indices + q.size || *it != idx) {
+    return libsnark::knowledge_commitment<T1, T2>::zero();
+  }
+  return pk.element<libsnark::knowledge_commitment<T1, T2>>(values_id, it - q.indices);
+}
+
+// kcMultiExp over a streamed query, one chunk at a time
+template<typename T1, typename T2>
+libsnark::knowledge_commitment<T1, T2> kcStreamedMultiExp(const streamed_proving_key &pk, const kc_query_view<T1, T2> &q, int values_id,
+                                                          size_t min_idx, size_t max_idx, const std::vector<libff::alt_bn128_Fr> &coeffs,
+                                                          prover_scratch &scratch, std::vector<uint8_t> &buffer)
+{
+  typedef libsnark::knowledge_commitment<T1, T2> KC;
+
+  const size_t lo = std::lower_bound(q.indices, q.indices + q.size, min_idx) - q.indices;
+  const size_t hi = std::lower_bound(q.indices, q.indices + q.size, max_idx) - q.indices;
+
+  KC result = KC::zero();
+  pk.forEachChunk<KC>(values_id, lo, hi, buffer, [&](const KC* values, size_t first, size_t count) {
+    scratch.scalars.clear();
+    scratch.scalars.reserve(count);
+    for (size_t i = first; i < first + count; ++i) {
+      scratch.scalars.emplace_back(coeffs[q.indices[i] - min_idx].as_bigint());
+    }
+    result = result + KC(multiExpPippenger(strided_points<T1>(&values[0].g, sizeof(KC), count), scratch.scalars),
+                         multiExpPippenger(strided_points<T2>(&values[0].h, sizeof(KC), count), scratch.scalars));
+  });
+  return result;
+}
+
+// queryMultiExp over a streamed query: sum_{i < n} coeffs[i] * q[first + i]
+inline libff::alt_bn128_G1 queryStreamedMultiExp(const streamed_proving_key &pk, int values_id, size_t first,
+                                                 const libff::alt_bn128_Fr* coeffs, size_t n,
+                                                 prover_scratch &scratch, std::vector<uint8_t> &buffer)
+{
+  typedef libff::alt_bn128_G1 G1;
+
+  G1 result = G1::zero();
+  pk.forEachChunk<G1>(values_id, first, first + n, buffer, [&](const G1* values, size_t chunk_first, size_t count) {
+    scalarsFromField(coeffs + (chunk_first - first), count, scratch.scalars);
+    result = result + multiExpPippenger(strided_points<G1>(values, sizeof(G1), count), scratch.scalars);
+  });
+  return result;
+}
+
+// proofFromQapWitness for a streamed key
+inline libsnark::r1cs_ppzksnark_proof<prover_pp> proofFromQapWitnessStreamed(const streamed_proving_key &key,
+                                                                             const libsnark::qap_witness<libff::alt_bn128_Fr> &qap_wit,
+                                                                             prover_scratch &scratch)
+{
+  typedef libff::alt_bn128_G1 G1;
+  typedef libff::alt_bn128_G2 G2;
+  typedef libsnark::knowledge_commitment<G1, G1> KC11;
+  typedef libsnark::knowledge_commitment<G2, G1> KC21;
+
+  const proving_key_view &pk = key.view();
+  const size_t n = qap_wit.num_variables();
+  assert(pk.A_query.domain_size == n + 2);
+  assert(pk.B_query.domain_size == n + 2);
+  assert(pk.C_query.domain_size == n + 2);
+  assert(pk.H_query.size == qap_wit.degree() + 1);
+  assert(pk.K_query.size == n + 4);
+
+  KC11 g_A = kcStreamedAt(key, pk.A_query, PK_SECTION_A_VALUES, 0) + qap_wit.d1 * kcStreamedAt(key, pk.A_query, PK_SECTION_A_VALUES, n + 1);
+  KC21 g_B = kcStreamedAt(key, pk.B_query, PK_SECTION_B_VALUES, 0) + qap_wit.d2 * kcStreamedAt(key, pk.B_query, PK_SECTION_B_VALUES, n + 1);
+  KC11 g_C = kcStreamedAt(key, pk.C_query, PK_SECTION_C_VALUES, 0) + qap_wit.d3 * kcStreamedAt(key, pk.C_query, PK_SECTION_C_VALUES, n + 1);
+
+  G1 g_H = G1::zero();
+  G1 g_K = (key.element<G1>(PK_SECTION_K_VALUES, 0) +
+            qap_wit.d1 * key.element<G1>(PK_SECTION_K_VALUES, n + 1) +
+            qap_wit.d2 * key.element<G1>(PK_SECTION_K_VALUES, n + 2) +
+            qap_wit.d3 * key.element<G1>(PK_SECTION_K_VALUES, n + 3));
+
+  std::vector<uint8_t> buffer;
+
+  libff::enter_block("Compute the proof");
+  {
+    trace_span span("prove/multiexp_A");
+    g_A = g_A + kcStreamedMultiExp(key, pk.A_query, PK_SECTION_A_VALUES, 1, 1 + n, qap_wit.coefficients_for_ABCs, scratch, buffer);
+  }
+  {
+    trace_span span("prove/multiexp_B");
+    g_B = g_B + kcStreamedMultiExp(key, pk.B_query, PK_SECTION_B_VALUES, 1, 1 + n, qap_wit.coefficients_for_ABCs, scratch, buffer);
+  }
+  {
+    trace_span span("prove/multiexp_C");
+    g_C = g_C + kcStreamedMultiExp(key, pk.C_query, PK_SECTION_C_VALUES, 1, 1 + n, qap_wit.coefficients_for_ABCs, scratch, buffer);
+  }
+  {
+    trace_span span("prove/multiexp_H");
+    g_H = g_H + queryStreamedMultiExp(key, PK_SECTION_H_VALUES, 0, qap_wit.coefficients_for_H.data(), qap_wit.degree() + 1, scratch, buffer);
+  }
+  {
+    trace_span span("prove/multiexp_K");
+    g_K = g_K + queryStreamedMultiExp(key, PK_SECTION_K_VALUES, 1, qap_wit.coefficients_for_ABCs.data(), n, scratch, buffer);
+  }
+  libff::leave_block("Compute the proof");
+
+  return libsnark::r1cs_ppzksnark_proof<prover_pp>(std::move(g_A), std::move(g_B), std::move(g_C), std::move(g_H), std::move(g_K));
+}
+
+// proveWithKeyView for a streamed key
+inline libsnark::r1cs_ppzksnark_proof<prover_pp> proveStreamed(const streamed_proving_key &key,
+                                                               const libsnark::r1cs_ppzksnark_primary_input<prover_pp> &primary_input,
+                                                               const libsnark::r1cs_ppzksnark_auxiliary_input<prover_pp> &auxiliary_input)
+{
+  trace_span prove_span("prove_streamed");
+  libff::enter_block("Call to proveStreamed");
+  prover_scratch scratch;
+  const libsnark::qap_witness<libff::alt_bn128_Fr> qap_wit = qapWitnessForProof(key.view(), primary_input, auxiliary_input);
+  libsnark::r1cs_ppzksnark_proof<prover_pp> proof = proofFromQapWitnessStreamed(key, qap_wit, scratch);
+  libff::leave_block("Call to proveStreamed");
+  return proof;
+}
+
+#endif // ZOKRATES_PK_STREAM_HPP_
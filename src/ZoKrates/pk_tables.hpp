@@ -0,0 +1,252 @@
+/**
+ * @file pk_tables.hpp
+ *
+ * Fixed-base tables for a binary proving key, stored next to it as
+ * <pk_path>.tables.
+ *
+ * The query bases never change between proofs, so the doublings that a
+ * multiexp spends on them can be done once: for every base P the file holds
+ * 2^(j * shift_bits) * P for j < num_shifts, normalized to Z = 1 (see
+ * fixed_base_table and multiExpWithTable in multiexp.hpp). num_shifts is the
+ * memory/speed tradeoff: the file is about num_shifts times the size of the
+ * queries, and proving needs about 1/num_shifts of the doublings.
+ *
+ * Layout: pk_tables_header, then one 64 byte aligned section per table,
+ * holding the num_shifts shifted copies of the bases one after another. The
+ * header records the header checksum of the proving key the tables were
+ * computed from, so they are never used with another key.
+ */
+
+#ifndef ZOKRATES_PK_TABLES_HPP_
+#define ZOKRATES_PK_TABLES_HPP_
+
+#include <vector>
+
+#include "affine.hpp"
+#include "pk_binary.hpp"
+
+const char pk_tables_magic[8] = { 'Z', 'K', 'P', 'K', 'T', 'B', 'L', '\0' };
+const uint32_t pk_tables_version = 1;
+const size_t pk_tables_max_shifts = 64;
+
+enum pk_tables_section_id {
+  PK_TABLE_A_G,
+  PK_TABLE_A_H,
+  PK_TABLE_B_G,
+  PK_TABLE_B_H,
+  PK_TABLE_C_G,
+  PK_TABLE_C_H,
+  PK_TABLE_H,
+  PK_TABLE_K,
+  PK_TABLE_COUNT
+};
+
+struct pk_tables_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t num_shifts;
+  uint64_t shift_bits;
+  // header_checksum of the proving key
+  uint64_t pk_header_checksum;
+  // number of bases per table
+  uint64_t counts[PK_TABLE_COUNT];
+  pk_binary_section sections[PK_TABLE_COUNT];
+  uint64_t payload_checksum;
+  // over all header bytes before this field
+  uint64_t header_checksum;
+};
+
+inline std::string provingKeyTablesPath(const char* pk_path)
+{
+  return std::string(pk_path) + ".tables";
+}
+
+inline size_t tableShiftBits(size_t num_shifts)
+{
+  const size_t bits = libff::alt_bn128_Fr::size_in_bits();
+  return (bits + num_shifts - 1) / num_shifts;
+}
+
+// writes the num_shifts shifted copies of the bases. Holds two copies of the
+// bases in memory, not the whole table.
+template<typename T>
+void writeTableSection(pk_binary_writer &out, strided_points<T> bases, size_t num_shifts, size_t shift_bits)
+{
+  std::vector<T> shifted(bases.size);
+  for (size_t i = 0; i < bases.size; ++i) {
+    shifted[i] = bases[i];
+  }
+
+  std::vector<T> affine;
+  for (size_t j = 0; j < num_shifts; ++j) {
+    affine = shifted;
+    batchToAffineCoordinates(affine);
+    out.write(affine.data(), affine.size() * sizeof(T));
+
+    if (j + 1 < num_shifts) {
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+      for (size_t i = 0; i < shifted.size(); ++i) {
+        for (size_t b = 0; b < shift_bits; ++b) {
+          shifted[i] = shifted[i].dbl();
+        }
+      }
+    }
+  }
+  out.pad();
+}
+
+inline void writeProvingKeyTables(const mapped_proving_key &pk, const char* tables_path, size_t num_shifts)
+{
+  if (num_shifts == 0 || num_shifts > pk_tables_max_shifts) {
+    throw std::invalid_argument("proving key tables: number of shifts must be between 1 and " + std::to_string(pk_tables_max_shifts));
+  }
+  const proving_key_view &v = pk.view();
+
+  pk_tables_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, pk_tables_magic, sizeof(pk_tables_magic));
+  header.version = pk_tables_version;
+  header.header_size = sizeof(header);
+  header.num_shifts = num_shifts;
+  header.shift_bits = tableShiftBits(num_shifts);
+  header.pk_header_checksum = pk.headerChecksum();
+
+  const uint64_t counts[PK_TABLE_COUNT] = {
+    v.A_query.size, v.A_query.size, v.B_query.size, v.B_query.size,
+    v.C_query.size, v.C_query.size, v.H_query.size, v.K_query.size
+  };
+  const uint64_t point_sizes[PK_TABLE_COUNT] = {
+    sizeof(libff::alt_bn128_G1), sizeof(libff::alt_bn128_G1), sizeof(libff::alt_bn128_G2), sizeof(libff::alt_bn128_G1),
+    sizeof(libff::alt_bn128_G1), sizeof(libff::alt_bn128_G1), sizeof(libff::alt_bn128_G1), sizeof(libff::alt_bn128_G1)
+  };
+  uint64_t offset = alignedSize(sizeof(header));
+  for (int i = 0; i < PK_TABLE_COUNT; ++i) {
+    header.counts[i] = counts[i];
+    header.sections[i].offset = offset;
+    header.sections[i].length = num_shifts * counts[i] * point_sizes[i];
+    offset += alignedSize(header.sections[i].length);
+  }
+
+  std::ofstream fh(tables_path, std::ios::binary);
+  if (!fh.is_open()) {
+    throw std::runtime_error(std::string("cannot open ") + tables_path);
+  }
+
+  // header is written last, once the payload checksum is known
+  fh.seekp(header.sections[0].offset);
+  pk_binary_writer out(fh);
+  out.written = header.sections[0].offset;
+
+  typedef libsnark::knowledge_commitment<libff::alt_bn128_G1, libff::alt_bn128_G1> kc_G1;
+  typedef libsnark::knowledge_commitment<libff::alt_bn128_G2, libff::alt_bn128_G1> kc_G2;
+  const size_t shift_bits = header.shift_bits;
+  writeTableSection(out, strided_points<libff::alt_bn128_G1>(&v.A_query.values[0].g, sizeof(kc_G1), v.A_query.size), num_shifts, shift_bits);
+  writeTableSection(out, strided_points<libff::alt_bn128_G1>(&v.A_query.values[0].h, sizeof(kc_G1), v.A_query.size), num_shifts, shift_bits);
+  writeTableSection(out, strided_points<libff::alt_bn128_G2>(&v.B_query.values[0].g, sizeof(kc_G2), v.B_query.size), num_shifts, shift_bits);
+  writeTableSection(out, strided_points<libff::alt_bn128_G1>(&v.B_query.values[0].h, sizeof(kc_G2), v.B_query.size), num_shifts, shift_bits);
+  writeTableSection(out, strided_points<libff::alt_bn128_G1>(&v.C_query.values[0].g, sizeof(kc_G1), v.C_query.size), num_shifts, shift_bits);
+  writeTableSection(out, strided_points<libff::alt_bn128_G1>(&v.C_query.values[0].h, sizeof(kc_G1), v.C_query.size), num_shifts, shift_bits);
+  writeTableSection(out, strided_points<libff::alt_bn128_G1>(v.H_query.values, sizeof(libff::alt_bn128_G1), v.H_query.size), num_shifts, shift_bits);
+  writeTableSection(out, strided_points<libff::alt_bn128_G1>(v.K_query.values, sizeof(libff::alt_bn128_G1), v.K_query.size), num_shifts, shift_bits);
+  assert(out.written == offset);
+
+  header.payload_checksum = out.checksum.h;
+  pk_checksum header_sum;
+  header_sum.update(&header, offsetof(pk_tables_header, header_checksum));
+  header.header_checksum = header_sum.h;
+
+  fh.seekp(0);
+  fh.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  fh.flush();
+  if (!fh) {
+    throw std::runtime_error(std::string("error writing ") + tables_path);
+  }
+}
+
+// Tables mapped into memory, validated against the key they are used with.
+// Attach them with pk.attachTables(&tables.tables()).
+class mapped_proving_key_tables {
+public:
+  mapped_proving_key_tables(const char* tables_path, const mapped_proving_key &pk) : file(tables_path)
+  {
+    if (file.size() < sizeof(pk_tables_header)) {
+      throw std::runtime_error("proving key tables: truncated header");
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    checkHeader(pk);
+
+    t.A_g = table<libff::alt_bn128_G1>(PK_TABLE_A_G);
+    t.A_h = table<libff::alt_bn128_G1>(PK_TABLE_A_H);
+    t.B_g = table<libff::alt_bn128_G2>(PK_TABLE_B_G);
+    t.B_h = table<libff::alt_bn128_G1>(PK_TABLE_B_H);
+    t.C_g = table<libff::alt_bn128_G1>(PK_TABLE_C_G);
+    t.C_h = table<libff::alt_bn128_G1>(PK_TABLE_C_H);
+    t.H = table<libff::alt_bn128_G1>(PK_TABLE_H);
+    t.K = table<libff::alt_bn128_G1>(PK_TABLE_K);
+  }
+
+  mapped_proving_key_tables(const mapped_proving_key_tables&) = delete;
+  mapped_proving_key_tables& operator=(const mapped_proving_key_tables&) = delete;
+
+  const proving_key_tables& tables() const { return t; }
+  size_t numShifts() const { return header.num_shifts; }
+
+private:
+  void checkHeader(const mapped_proving_key &pk) const
+  {
+    if (memcmp(header.magic, pk_tables_magic, sizeof(pk_tables_magic)) != 0) {
+      throw std::runtime_error("proving key tables: bad magic");
+    }
+    if (header.version != pk_tables_version || header.header_size != sizeof(pk_tables_header)) {
+      throw std::runtime_error("proving key tables: unsupported version");
+    }
+    pk_checksum header_sum;
+    header_sum.update(&header, offsetof(pk_tables_header, header_checksum));
+    if (header_sum.h != header.header_checksum) {
+      throw std::runtime_error("proving key tables: header checksum mismatch");
+    }
+    if (header.pk_header_checksum != pk.headerChecksum()) {
+      throw std::runtime_error("proving key tables: computed for a different proving key");
+    }
+    if (header.num_shifts == 0 || header.num_shifts > pk_tables_max_shifts ||
+        header.shift_bits != tableShiftBits(header.num_shifts)) {
+      throw std::runtime_error("proving key tables: bad shift parameters");
+    }
+
+    const proving_key_view &v = pk.view();
+    const uint64_t counts[PK_TABLE_COUNT] = {
+      v.A_query.size, v.A_query.size, v.B_query.size, v.B_query.size,
+      v.C_query.size, v.C_query.size, v.H_query.size, v.K_query.size
+    };
+    for (int i = 0; i < PK_TABLE_COUNT; ++i) {
+      const size_t point_size = (i == PK_TABLE_B_G ? sizeof(libff::alt_bn128_G2) : sizeof(libff::alt_bn128_G1));
+      if (header.counts[i] != counts[i] || header.sections[i].length != header.num_shifts * counts[i] * point_size) {
+        throw std::runtime_error("proving key tables: size mismatch");
+      }
+      if (header.sections[i].offset % pk_binary_alignment != 0 ||
+          header.sections[i].offset + header.sections[i].length > file.size()) {
+        throw std::runtime_error("proving key tables: truncated file");
+      }
+    }
+  }
+
+  template<typename T>
+  fixed_base_table<T> table(int id) const
+  {
+    fixed_base_table<T> result;
+    result.count = header.counts[id];
+    result.num_shifts = header.num_shifts;
+    result.shift_bits = header.shift_bits;
+    result.points = reinterpret_cast<const T*>(file.data() + header.sections[id].offset);
+    return result;
+  }
+
+  mapped_file file;
+  pk_tables_header header;
+  proving_key_tables t;
+};
+
+#endif // ZOKRATES_PK_TABLES_HPP_
@@ -0,0 +1,347 @@
+/**
+ * @file proof_bundle.hpp
+ *
+ * Compact binary encoding of r1cs_ppzksnark proofs together with their
+ * primary inputs.
+ *
+ * Points are stored compressed: the big endian affine x coordinate (for G2
+ * x.c1 then x.c0, like the hex export), with the two top bits of the first
+ * byte, which are always clear because q < 2^254, used as flags for the point
+ * at infinity and for the parity of y (of y.c0 for G2, of y.c1 if y.c0 is
+ * zero). Decoding recovers y with a square root and checks that every point
+ * is on the curve and, for G2, in the prime order subgroup.
+ *
+ * Bundle layout (integers little endian):
+ *   "ZKPB", version (1 byte), backend (1 byte, 0 = r1cs_ppzksnark),
+ *   2 reserved bytes, circuit id (32 bytes, see constraintSystemDigest),
+ *   number of inputs (4 bytes), A, A_p, B, B_p, C, C_p, H, K (288 bytes),
+ *   the inputs as 32 byte big endian field elements.
+ *
+ * A stream is a sequence of bundles, each preceded by its length as 4 bytes
+ * little endian.
+ */
+
+#ifndef ZOKRATES_PROOF_BUNDLE_HPP_
+#define ZOKRATES_PROOF_BUNDLE_HPP_
+
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
+
+#include "affine.hpp"
+#include "prover.hpp"
+
+const char proof_bundle_magic[4] = { 'Z', 'K', 'P', 'B' };
+const uint8_t proof_bundle_version = 1;
+const uint8_t proof_bundle_backend_ppzksnark = 0;
+const size_t proof_bundle_header_size = 44;
+const size_t proof_bundle_points_size = 7 * 32 + 64;
+
+const uint8_t point_flag_infinity = 0x80;
+const uint8_t point_flag_odd = 0x40;
+
+inline size_t proofBundleSize(size_t num_inputs)
+{
+  return proof_bundle_header_size + proof_bundle_points_size + 32 * num_inputs;
+}
+
+struct proof_bundle {
+  uint8_t circuit_id[32];
+  libsnark::r1cs_primary_input<libff::alt_bn128_Fr> primary_input;
+  libsnark::r1cs_ppzksnark_proof<prover_pp> proof;
+};
+
+template<mp_size_t n>
+void bigintToBytes(const libff::bigint<n> &x, uint8_t* out)
+{
+  for (mp_size_t i = 0; i < n; ++i) {
+    const uint64_t limb = x.data[n - 1 - i];
+    for (int j = 0; j < 8; ++j) {
+      out[8 * i + j] = uint8_t(limb >> (56 - 8 * j));
+    }
+  }
+}
+
+// big endian bytes to a field element, rejecting values >= the modulus
+template<typename FieldT>
+FieldT fieldFromBytes(const uint8_t* in)
+{
+  const mp_size_t n = FieldT::num_limbs;
+  libff::bigint<n> x;
+  for (mp_size_t i = 0; i < n; ++i) {
+    uint64_t limb = 0;
+    for (int j = 0; j < 8; ++j) {
+      limb = (limb << 8) | in[8 * i + j];
+    }
+    x.data[n - 1 - i] = limb;
+  }
+  if (mpn_cmp(x.data, FieldT::mod.data, n) >= 0) {
+    throw std::runtime_error("proof bundle: field element out of range");
+  }
+  return FieldT(x);
+}
+
+inline bool isOdd(const libff::alt_bn128_Fq &x)
+{
+  return x.as_bigint().data[0] & 1;
+}
+
+inline bool isOdd(const libff::alt_bn128_Fq2 &x)
+{
+  return x.c0.is_zero() ? isOdd(x.c1) : isOdd(x.c0);
+}
+
+inline bool isSquare(const libff::alt_bn128_Fq &x)
+{
+  return x.is_zero() || (x ^ libff::alt_bn128_Fq::euler) == libff::alt_bn128_Fq::one();
+}
+
+// a in Fq2 is a square iff its norm is a square in Fq
+inline bool isSquare(const libff::alt_bn128_Fq2 &x)
+{
+  return isSquare(x.c0.squared() - libff::alt_bn128_Fq2::non_residue * x.c1.squared());
+}
+
+// y with y^2 = rhs and the given parity; throws if rhs is not a square
+template<typename FieldT>
+FieldT sqrtWithParity(const FieldT &rhs, bool odd)
+{
+  if (!isSquare(rhs)) {
+    throw std::runtime_error("proof bundle: point not on curve");
+  }
+  FieldT y = rhs.sqrt();
+  if (isOdd(y) != odd) {
+    y = -y;
+  }
+  return y;
+}
+
+// aff has to be in affine coordinates
+inline void compressG1(const libff::alt_bn128_G1 &aff, uint8_t* out)
+{
+  if (aff.is_zero()) {
+    memset(out, 0, 32);
+    out[0] = point_flag_infinity;
+    return;
+  }
+  bigintToBytes(aff.X.as_bigint(), out);
+  if (isOdd(aff.Y)) {
+    out[0] |= point_flag_odd;
+  }
+}
+
+// aff has to be in affine coordinates
+inline void compressG2(const libff::alt_bn128_G2 &aff, uint8_t* out)
+{
+  if (aff.is_zero()) {
+    memset(out, 0, 64);
+    out[0] = point_flag_infinity;
+    return;
+  }
+  bigintToBytes(aff.X.c1.as_bigint(), out);
+  bigintToBytes(aff.X.c0.as_bigint(), out + 32);
+  if (isOdd(aff.Y)) {
+    out[0] |= point_flag_odd;
+  }
+}
+
+// copies a compressed coordinate and strips the flags from it
+inline uint8_t splitFlags(const uint8_t* in, uint8_t* x, size_t len)
+{
+  memcpy(x, in, len);
+  const uint8_t flags = x[0] & (point_flag_infinity | point_flag_odd);
+  x[0] &= ~(point_flag_infinity | point_flag_odd);
+  if (flags & point_flag_infinity) {
+    for (size_t i = 0; i < len; ++i) {
+      if (x[i] != 0 || (flags & point_flag_odd)) {
+        throw std::runtime_error("proof bundle: malformed point at infinity");
+      }
+    }
+  }
+  return flags;
+}
+
+inline libff::alt_bn128_G1 decompressG1(const uint8_t* in)
+{
+  uint8_t x_bytes[32];
+  const uint8_t flags = splitFlags(in, x_bytes, sizeof(x_bytes));
+  if (flags & point_flag_infinity) {
+    return libff::alt_bn128_G1::zero();
+  }
+  const libff::alt_bn128_Fq x = fieldFromBytes<libff::alt_bn128_Fq>(x_bytes);
+  const libff::alt_bn128_Fq y = sqrtWithParity(x.squared() * x + libff::alt_bn128_coeff_b, flags & point_flag_odd);
+  // G1 has cofactor 1, being on the curve is enough
+  return libff::alt_bn128_G1(x, y, libff::alt_bn128_Fq::one());
+}
+
+inline libff::alt_bn128_G2 decompressG2(const uint8_t* in)
+{
+  uint8_t x_bytes[64];
+  const uint8_t flags = splitFlags(in, x_bytes, sizeof(x_bytes));
+  if (flags & point_flag_infinity) {
+    return libff::alt_bn128_G2::zero();
+  }
+  const libff::alt_bn128_Fq2 x(fieldFromBytes<libff::alt_bn128_Fq>(x_bytes + 32), fieldFromBytes<libff::alt_bn128_Fq>(x_bytes));
+  const libff::alt_bn128_Fq2 y = sqrtWithParity(x.squared() * x + libff::alt_bn128_twist_coeff_b, flags & point_flag_odd);
+  const libff::alt_bn128_G2 p(x, y, libff::alt_bn128_Fq2::one());
+  if (!(libff::alt_bn128_modulus_r * p).is_zero()) {
+    throw std::runtime_error("proof bundle: G2 point not in the prime order subgroup");
+  }
+  return p;
+}
+
+// writes proofBundleSize(primary_input.size()) bytes to out
+inline void encodeProofBundle(const libsnark::r1cs_ppzksnark_proof<prover_pp> &proof,
+                              const libsnark::r1cs_primary_input<libff::alt_bn128_Fr> &primary_input,
+                              const uint8_t circuit_id[32], uint8_t* out)
+{
+  memcpy(out, proof_bundle_magic, sizeof(proof_bundle_magic));
+  out[4] = proof_bundle_version;
+  out[5] = proof_bundle_backend_ppzksnark;
+  out[6] = out[7] = 0;
+  memcpy(out + 8, circuit_id, 32);
+  const uint32_t num_inputs = primary_input.size();
+  for (int i = 0; i < 4; ++i) {
+    out[40 + i] = uint8_t(num_inputs >> (8 * i));
+  }
+
+  std::vector<libff::alt_bn128_G1> g1 = { proof.g_A.g, proof.g_A.h, proof.g_B.h, proof.g_C.g, proof.g_C.h, proof.g_H, proof.g_K };
+  batchToAffineCoordinates(g1);
+  libff::alt_bn128_G2 B = proof.g_B.g;
+  B.to_affine_coordinates();
+
+  uint8_t* points = out + proof_bundle_header_size;
+  compressG1(g1[0], points);
+  compressG1(g1[1], points + 32);
+  compressG2(B, points + 64);
+  compressG1(g1[2], points + 128);
+  compressG1(g1[3], points + 160);
+  compressG1(g1[4], points + 192);
+  compressG1(g1[5], points + 224);
+  compressG1(g1[6], points + 256);
+
+  uint8_t* inputs = points + proof_bundle_points_size;
+  for (size_t i = 0; i < primary_input.size(); ++i) {
+    bigintToBytes(primary_input[i].as_bigint(), inputs + 32 * i);
+  }
+}
+
+inline proof_bundle decodeProofBundle(const uint8_t* data, size_t len)
+{
+  if (len < proof_bundle_header_size || memcmp(data, proof_bundle_magic, sizeof(proof_bundle_magic)) != 0) {
+    throw std::runtime_error("proof bundle: bad magic");
+  }
+  if (data[4] != proof_bundle_version || data[5] != proof_bundle_backend_ppzksnark) {
+    throw std::runtime_error("proof bundle: unsupported version or backend");
+  }
+  uint32_t num_inputs = 0;
+  for (int i = 0; i < 4; ++i) {
+    num_inputs |= uint32_t(data[40 + i]) << (8 * i);
+  }
+  if (len != proofBundleSize(num_inputs)) {
+    throw std::runtime_error("proof bundle: size mismatch");
+  }
+
+  proof_bundle bundle;
+  memcpy(bundle.circuit_id, data + 8, 32);
+
+  const uint8_t* points = data + proof_bundle_header_size;
+  typedef libsnark::knowledge_commitment<libff::alt_bn128_G1, libff::alt_bn128_G1> kc_G1;
+  typedef libsnark::knowledge_commitment<libff::alt_bn128_G2, libff::alt_bn128_G1> kc_G2;
+  bundle.proof = libsnark::r1cs_ppzksnark_proof<prover_pp>(
+    kc_G1(decompressG1(points), decompressG1(points + 32)),
+    kc_G2(decompressG2(points + 64), decompressG1(points + 128)),
+    kc_G1(decompressG1(points + 160), decompressG1(points + 192)),
+    decompressG1(points + 224),
+    decompressG1(points + 256));
+
+  const uint8_t* inputs = points + proof_bundle_points_size;
+  bundle.primary_input.reserve(num_inputs);
+  for (uint32_t i = 0; i < num_inputs; ++i) {
+    bundle.primary_input.emplace_back(fieldFromBytes<libff::alt_bn128_Fr>(inputs + 32 * i));
+  }
+  return bundle;
+}
+
+// appends length prefixed bundles to a stream
+class proof_bundle_stream_writer {
+public:
+  explicit proof_bundle_stream_writer(std::ostream &out) : out(out) {}
+
+  void write(const libsnark::r1cs_ppzksnark_proof<prover_pp> &proof,
+             const libsnark::r1cs_primary_input<libff::alt_bn128_Fr> &primary_input,
+             const uint8_t circuit_id[32])
+  {
+    const uint32_t len = proofBundleSize(primary_input.size());
+    buffer.resize(4 + len);
+    for (int i = 0; i < 4; ++i) {
+      buffer[i] = uint8_t(len >> (8 * i));
+    }
+    encodeProofBundle(proof, primary_input, circuit_id, buffer.data() + 4);
+    out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    if (!out) {
+      throw std::runtime_error("proof bundle: write failed");
+    }
+  }
+
+private:
+  std::ostream &out;
+  std::vector<uint8_t> buffer;
+};
+
+// Splits a stream into its bundles without decoding them.
+inline std::vector<std::pair<const uint8_t*, size_t>> proofBundleStreamRecords(const uint8_t* data, size_t len)
+{
+  std::vector<std::pair<const uint8_t*, size_t>> records;
+  size_t pos = 0;
+  while (pos < len) {
+    if (len - pos < 4) {
+      throw std::runtime_error("proof bundle stream: truncated length prefix");
+    }
+    uint32_t record_len = 0;
+    for (int i = 0; i < 4; ++i) {
+      record_len |= uint32_t(data[pos + i]) << (8 * i);
+    }
+    pos += 4;
+    if (len - pos < record_len) {
+      throw std::runtime_error("proof bundle stream: truncated bundle");
+    }
+    records.emplace_back(data + pos, record_len);
+    pos += record_len;
+  }
+  return records;
+}
+
+// Decodes a whole stream, bundles in parallel under MULTICORE.
+inline std::vector<proof_bundle> decodeProofBundleStream(const uint8_t* data, size_t len)
+{
+  const std::vector<std::pair<const uint8_t*, size_t>> records = proofBundleStreamRecords(data, len);
+  std::vector<proof_bundle> bundles(records.size());
+  std::vector<std::string> errors(records.size());
+
+#ifdef MULTICORE
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+  for (size_t i = 0; i < records.size(); ++i) {
+    try {
+      bundles[i] = decodeProofBundle(records[i].first, records[i].second);
+    } catch (const std::exception &e) {
+      errors[i] = e.what();
+    }
+  }
+
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (!errors[i].empty()) {
+      throw std::runtime_error("bundle " + std::to_string(i) + ": " + errors[i]);
+    }
+  }
+  return bundles;
+}
+
+#endif // ZOKRATES_PROOF_BUNDLE_HPP_
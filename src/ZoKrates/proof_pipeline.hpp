@@ -0,0 +1,287 @@
+/**
+ * @file proof_pipeline.hpp
+ *
+ * Streams many proofs for one proving key through a pipeline of stages:
+ *
+ *   witness -> H polynomial (FFTs) -> multiexp -> export
+ *
+ * Each stage runs on its own thread and hands jobs to the next one through a
+ * bounded queue, so job k+1 computes its witness and H while job k is in the
+ * multiexps. A full queue blocks the stage before it, which bounds the number
+ * of witnesses and QAP witnesses alive at a time (backpressure) and keeps
+ * memory flat however many proofs are streamed.
+ *
+ * The witness source and the export sink are supplied by the caller. Under
+ * MULTICORE the OpenMP team of each stage can be sized separately; by default
+ * the multiexp stage, which dominates, gets proverThreads() and the H stage a
+ * quarter of them. Every stage reports how many jobs it handled, how long it
+ * worked and how long it sat waiting on its neighbours.
+ *
+ * Like proveBatch, the pipeline expects libff's profiling counters to be
+ * inhibited already (see batch_prover.hpp).
+ */
+
+#ifndef ZOKRATES_PROOF_PIPELINE_HPP_
+#define ZOKRATES_PROOF_PIPELINE_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
+#include "batch_prover.hpp"
+#include "prover.hpp"
+#include "threads.hpp"
+#include "trace.hpp"
+
+// FIFO with a fixed capacity. push() blocks while the queue is full, pop()
+// while it is empty; both return false once the queue has been closed (pop
+// only after the remaining items have been drained).
+template<typename T>
+class bounded_queue {
+public:
+  explicit bounded_queue(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+  bool push(T item)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [&]() { return closed || items.size() < capacity; });
+    if (closed) {
+      return false;
+    }
+    items.push_back(std::move(item));
+    not_empty.notify_one();
+    return true;
+  }
+
+  bool pop(T &item)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [&]() { return closed || !items.empty(); });
+    if (items.empty()) {
+      return false;
+    }
+    item = std::move(items.front());
+    items.pop_front();
+    not_full.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    not_full.notify_all();
+    not_empty.notify_all();
+  }
+
+private:
+  const size_t capacity;
+  std::deque<T> items;
+  bool closed = false;
+  std::mutex mutex;
+  std::condition_variable not_full;
+  std::condition_variable not_empty;
+};
+
+struct pipeline_stage_stats {
+  std::string name;
+  size_t jobs = 0;
+  double busy_seconds = 0;
+  double wait_seconds = 0;
+};
+
+struct pipeline_stats {
+  std::vector<pipeline_stage_stats> stages;
+  double wall_seconds = 0;
+  size_t proofs = 0;
+};
+
+inline void printPipelineStats(const pipeline_stats &stats, FILE* out = stdout)
+{
+  fprintf(out, "%zu proofs in %.3f s, %.2f proofs/sec\n", stats.proofs, stats.wall_seconds,
+          stats.wall_seconds > 0 ? stats.proofs / stats.wall_seconds : 0.0);
+  fprintf(out, "%-10s %8s %12s %12s %12s %10s\n", "stage", "jobs", "busy s", "wait s", "jobs/sec", "util");
+  for (const pipeline_stage_stats &s : stats.stages) {
+    fprintf(out, "%-10s %8zu %12.3f %12.3f %12.2f %9.1f%%\n", s.name.c_str(), s.jobs, s.busy_seconds, s.wait_seconds,
+            s.busy_seconds > 0 ? s.jobs / s.busy_seconds : 0.0,
+            stats.wall_seconds > 0 ? 100 * s.busy_seconds / stats.wall_seconds : 0.0);
+  }
+}
+
+struct proof_pipeline_options {
+  // jobs that may wait between two stages
+  size_t queue_capacity = 2;
+  // OpenMP threads of the witness, H and multiexp stages, 0 picks a default
+  size_t witness_threads = 1;
+  size_t h_threads = 0;
+  size_t multiexp_threads = 0;
+};
+
+// Fills in the witness of job i. Returning false ends the stream.
+typedef std::function<bool(size_t, prover_witness&)> pipeline_witness_source;
+// Receives the proof of job i, in job order.
+typedef std::function<void(size_t, const prover_witness&, const libsnark::r1cs_ppzksnark_proof<prover_pp>&)> pipeline_proof_sink;
+
+class proof_pipeline {
+public:
+  proof_pipeline(const proving_key_view &pk, const proof_pipeline_options &options = proof_pipeline_options())
+    : pk(pk), options(options) {}
+
+  // Runs until the source is exhausted and every proof has been exported.
+  // An exception in any stage stops the pipeline and is rethrown here.
+  pipeline_stats run(const pipeline_witness_source &source, const pipeline_proof_sink &sink)
+  {
+    typedef std::chrono::steady_clock clock;
+
+    const size_t all_threads = proverThreads();
+    const size_t h_threads = options.h_threads != 0 ? options.h_threads : std::max<size_t>(1, all_threads / 4);
+    const size_t multiexp_threads = options.multiexp_threads != 0 ? options.multiexp_threads : all_threads;
+    const size_t witness_threads = std::max<size_t>(1, options.witness_threads);
+
+    bounded_queue<std::unique_ptr<job>> witnesses(options.queue_capacity);
+    bounded_queue<std::unique_ptr<job>> qap_witnesses(options.queue_capacity);
+    bounded_queue<std::unique_ptr<job>> proofs(options.queue_capacity);
+
+    pipeline_stats stats;
+    stats.stages.resize(4);
+    stats.stages[0].name = "witness";
+    stats.stages[1].name = "h";
+    stats.stages[2].name = "multiexp";
+    stats.stages[3].name = "export";
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto stop = [&]() {
+      {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+      witnesses.close();
+      qap_witnesses.close();
+      proofs.close();
+    };
+
+    // one stage: pops from in (or produces when in is null), works, pushes to
+    // out (or consumes when out is null), and closes out when done
+    auto stage = [&](pipeline_stage_stats &s, size_t omp_threads,
+                     bounded_queue<std::unique_ptr<job>>* in, bounded_queue<std::unique_ptr<job>>* out,
+                     const std::function<bool(std::unique_ptr<job>&)> &work) {
+#ifdef MULTICORE
+      omp_set_num_threads(omp_threads);
+#else
+      (void) omp_threads;
+#endif
+      try {
+        for (;;) {
+          std::unique_ptr<job> j;
+          clock::time_point t0 = clock::now();
+          if (in != nullptr && !in->pop(j)) {
+            s.wait_seconds += std::chrono::duration<double>(clock::now() - t0).count();
+            break;
+          }
+          clock::time_point t1 = clock::now();
+          s.wait_seconds += std::chrono::duration<double>(t1 - t0).count();
+          if (!work(j)) {
+            break;
+          }
+          clock::time_point t2 = clock::now();
+          s.busy_seconds += std::chrono::duration<double>(t2 - t1).count();
+          ++s.jobs;
+          if (out != nullptr) {
+            const bool pushed = out->push(std::move(j));
+            s.wait_seconds += std::chrono::duration<double>(clock::now() - t2).count();
+            if (!pushed) {
+              break;
+            }
+          }
+        }
+      } catch (...) {
+        stop();
+      }
+      if (out != nullptr) {
+        out->close();
+      }
+    };
+
+    const clock::time_point start = clock::now();
+    size_t next_index = 0;
+
+    std::vector<std::thread> threads;
+    threads.emplace_back(stage, std::ref(stats.stages[0]), witness_threads, nullptr, &witnesses,
+                         [&](std::unique_ptr<job> &j) {
+                           j.reset(new job);
+                           j->index = next_index;
+                           trace_span span("pipeline/witness");
+                           if (!source(j->index, j->witness)) {
+                             return false;
+                           }
+                           ++next_index;
+                           return true;
+                         });
+    threads.emplace_back(stage, std::ref(stats.stages[1]), h_threads, &witnesses, &qap_witnesses,
+                         [&](std::unique_ptr<job> &j) {
+                           trace_span span("pipeline/h");
+                           j->qap_wit.reset(new libsnark::qap_witness<libff::alt_bn128_Fr>(
+                             qapWitnessForProof(pk, j->witness.primary_input, j->witness.auxiliary_input)));
+                           // the QAP witness holds everything the multiexps need
+                           j->witness.auxiliary_input.clear();
+                           j->witness.auxiliary_input.shrink_to_fit();
+                           return true;
+                         });
+    threads.emplace_back(stage, std::ref(stats.stages[2]), multiexp_threads, &qap_witnesses, &proofs,
+                         [&](std::unique_ptr<job> &j) {
+                           trace_span span("pipeline/multiexp");
+                           j->proof = proofFromQapWitness(pk, *j->qap_wit, scratch);
+                           j->qap_wit.reset();
+                           return true;
+                         });
+    threads.emplace_back(stage, std::ref(stats.stages[3]), 1, &proofs, nullptr,
+                         [&](std::unique_ptr<job> &j) {
+                           trace_span span("pipeline/export");
+                           sink(j->index, j->witness, j->proof);
+                           return true;
+                         });
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+
+    stats.wall_seconds = std::chrono::duration<double>(clock::now() - start).count();
+    stats.proofs = stats.stages[3].jobs;
+
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return stats;
+  }
+
+private:
+  struct job {
+    size_t index = 0;
+    prover_witness witness;
+    // qap_witness has no default constructor
+    std::unique_ptr<libsnark::qap_witness<libff::alt_bn128_Fr>> qap_wit;
+    libsnark::r1cs_ppzksnark_proof<prover_pp> proof;
+  };
+
+  const proving_key_view pk;
+  const proof_pipeline_options options;
+  // only touched by the multiexp stage
+  prover_scratch scratch;
+};
+
+#endif // ZOKRATES_PROOF_PIPELINE_HPP_
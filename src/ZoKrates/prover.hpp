@@ -0,0 +1,272 @@
+/**
+ * @file prover.hpp
+ *
+ * r1cs_ppzksnark prover that reads the proving key through a view of raw
+ * arrays instead of the std::vector members of r1cs_ppzksnark_proving_key.
+ * The view can point into an in-memory key or into a memory mapped binary
+ * key file (see pk_binary.hpp), so a mapped key is used in place.
+ *
+ * The computation mirrors r1cs_ppzksnark_prover and produces the same proof
+ * for the same randomness.
+ */
+
+#ifndef ZOKRATES_PROVER_HPP_
+#define ZOKRATES_PROVER_HPP_
+
+#include <algorithm>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
+
+#include "flat_r1cs.hpp"
+#include "multiexp.hpp"
+#include "trace.hpp"
+
+typedef libff::alt_bn128_pp prover_pp;
+
+// sparse knowledge commitment query: values[i] belongs to index indices[i]
+template<typename T1, typename T2>
+struct kc_query_view {
+  size_t domain_size;
+  size_t size;
+  const size_t* indices;
+  const libsnark::knowledge_commitment<T1, T2>* values;
+};
+
+template<typename T>
+struct query_view {
+  size_t size;
+  const T* values;
+};
+
+// optional fixed-base tables for the query bases, see pk_tables.hpp. The kc
+// query tables are indexed by position in the values array.
+struct proving_key_tables {
+  fixed_base_table<libff::alt_bn128_G1> A_g, A_h;
+  fixed_base_table<libff::alt_bn128_G2> B_g;
+  fixed_base_table<libff::alt_bn128_G1> B_h;
+  fixed_base_table<libff::alt_bn128_G1> C_g, C_h;
+  fixed_base_table<libff::alt_bn128_G1> H;
+  fixed_base_table<libff::alt_bn128_G1> K;
+};
+
+struct proving_key_view {
+  kc_query_view<libff::alt_bn128_G1, libff::alt_bn128_G1> A_query;
+  kc_query_view<libff::alt_bn128_G2, libff::alt_bn128_G1> B_query;
+  kc_query_view<libff::alt_bn128_G1, libff::alt_bn128_G1> C_query;
+  query_view<libff::alt_bn128_G1> H_query;
+  query_view<libff::alt_bn128_G1> K_query;
+  // null for binary keys, which only keep flat_constraints
+  const libsnark::r1cs_ppzksnark_constraint_system<prover_pp>* constraint_system = nullptr;
+  // null unless tables were loaded for the key
+  const proving_key_tables* tables = nullptr;
+  // the constraints in flat form, used for the QAP witness when set
+  const flat_r1cs_view* flat_constraints = nullptr;
+  // evaluation domain of flat_constraints, built per proof when null
+  const qap_domain* domain = nullptr;
+
+  size_t num_inputs() const { return flat_constraints ? flat_constraints->num_inputs() : constraint_system->num_inputs(); }
+  size_t num_variables() const { return flat_constraints ? flat_constraints->num_variables() : constraint_system->num_variables(); }
+};
+
+template<typename T1, typename T2>
+kc_query_view<T1, T2> viewOfQuery(const libsnark::knowledge_commitment_vector<T1, T2> &q)
+{
+  kc_query_view<T1, T2> v;
+  v.domain_size = q.domain_size();
+  v.size = q.values.size();
+  v.indices = q.indices.data();
+  v.values = q.values.data();
+  return v;
+}
+
+template<typename T>
+query_view<T> viewOfQuery(const std::vector<T> &q)
+{
+  query_view<T> v;
+  v.size = q.size();
+  v.values = q.data();
+  return v;
+}
+
+// the view borrows from pk, which has to outlive it
+inline proving_key_view viewOfProvingKey(const libsnark::r1cs_ppzksnark_proving_key<prover_pp> &pk)
+{
+  proving_key_view v;
+  v.A_query = viewOfQuery(pk.A_query);
+  v.B_query = viewOfQuery(pk.B_query);
+  v.C_query = viewOfQuery(pk.C_query);
+  v.H_query = viewOfQuery(pk.H_query);
+  v.K_query = viewOfQuery(pk.K_query);
+  v.constraint_system = &pk.constraint_system;
+  return v;
+}
+
+// entry for index idx, zero if the sparse query has none
+template<typename T1, typename T2>
+libsnark::knowledge_commitment<T1, T2> kcQueryAt(const kc_query_view<T1, T2> &q, size_t idx)
+{
+  const size_t* it = std::lower_bound(q.indices, q.indices + q.size, idx);
+  if (it == q.indices + q.size || *it != idx) {
+    return libsnark::knowledge_commitment<T1, T2>::zero();
+  }
+  return q.values[it - q.indices];
+}
+
+// Buffers reused from one proof to the next. A prover thread keeps its own
+// instance, the proving key itself is only read.
+struct prover_scratch {
+  std::vector<multiexp_scalar> scalars;
+};
+
+// sum over the query entries with min_idx <= index < max_idx of
+// coeffs[index - min_idx] * entry, like kc_multi_exp_with_mixed_addition
+template<typename T1, typename T2>
+libsnark::knowledge_commitment<T1, T2> kcMultiExp(const kc_query_view<T1, T2> &q, size_t min_idx, size_t max_idx, const std::vector<libff::alt_bn128_Fr> &coeffs, std::vector<multiexp_scalar> &scalars,
+                                                  const fixed_base_table<T1>* g_table = nullptr, const fixed_base_table<T2>* h_table = nullptr)
+{
+  const size_t lo = std::lower_bound(q.indices, q.indices + q.size, min_idx) - q.indices;
+  const size_t hi = std::lower_bound(q.indices, q.indices + q.size, max_idx) - q.indices;
+  if (lo == hi) {
+    return libsnark::knowledge_commitment<T1, T2>::zero();
+  }
+
+  scalars.clear();
+  scalars.reserve(hi - lo);
+  for (size_t i = lo; i < hi; ++i) {
+    scalars.emplace_back(coeffs[q.indices[i] - min_idx].as_bigint());
+  }
+
+  const size_t stride = sizeof(libsnark::knowledge_commitment<T1, T2>);
+  return libsnark::knowledge_commitment<T1, T2>(
+    g_table ? multiExpWithTable(*g_table, lo, scalars) : multiExpPippenger(strided_points<T1>(&q.values[lo].g, stride, hi - lo), scalars),
+    h_table ? multiExpWithTable(*h_table, lo, scalars) : multiExpPippenger(strided_points<T2>(&q.values[lo].h, stride, hi - lo), scalars));
+}
+
+// sum_{i < n} coeffs[i] * q[first + i]
+template<typename T>
+T queryMultiExp(const query_view<T> &q, size_t first, const libff::alt_bn128_Fr* coeffs, size_t n, std::vector<multiexp_scalar> &scalars,
+                const fixed_base_table<T>* table = nullptr)
+{
+  assert(first + n <= q.size);
+  scalarsFromField(coeffs, n, scalars);
+  if (table) {
+    return multiExpWithTable(*table, first, scalars);
+  }
+  return multiExpPippenger(strided_points<T>(q.values + first, sizeof(T), n), scalars);
+}
+
+// First half of the prover: draws the zero knowledge randomness d1, d2, d3
+// and computes the QAP witness, i.e. the coefficients of H (the FFTs).
+inline libsnark::qap_witness<libff::alt_bn128_Fr> qapWitnessForProof(const proving_key_view &pk,
+                                                                     const libsnark::r1cs_ppzksnark_primary_input<prover_pp> &primary_input,
+                                                                     const libsnark::r1cs_ppzksnark_auxiliary_input<prover_pp> &auxiliary_input)
+{
+  typedef libff::alt_bn128_Fr Fr;
+
+  const Fr d1 = Fr::random_element(),
+    d2 = Fr::random_element(),
+    d3 = Fr::random_element();
+
+  trace_span span("prove/qap_witness_map");
+  libff::enter_block("Compute the polynomial H");
+  libsnark::qap_witness<Fr> qap_wit = !pk.flat_constraints ?
+    libsnark::r1cs_to_qap_witness_map(*pk.constraint_system, primary_input, auxiliary_input, d1, d2, d3) :
+    pk.domain ?
+    flatQapWitnessMap(*pk.flat_constraints, *pk.domain, primary_input, auxiliary_input, d1, d2, d3) :
+    flatQapWitnessMap(*pk.flat_constraints, primary_input, auxiliary_input, d1, d2, d3);
+  libff::leave_block("Compute the polynomial H");
+  return qap_wit;
+}
+
+// Second half of the prover: the multi-exponentiations over the key.
+inline libsnark::r1cs_ppzksnark_proof<prover_pp> proofFromQapWitness(const proving_key_view &pk,
+                                                                     const libsnark::qap_witness<libff::alt_bn128_Fr> &qap_wit,
+                                                                     prover_scratch &scratch)
+{
+  typedef libff::alt_bn128_G1 G1;
+  typedef libff::alt_bn128_G2 G2;
+
+  const size_t n = qap_wit.num_variables();
+  assert(pk.A_query.domain_size == n + 2);
+  assert(pk.B_query.domain_size == n + 2);
+  assert(pk.C_query.domain_size == n + 2);
+  assert(pk.H_query.size == qap_wit.degree() + 1);
+  assert(pk.K_query.size == n + 4);
+
+  libsnark::knowledge_commitment<G1, G1> g_A = kcQueryAt(pk.A_query, 0) + qap_wit.d1 * kcQueryAt(pk.A_query, n + 1);
+  libsnark::knowledge_commitment<G2, G1> g_B = kcQueryAt(pk.B_query, 0) + qap_wit.d2 * kcQueryAt(pk.B_query, n + 1);
+  libsnark::knowledge_commitment<G1, G1> g_C = kcQueryAt(pk.C_query, 0) + qap_wit.d3 * kcQueryAt(pk.C_query, n + 1);
+
+  G1 g_H = G1::zero();
+  G1 g_K = (pk.K_query.values[0] +
+            qap_wit.d1 * pk.K_query.values[n + 1] +
+            qap_wit.d2 * pk.K_query.values[n + 2] +
+            qap_wit.d3 * pk.K_query.values[n + 3]);
+
+  const proving_key_tables* t = pk.tables;
+
+  libff::enter_block("Compute the proof");
+
+  libff::enter_block("Compute answer to A-query", false);
+  {
+    trace_span span("prove/multiexp_A");
+    g_A = g_A + kcMultiExp(pk.A_query, 1, 1 + n, qap_wit.coefficients_for_ABCs, scratch.scalars, t ? &t->A_g : nullptr, t ? &t->A_h : nullptr);
+  }
+  libff::leave_block("Compute answer to A-query", false);
+
+  libff::enter_block("Compute answer to B-query", false);
+  {
+    trace_span span("prove/multiexp_B");
+    g_B = g_B + kcMultiExp(pk.B_query, 1, 1 + n, qap_wit.coefficients_for_ABCs, scratch.scalars, t ? &t->B_g : nullptr, t ? &t->B_h : nullptr);
+  }
+  libff::leave_block("Compute answer to B-query", false);
+
+  libff::enter_block("Compute answer to C-query", false);
+  {
+    trace_span span("prove/multiexp_C");
+    g_C = g_C + kcMultiExp(pk.C_query, 1, 1 + n, qap_wit.coefficients_for_ABCs, scratch.scalars, t ? &t->C_g : nullptr, t ? &t->C_h : nullptr);
+  }
+  libff::leave_block("Compute answer to C-query", false);
+
+  libff::enter_block("Compute answer to H-query", false);
+  {
+    trace_span span("prove/multiexp_H");
+    g_H = g_H + queryMultiExp(pk.H_query, 0, qap_wit.coefficients_for_H.data(), qap_wit.degree() + 1, scratch.scalars, t ? &t->H : nullptr);
+  }
+  libff::leave_block("Compute answer to H-query", false);
+
+  libff::enter_block("Compute answer to K-query", false);
+  {
+    trace_span span("prove/multiexp_K");
+    g_K = g_K + queryMultiExp(pk.K_query, 1, qap_wit.coefficients_for_ABCs.data(), n, scratch.scalars, t ? &t->K : nullptr);
+  }
+  libff::leave_block("Compute answer to K-query", false);
+
+  libff::leave_block("Compute the proof");
+
+  return libsnark::r1cs_ppzksnark_proof<prover_pp>(std::move(g_A), std::move(g_B), std::move(g_C), std::move(g_H), std::move(g_K));
+}
+
+inline libsnark::r1cs_ppzksnark_proof<prover_pp> proveWithKeyView(const proving_key_view &pk,
+                                                                  const libsnark::r1cs_ppzksnark_primary_input<prover_pp> &primary_input,
+                                                                  const libsnark::r1cs_ppzksnark_auxiliary_input<prover_pp> &auxiliary_input,
+                                                                  prover_scratch &scratch)
+{
+  trace_span prove_span("prove");
+  libff::enter_block("Call to proveWithKeyView");
+  const libsnark::qap_witness<libff::alt_bn128_Fr> qap_wit = qapWitnessForProof(pk, primary_input, auxiliary_input);
+  libsnark::r1cs_ppzksnark_proof<prover_pp> proof = proofFromQapWitness(pk, qap_wit, scratch);
+  libff::leave_block("Call to proveWithKeyView");
+  return proof;
+}
+
+inline libsnark::r1cs_ppzksnark_proof<prover_pp> proveWithKeyView(const proving_key_view &pk,
+                                                                  const libsnark::r1cs_ppzksnark_primary_input<prover_pp> &primary_input,
+                                                                  const libsnark::r1cs_ppzksnark_auxiliary_input<prover_pp> &auxiliary_input)
+{
+  prover_scratch scratch;
+  return proveWithKeyView(pk, primary_input, auxiliary_input, scratch);
+}
+
+#endif // ZOKRATES_PROVER_HPP_
@@ -0,0 +1,280 @@
+/**
+ * @file qap_domain.hpp
+ *
+ * Evaluation domain of a circuit's QAP, built once per proving key and
+ * shared read-only by all proofs and prover threads.
+ *
+ * libfqfft recomputes the twiddle factors inside every FFT, one extra
+ * multiplication per butterfly, and multiplies by the coset powers in a
+ * serial loop. For basic radix-2 domains qap_domain keeps the m/2 powers of
+ * omega in a table and runs an iterative radix-2 FFT over it: the stages that
+ * fit into fft_block_size elements block by block, so that a block stays in
+ * cache across them, the remaining ones over the whole vector, both in
+ * parallel. Coset multiplications are split into chunks that each start from
+ * their own power of g. All multiplications go through fieldMul (see
+ * field_kernels.hpp).
+ *
+ * Which domain a size gets is still decided by get_evaluation_domain, so
+ * proofs match the proving key. The step and extended radix-2 domains it
+ * picks for some sizes that are not a power of two, and the arithmetic and
+ * geometric ones, run libfqfft's kernels.
+ *
+ * Not covered: only proving key handles of binary keys keep a qap_domain;
+ * with text keys every proof still builds libfqfft's domain.
+ * <pk_path>.domain is only written by _precompute_proving_key, not by the
+ * setup functions or on load. Keygen still builds its domain inside
+ * libsnark's generator, and the ppzksnark verifier has no domain work.
+ */
+
+#ifndef ZOKRATES_QAP_DOMAIN_HPP_
+#define ZOKRATES_QAP_DOMAIN_HPP_
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+#include <libfqfft/evaluation_domain/domains/basic_radix2_domain.hpp>
+#include <libfqfft/evaluation_domain/get_evaluation_domain.hpp>
+
+#include "field_kernels.hpp"
+
+// 4096 elements of 32 bytes, half of a typical L2
+const size_t fft_block_size = size_t(1) << 12;
+const size_t fft_coset_chunk = size_t(1) << 14;
+
+class qap_domain {
+public:
+  typedef libff::alt_bn128_Fr Fr;
+
+  // the domain get_evaluation_domain(min_size) returns, with its twiddle
+  // table computed when it is a basic radix-2 domain
+  explicit qap_domain(size_t min_size) : domain(libfqfft::get_evaluation_domain<Fr>(min_size)), m(domain->m)
+  {
+    init();
+    if (radix2) {
+      owned_twiddles.resize(m / 2);
+      computeTwiddles(owned_twiddles.data());
+      twiddles = owned_twiddles.data();
+    }
+  }
+
+  // the same with a table computed earlier (see pk_domain.hpp); it has to
+  // hold m / 2 elements and outlive the domain
+  qap_domain(size_t min_size, const Fr* table, size_t table_size) : domain(libfqfft::get_evaluation_domain<Fr>(min_size)), m(domain->m)
+  {
+    init();
+    if (!radix2 || table_size != m / 2 || table[0] != Fr::one() || (m > 2 && table[1] != omega)) {
+      throw std::runtime_error("qap domain: twiddle table does not match the domain");
+    }
+    twiddles = table;
+  }
+
+  qap_domain(const qap_domain&) = delete;
+  qap_domain& operator=(const qap_domain&) = delete;
+
+  // the m / 2 powers of omega, for writing them to a file
+  static void computeTwiddles(size_t m, const Fr &omega, Fr* out)
+  {
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static)
+#endif
+    for (size_t start = 0; start < m / 2; start += fft_coset_chunk) {
+      Fr w = omega ^ start;
+      for (size_t i = start; i < std::min(m / 2, start + fft_coset_chunk); ++i) {
+        out[i] = w;
+        w = fieldMul(w, omega);
+      }
+    }
+  }
+
+  bool hasTwiddleTable() const { return radix2; }
+  const Fr* twiddleTable() const { return twiddles; }
+  const Fr& rootOfUnity() const { return omega; }
+
+  void FFT(std::vector<Fr> &a) const
+  {
+    checkSize(a);
+    if (!radix2) {
+      domain->FFT(a);
+      return;
+    }
+    radix2FFT(a);
+  }
+
+  void iFFT(std::vector<Fr> &a) const
+  {
+    checkSize(a);
+    if (!radix2) {
+      domain->iFFT(a);
+      return;
+    }
+    // FFT with omega^-1 is the FFT with omega, read backwards from index 1
+    radix2FFT(a);
+    std::reverse(a.begin() + 1, a.end());
+    multiplyByPowers(a, Fr::one(), m_inverse);
+  }
+
+  void cosetFFT(std::vector<Fr> &a, const Fr &g) const
+  {
+    checkSize(a);
+    if (!radix2) {
+      domain->cosetFFT(a, g);
+      return;
+    }
+    multiplyByPowers(a, g, Fr::one());
+    radix2FFT(a);
+  }
+
+  void icosetFFT(std::vector<Fr> &a, const Fr &g) const
+  {
+    checkSize(a);
+    if (!radix2) {
+      domain->icosetFFT(a, g);
+      return;
+    }
+    radix2FFT(a);
+    std::reverse(a.begin() + 1, a.end());
+    // the 1/m of the inverse FFT folded into the coset multiplication
+    multiplyByPowers(a, g.inverse(), m_inverse);
+  }
+
+  // H += coeff * Z, H has m + 1 coefficients
+  void add_poly_Z(const Fr &coeff, std::vector<Fr> &H) const
+  {
+    if (!radix2) {
+      domain->add_poly_Z(coeff, H);
+      return;
+    }
+    // Z = X^m - 1
+    H[m] += coeff;
+    H[0] -= coeff;
+  }
+
+  // P /= Z on the coset of the multiplicative generator
+  void divide_by_Z_on_coset(std::vector<Fr> &P) const
+  {
+    if (!radix2) {
+      domain->divide_by_Z_on_coset(P);
+      return;
+    }
+    // Z(g * omega^i) = g^m - 1 for every i
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+    for (size_t i = 0; i < m; ++i) {
+      P[i] = fieldMul(P[i], Z_inverse_at_coset);
+    }
+  }
+
+private:
+  void init()
+  {
+    const libfqfft::basic_radix2_domain<Fr>* basic = dynamic_cast<const libfqfft::basic_radix2_domain<Fr>*>(domain.get());
+    radix2 = basic != nullptr;
+    if (radix2) {
+      omega = basic->omega;
+      log_m = libff::log2(m);
+      m_inverse = Fr(long(m)).inverse();
+      Z_inverse_at_coset = ((Fr::multiplicative_generator ^ m) - Fr::one()).inverse();
+    }
+  }
+
+  void computeTwiddles(Fr* out) const { computeTwiddles(m, omega, out); }
+
+  void checkSize(const std::vector<Fr> &a) const
+  {
+    if (a.size() != m) {
+      throw std::invalid_argument("qap domain: vector does not have the domain's size");
+    }
+  }
+
+  // a[i] *= c * g^i
+  void multiplyByPowers(std::vector<Fr> &a, const Fr &g, const Fr &c) const
+  {
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static)
+#endif
+    for (size_t start = 0; start < m; start += fft_coset_chunk) {
+      Fr u = c * (g ^ start);
+      for (size_t i = start; i < std::min(m, start + fft_coset_chunk); ++i) {
+        a[i] = fieldMul(a[i], u);
+        u = fieldMul(u, g);
+      }
+    }
+  }
+
+  // the butterflies of the stage combining halves of len elements, on a
+  // block of block_len elements starting at a; the twiddle for position j is
+  // omega^(j * m / (2 len))
+  void radix2Stage(Fr* a, size_t block_len, size_t len) const
+  {
+    const size_t stride = m / (2 * len);
+    for (size_t i = 0; i < block_len; i += 2 * len) {
+      for (size_t j = 0; j < len; ++j) {
+        const Fr t = fieldMul(twiddles[j * stride], a[i + j + len]);
+        a[i + j + len] = a[i + j] - t;
+        a[i + j] += t;
+      }
+    }
+  }
+
+  // in place, natural order in and out: a_k = sum_j a_j omega^(j k)
+  void radix2FFT(std::vector<Fr> &a) const
+  {
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+    for (size_t i = 0; i < m; ++i) {
+      const size_t r = libff::bitreverse(i, log_m);
+      if (i < r) {
+        std::swap(a[i], a[r]);
+      }
+    }
+
+    const size_t block = std::min(m, fft_block_size);
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static)
+#endif
+    for (size_t start = 0; start < m; start += block) {
+      for (size_t len = 1; len < block; len *= 2) {
+        radix2Stage(a.data() + start, block, len);
+      }
+    }
+
+    for (size_t len = block; len < m; len *= 2) {
+      const size_t stride = m / (2 * len);
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static)
+#endif
+      for (size_t k = 0; k < m / 2; ++k) {
+        const size_t j = k & (len - 1);
+        const size_t i = 2 * (k - j) + j;
+        const Fr t = fieldMul(twiddles[j * stride], a[i + len]);
+        a[i + len] = a[i] - t;
+        a[i] += t;
+      }
+    }
+  }
+
+  std::shared_ptr<libfqfft::evaluation_domain<Fr>> domain;
+  bool radix2 = false;
+  size_t log_m = 0;
+  Fr omega;
+  Fr m_inverse;
+  Fr Z_inverse_at_coset;
+  std::vector<Fr> owned_twiddles;
+  const Fr* twiddles = nullptr;
+
+public:
+  const size_t m;
+};
+
+// the size flatQapWitnessMap and r1cs_to_qap_witness_map ask the domain for
+inline size_t qapDomainMinSize(size_t num_constraints, size_t num_inputs)
+{
+  return num_constraints + num_inputs + 1;
+}
+
+#endif // ZOKRATES_QAP_DOMAIN_HPP_
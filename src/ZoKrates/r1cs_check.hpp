@@ -0,0 +1,226 @@
+/**
+ * @file r1cs_check.hpp
+ *
+ * Satisfiability check of a witness against a constraint system, meant as a
+ * cheap gate before proving.
+ *
+ * Unlike r1cs_constraint_system::is_satisfied, which is what
+ * protoboard::is_satisfied and the asserts around it use, the check runs on
+ * several threads, is not compiled out under NDEBUG and reports which
+ * constraints fail: their index, annotation (DEBUG builds) and the values of
+ * A.s, B.s and C.s. Constraints are handed out in chunks, and all workers
+ * stop once max_failures failing constraints have been found. The flat
+ * constraint systems of binary proving keys are checked in place.
+ */
+
+#ifndef ZOKRATES_R1CS_CHECK_HPP_
+#define ZOKRATES_R1CS_CHECK_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+#include <libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp>
+
+#include "flat_r1cs.hpp"
+#include "threads.hpp"
+
+const size_t r1cs_check_chunk_size = 4096;
+
+template<typename FieldT>
+struct r1cs_constraint_failure {
+  size_t index;
+  std::string annotation;
+  FieldT a_value;
+  FieldT b_value;
+  FieldT c_value;
+};
+
+template<typename FieldT>
+struct r1cs_check_result {
+  bool satisfied = false;
+  // set when the witness does not even have the right shape
+  std::string error;
+  // failing constraints sorted by index, at most max_failures. With several
+  // threads these are not necessarily the lowest failing indices.
+  std::vector<r1cs_constraint_failure<FieldT>> failures;
+};
+
+// The work of checkR1csSatisfied on rows 0 .. num_constraints - 1:
+// evaluate(i, a, b, c) sets A.s, B.s and C.s of row i, annotate(i, failure)
+// fills in the annotation of a failing one.
+template<typename FieldT, typename Evaluate, typename Annotate>
+void checkR1csRows(size_t num_constraints, Evaluate evaluate, Annotate annotate, size_t num_threads, size_t max_failures,
+                   r1cs_check_result<FieldT> &result)
+{
+  max_failures = std::max<size_t>(1, max_failures);
+
+  const size_t num_chunks = (num_constraints + r1cs_check_chunk_size - 1) / r1cs_check_chunk_size;
+  if (num_threads == 0) {
+    num_threads = proverThreads();
+  }
+  num_threads = std::max<size_t>(1, std::min(num_threads, num_chunks));
+
+  std::atomic<size_t> next_chunk(0);
+  std::atomic<bool> stop(false);
+  std::mutex failures_mutex;
+
+  auto worker = [&]() {
+    for (size_t chunk = next_chunk++; chunk < num_chunks && !stop; chunk = next_chunk++) {
+      const size_t begin = chunk * r1cs_check_chunk_size;
+      const size_t end = std::min(num_constraints, begin + r1cs_check_chunk_size);
+      for (size_t i = begin; i < end && !stop; ++i) {
+        FieldT a, b, c;
+        evaluate(i, a, b, c);
+        if (a * b == c) {
+          continue;
+        }
+
+        r1cs_constraint_failure<FieldT> failure;
+        failure.index = i;
+        annotate(i, failure);
+        failure.a_value = a;
+        failure.b_value = b;
+        failure.c_value = c;
+
+        std::lock_guard<std::mutex> lock(failures_mutex);
+        result.failures.emplace_back(std::move(failure));
+        if (result.failures.size() >= max_failures) {
+          stop = true;
+        }
+      }
+    }
+  };
+
+  if (num_threads == 1) {
+    worker();
+  } else {
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < num_threads; ++t) {
+      pool.emplace_back(worker);
+    }
+    for (std::thread &thread : pool) {
+      thread.join();
+    }
+  }
+
+  std::sort(result.failures.begin(), result.failures.end(),
+            [](const r1cs_constraint_failure<FieldT> &x, const r1cs_constraint_failure<FieldT> &y) { return x.index < y.index; });
+  result.satisfied = result.failures.empty();
+}
+
+// false with result.error set if the witness has the wrong number of values
+template<typename FieldT>
+bool checkWitnessShape(size_t num_inputs, size_t num_variables, const libsnark::r1cs_primary_input<FieldT> &primary_input,
+                       const libsnark::r1cs_auxiliary_input<FieldT> &auxiliary_input, r1cs_check_result<FieldT> &result)
+{
+  if (primary_input.size() != num_inputs) {
+    result.error = "expected " + std::to_string(num_inputs) + " primary inputs, got " + std::to_string(primary_input.size());
+    return false;
+  }
+  if (primary_input.size() + auxiliary_input.size() != num_variables) {
+    result.error = "expected " + std::to_string(num_variables) + " variables, got " + std::to_string(primary_input.size() + auxiliary_input.size());
+    return false;
+  }
+  return true;
+}
+
+template<typename FieldT>
+r1cs_check_result<FieldT> checkR1csSatisfied(const libsnark::r1cs_constraint_system<FieldT> &cs,
+                                             const libsnark::r1cs_primary_input<FieldT> &primary_input,
+                                             const libsnark::r1cs_auxiliary_input<FieldT> &auxiliary_input,
+                                             size_t num_threads = 0,
+                                             size_t max_failures = 16)
+{
+  r1cs_check_result<FieldT> result;
+  if (!checkWitnessShape(cs.num_inputs(), cs.num_variables(), primary_input, auxiliary_input, result)) {
+    return result;
+  }
+
+  libsnark::r1cs_variable_assignment<FieldT> full_variable_assignment = primary_input;
+  full_variable_assignment.insert(full_variable_assignment.end(), auxiliary_input.begin(), auxiliary_input.end());
+
+  checkR1csRows<FieldT>(
+    cs.num_constraints(),
+    [&](size_t i, FieldT &a, FieldT &b, FieldT &c) {
+      const libsnark::r1cs_constraint<FieldT> &constraint = cs.constraints[i];
+      a = constraint.a.evaluate(full_variable_assignment);
+      b = constraint.b.evaluate(full_variable_assignment);
+      c = constraint.c.evaluate(full_variable_assignment);
+    },
+    [&](size_t i, r1cs_constraint_failure<FieldT> &failure) {
+#ifdef DEBUG
+      auto it = cs.constraint_annotations.find(i);
+      if (it != cs.constraint_annotations.end()) {
+        failure.annotation = it->second;
+      }
+#else
+      (void) i;
+      (void) failure;
+#endif
+    },
+    num_threads, max_failures, result);
+  return result;
+}
+
+// the same for a flat constraint system, which carries no annotations
+inline r1cs_check_result<libff::alt_bn128_Fr> checkR1csSatisfied(const flat_r1cs_view &flat,
+                                                                 const libsnark::r1cs_primary_input<libff::alt_bn128_Fr> &primary_input,
+                                                                 const libsnark::r1cs_auxiliary_input<libff::alt_bn128_Fr> &auxiliary_input,
+                                                                 size_t num_threads = 0,
+                                                                 size_t max_failures = 16)
+{
+  typedef libff::alt_bn128_Fr Fr;
+
+  r1cs_check_result<Fr> result;
+  if (!checkWitnessShape(flat.num_inputs(), flat.num_variables(), primary_input, auxiliary_input, result)) {
+    return result;
+  }
+
+  std::vector<Fr> full_assignment;
+  full_assignment.reserve(1 + flat.num_variables());
+  full_assignment.push_back(Fr::one());
+  full_assignment.insert(full_assignment.end(), primary_input.begin(), primary_input.end());
+  full_assignment.insert(full_assignment.end(), auxiliary_input.begin(), auxiliary_input.end());
+
+  checkR1csRows<Fr>(
+    flat.num_constraints,
+    [&](size_t i, Fr &a, Fr &b, Fr &c) {
+      a = flat.matrices[0].evaluate(i, full_assignment.data());
+      b = flat.matrices[1].evaluate(i, full_assignment.data());
+      c = flat.matrices[2].evaluate(i, full_assignment.data());
+    },
+    [](size_t, r1cs_constraint_failure<Fr>&) {},
+    num_threads, max_failures, result);
+  return result;
+}
+
+template<typename FieldT>
+void printR1csCheckResult(const r1cs_check_result<FieldT> &result, std::ostream &out)
+{
+  if (!result.error.empty()) {
+    out << "witness rejected: " << result.error << std::endl;
+    return;
+  }
+  if (result.satisfied) {
+    out << "witness satisfies all constraints" << std::endl;
+    return;
+  }
+  out << "witness rejected, failing constraints:" << std::endl;
+  for (const r1cs_constraint_failure<FieldT> &failure : result.failures) {
+    out << "  constraint " << failure.index;
+    if (!failure.annotation.empty()) {
+      out << " (" << failure.annotation << ")";
+    }
+    out << ": A.s = " << failure.a_value.as_bigint()
+        << ", B.s = " << failure.b_value.as_bigint()
+        << ", C.s = " << failure.c_value.as_bigint() << std::endl;
+  }
+}
+
+#endif // ZOKRATES_R1CS_CHECK_HPP_
@@ -0,0 +1,395 @@
+/**
+ * @file r1cs_json_reader.hpp
+ *
+ * Loader for the r1cs.json and tests.json files written by r1cs_json.hpp,
+ * including the multi-instance tests.json of instances_to_json.
+ *
+ * The input is parsed in one pass straight into the constraint system or
+ * assignment, without building a document tree: linear combinations are
+ * appended term by term as they are scanned, and field elements are
+ * converted from their digits 19 decimal (or 16 hex) digits per limb
+ * operation. Files are mmap'd, callers that already hold the bytes can use
+ * the (data, len) overloads.
+ *
+ * Accepted field element syntax: decimal or 0x-prefixed hex, optionally
+ * quoted and optionally negative; values are reduced modulo the field
+ * characteristic. The number of primary inputs is read from r1cs.json's
+ * "num_inputs"; the "variables" array only names the first variables and
+ * says nothing about which of them are inputs. r1cs.json does not record the
+ * number of auxiliary variables, so unless it is passed in, it is taken from
+ * the highest variable index used by a constraint.
+ */
+
+#ifndef ZOKRATES_R1CS_JSON_READER_HPP_
+#define ZOKRATES_R1CS_JSON_READER_HPP_
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp>
+
+#include "pk_binary.hpp"
+
+// cursor over a JSON text, with just enough of a tokenizer for our files
+class json_scanner {
+public:
+  json_scanner(const char* data, size_t len) : p(data), begin(data), end(data + len) {}
+
+  void skipSpace()
+  {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+      ++p;
+    }
+  }
+
+  // skips whitespace and consumes c if it is next
+  bool accept(char c)
+  {
+    skipSpace();
+    if (p < end && *p == c) {
+      ++p;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(char c)
+  {
+    if (!accept(c)) {
+      fail(std::string("expected '") + c + "'");
+    }
+  }
+
+  // a string's contents, escapes are kept as they are
+  std::string readString()
+  {
+    expect('"');
+    const char* start = p;
+    while (p < end && *p != '"') {
+      p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+    }
+    if (p >= end) {
+      fail("unterminated string");
+    }
+    return std::string(start, p++);
+  }
+
+  // a key of the form "123"
+  size_t readIndexKey()
+  {
+    expect('"');
+    const size_t index = readDigits("expected a variable index");
+    if (p >= end || *p != '"') {
+      fail("expected a variable index");
+    }
+    ++p;
+    return index;
+  }
+
+  // an unquoted non-negative integer
+  size_t readUnsigned()
+  {
+    skipSpace();
+    return readDigits("expected an unsigned integer");
+  }
+
+  template<typename FieldT>
+  FieldT readField()
+  {
+    skipSpace();
+    const bool quoted = p < end && *p == '"';
+    if (quoted) {
+      ++p;
+    }
+    const bool negative = p < end && *p == '-';
+    if (negative) {
+      ++p;
+    }
+
+    const mp_size_t n = FieldT::num_limbs;
+    mp_limb_t x[n + 1] = { 0 };
+    const char* start = p;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+      p += 2;
+      start = p;
+      readHex(x, n + 1);
+    } else {
+      readDecimal(x, n + 1);
+    }
+    if (p == start) {
+      fail("expected a field element");
+    }
+    if (quoted && (p >= end || *p++ != '"')) {
+      fail("unterminated string");
+    }
+    if (x[n] != 0) {
+      fail("field element too large");
+    }
+    // values below 2^(64 n) need at most a few subtractions
+    while (mpn_cmp(x, FieldT::mod.data, n) >= 0) {
+      mpn_sub_n(x, x, FieldT::mod.data, n);
+    }
+
+    libff::bigint<n> b;
+    memcpy(b.data, x, sizeof(b.data));
+    const FieldT value(b);
+    return negative ? -value : value;
+  }
+
+  bool atEnd()
+  {
+    skipSpace();
+    return p >= end;
+  }
+
+  [[noreturn]] void fail(const std::string &what) const
+  {
+    throw std::runtime_error("json: " + what + " at byte " + std::to_string(p - begin));
+  }
+
+private:
+  // up to 18 decimal digits
+  size_t readDigits(const char* what)
+  {
+    size_t x = 0;
+    const char* start = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+      x = x * 10 + (*p++ - '0');
+    }
+    if (p == start || p - start > 18) {
+      fail(what);
+    }
+    return x;
+  }
+
+  // x = x * 10^19 + chunk, for every 19 digit chunk
+  void readDecimal(mp_limb_t* x, mp_size_t limbs)
+  {
+    while (p < end && *p >= '0' && *p <= '9') {
+      mp_limb_t chunk = 0, scale = 1;
+      for (int i = 0; i < 19 && p < end && *p >= '0' && *p <= '9'; ++i) {
+        chunk = chunk * 10 + (*p++ - '0');
+        scale *= 10;
+      }
+      if (mpn_mul_1(x, x, limbs, scale) != 0 || mpn_add_1(x, x, limbs, chunk) != 0) {
+        fail("field element too large");
+      }
+    }
+  }
+
+  void readHex(mp_limb_t* x, mp_size_t limbs)
+  {
+    while (p < end) {
+      const char c = *p;
+      mp_limb_t digit;
+      if (c >= '0' && c <= '9') {
+        digit = c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        digit = c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        digit = c - 'A' + 10;
+      } else {
+        break;
+      }
+      ++p;
+      if (x[limbs - 1] >> (GMP_NUMB_BITS - 4)) {
+        fail("field element too large");
+      }
+      mpn_lshift(x, x, limbs, 4);
+      x[0] |= digit;
+    }
+  }
+
+  const char* p;
+  const char* begin;
+  const char* end;
+};
+
+// {"idx":coeff,...}, appended to lc. Returns the highest index seen.
+template<typename FieldT>
+size_t linear_combination_from_json(json_scanner &in, libsnark::linear_combination<FieldT> &lc)
+{
+  size_t max_index = 0;
+  in.expect('{');
+  if (in.accept('}')) {
+    return max_index;
+  }
+  do {
+    const size_t index = in.readIndexKey();
+    in.expect(':');
+    lc.terms.emplace_back(libsnark::variable<FieldT>(index), in.readField<FieldT>());
+    max_index = std::max(max_index, index);
+  } while (in.accept(','));
+  in.expect('}');
+  return max_index;
+}
+
+// num_variables excludes ~one, 0 means the highest index used
+template<typename FieldT>
+libsnark::r1cs_constraint_system<FieldT> r1cs_from_json(const char* data, size_t len, size_t num_variables = 0)
+{
+  json_scanner in(data, len);
+  libsnark::r1cs_constraint_system<FieldT> cs;
+
+  in.expect('{');
+  size_t num_names = 0;
+  size_t num_inputs = 0;
+  size_t max_index = 0;
+  bool seen_num_inputs = false, seen_variables = false, seen_constraints = false;
+  do {
+    const std::string key = in.readString();
+    in.expect(':');
+    if (key == "num_inputs") {
+      seen_num_inputs = true;
+      num_inputs = in.readUnsigned();
+    } else if (key == "variables") {
+      in.expect('[');
+      seen_variables = true;
+      if (!in.accept(']')) {
+        do {
+          const std::string name = in.readString();
+#ifdef DEBUG
+          if (!name.empty()) {
+            cs.variable_annotations[num_names] = name;
+          }
+#else
+          (void) name;
+#endif
+          ++num_names;
+        } while (in.accept(','));
+        in.expect(']');
+      }
+    } else if (key == "constraints") {
+      in.expect('[');
+      seen_constraints = true;
+      if (!in.accept(']')) {
+        do {
+          in.expect('[');
+          cs.constraints.emplace_back();
+          libsnark::r1cs_constraint<FieldT> &constraint = cs.constraints.back();
+          max_index = std::max(max_index, linear_combination_from_json(in, constraint.a));
+          in.expect(',');
+          max_index = std::max(max_index, linear_combination_from_json(in, constraint.b));
+          in.expect(',');
+          max_index = std::max(max_index, linear_combination_from_json(in, constraint.c));
+          in.expect(']');
+        } while (in.accept(','));
+        in.expect(']');
+      }
+    } else {
+      in.fail("unexpected key \"" + key + "\"");
+    }
+  } while (in.accept(','));
+  in.expect('}');
+  if (!in.atEnd()) {
+    in.fail("trailing data");
+  }
+  if (!seen_num_inputs || !seen_variables || !seen_constraints || num_names == 0) {
+    throw std::runtime_error("json: r1cs needs \"num_inputs\", \"variables\" (starting with ~one) and \"constraints\"");
+  }
+
+  cs.primary_input_size = num_inputs;
+  if (num_variables == 0) {
+    num_variables = std::max(max_index, cs.primary_input_size);
+  }
+  if (max_index > num_variables || cs.primary_input_size > num_variables) {
+    throw std::runtime_error("json: constraints use variable " + std::to_string(max_index) +
+                             " of " + std::to_string(num_variables));
+  }
+  cs.auxiliary_input_size = num_variables - cs.primary_input_size;
+  return cs;
+}
+
+template<typename FieldT>
+libsnark::r1cs_constraint_system<FieldT> r1cs_from_json_file(const std::string &path, size_t num_variables = 0)
+{
+  const mapped_file file(path.c_str());
+  return r1cs_from_json<FieldT>(reinterpret_cast<const char*>(file.data()), file.size(), num_variables);
+}
+
+// {"TestVariables":[...]}, the full assignment without ~one
+template<typename FieldT>
+libsnark::r1cs_variable_assignment<FieldT> array_from_json(const char* data, size_t len)
+{
+  json_scanner in(data, len);
+  libsnark::r1cs_variable_assignment<FieldT> values;
+
+  in.expect('{');
+  if (in.readString() != "TestVariables") {
+    in.fail("expected \"TestVariables\"");
+  }
+  in.expect(':');
+  in.expect('[');
+  if (!in.accept(']')) {
+    do {
+      values.emplace_back(in.readField<FieldT>());
+    } while (in.accept(','));
+    in.expect(']');
+  }
+  in.expect('}');
+  if (!in.atEnd()) {
+    in.fail("trailing data");
+  }
+  return values;
+}
+
+template<typename FieldT>
+libsnark::r1cs_variable_assignment<FieldT> array_from_json_file(const std::string &path)
+{
+  const mapped_file file(path.c_str());
+  return array_from_json<FieldT>(reinterpret_cast<const char*>(file.data()), file.size());
+}
+
+// {"TestInstances":[[...],...]}, one full assignment without ~one per
+// instance, as written by instances_to_json
+template<typename FieldT>
+std::vector<libsnark::r1cs_variable_assignment<FieldT>> instances_from_json(const char* data, size_t len)
+{
+  json_scanner in(data, len);
+  std::vector<libsnark::r1cs_variable_assignment<FieldT>> instances;
+
+  in.expect('{');
+  if (in.readString() != "TestInstances") {
+    in.fail("expected \"TestInstances\"");
+  }
+  in.expect(':');
+  in.expect('[');
+  if (!in.accept(']')) {
+    do {
+      libsnark::r1cs_variable_assignment<FieldT> values;
+      if (!instances.empty()) {
+        values.reserve(instances.back().size());
+      }
+      in.expect('[');
+      if (!in.accept(']')) {
+        do {
+          values.emplace_back(in.readField<FieldT>());
+        } while (in.accept(','));
+        in.expect(']');
+      }
+      if (!instances.empty() && values.size() != instances.back().size()) {
+        in.fail("instances differ in size");
+      }
+      instances.emplace_back(std::move(values));
+    } while (in.accept(','));
+    in.expect(']');
+  }
+  in.expect('}');
+  if (!in.atEnd()) {
+    in.fail("trailing data");
+  }
+  return instances;
+}
+
+template<typename FieldT>
+std::vector<libsnark::r1cs_variable_assignment<FieldT>> instances_from_json_file(const std::string &path)
+{
+  const mapped_file file(path.c_str());
+  return instances_from_json<FieldT>(reinterpret_cast<const char*>(file.data()), file.size());
+}
+
+#endif // ZOKRATES_R1CS_JSON_READER_HPP_
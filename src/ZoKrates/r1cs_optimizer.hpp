@@ -0,0 +1,510 @@
+/**
+ * @file r1cs_optimizer.hpp
+ *
+ * Optional pass over a constraint system before key generation.
+ *
+ * 1. Linear constraints, i.e. those where A or B is a constant, are used to
+ *    substitute an auxiliary variable away: from L = 0 with L = a*B - C (or
+ *    b*A - C) and a variable v of L, v = -(L - c*v) / c is substituted into
+ *    every other constraint and the linear constraint is dropped. Only
+ *    expressions of at most max_substitution_terms terms are substituted,
+ *    so that the pass cannot blow up the number of terms.
+ * 2. Constraints that hold for every assignment (0 = 0, constant products)
+ *    and duplicates (A*B=C and B*A=C count as the same) are dropped.
+ * 3. Auxiliary variables that no remaining constraint uses are dropped and
+ *    the rest are renumbered densely. Primary inputs keep their indices, so
+ *    the public inputs stay the same. The keys are generated for the
+ *    optimized system, so its verification key is not the one the original
+ *    system would get.
+ *
+ * The resulting r1cs_witness_map turns a witness of the original system, as
+ * the gadgets produce it, into one of the optimized system. It can be stored
+ * next to the proving key (<pk_path>.wmap), in which case the prover applies
+ * it to incoming witnesses by itself.
+ *
+ * The optimized system only enforces the substituted linear constraints
+ * through the substitution: a witness that violates one of them can still
+ * reduce to a satisfying witness of the optimized system. The map therefore
+ * keeps those constraints as they are in the original system, and
+ * checkSubstituted() has to pass before a witness is reduced. Given that,
+ * the original witness satisfies the original system exactly when the
+ * reduced one satisfies the optimized system (constraints dropped as trivial
+ * or duplicate hold once the substitutions do).
+ */
+
+#ifndef ZOKRATES_R1CS_OPTIMIZER_HPP_
+#define ZOKRATES_R1CS_OPTIMIZER_HPP_
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp>
+
+#include "pk_binary.hpp"
+#include "r1cs_check.hpp"
+
+struct r1cs_optimization_report {
+  size_t constraints_before = 0;
+  size_t constraints_after = 0;
+  size_t variables_before = 0;
+  size_t variables_after = 0;
+  // by cause; a constraint or variable is only counted once
+  size_t substituted_variables = 0;
+  size_t trivial_constraints = 0;
+  size_t duplicate_constraints = 0;
+  size_t unused_variables = 0;
+};
+
+inline void printR1csOptimizationReport(const r1cs_optimization_report &report, std::ostream &out)
+{
+  out << "constraints: " << report.constraints_before << " -> " << report.constraints_after
+      << " (" << report.substituted_variables << " substituted, " << report.trivial_constraints << " trivial, "
+      << report.duplicate_constraints << " duplicate)\n";
+  out << "variables: " << report.variables_before << " -> " << report.variables_after
+      << " (" << report.substituted_variables << " substituted, " << report.unused_variables << " unused)\n";
+}
+
+// Variable i of the optimized system (1 based, ~one excluded) is variable
+// old_index[i - 1] of the original one. The first num_inputs entries are the
+// primary inputs, mapped to themselves.
+struct r1cs_witness_map {
+  size_t old_num_variables = 0;
+  size_t num_inputs = 0;
+  std::vector<size_t> old_index;
+  // the linear constraints that were substituted away, over the variables
+  // of the original system
+  libsnark::r1cs_constraint_system<libff::alt_bn128_Fr> substituted;
+
+  size_t num_variables() const { return old_index.size(); }
+
+  // a witness of the original system against the substituted constraints;
+  // failures are reported with their index in substituted
+  r1cs_check_result<libff::alt_bn128_Fr> checkSubstituted(const libsnark::r1cs_primary_input<libff::alt_bn128_Fr> &primary_input,
+                                                          const libsnark::r1cs_auxiliary_input<libff::alt_bn128_Fr> &auxiliary_input,
+                                                          size_t num_threads = 0) const
+  {
+    return checkR1csSatisfied(substituted, primary_input, auxiliary_input, num_threads);
+  }
+
+  // the auxiliary input of the optimized system for a witness of the original
+  template<typename FieldT>
+  libsnark::r1cs_auxiliary_input<FieldT> reduce(const libsnark::r1cs_primary_input<FieldT> &primary_input,
+                                                const libsnark::r1cs_auxiliary_input<FieldT> &auxiliary_input) const
+  {
+    if (primary_input.size() != num_inputs || num_inputs + auxiliary_input.size() != old_num_variables) {
+      throw std::invalid_argument("witness does not match the original constraint system");
+    }
+    libsnark::r1cs_auxiliary_input<FieldT> reduced;
+    reduced.reserve(old_index.size() - num_inputs);
+    for (size_t i = num_inputs; i < old_index.size(); ++i) {
+      reduced.push_back(auxiliary_input[old_index[i] - 1 - num_inputs]);
+    }
+    return reduced;
+  }
+};
+
+// sorted by index, merged, no zero coefficients
+template<typename FieldT>
+void normalizeLinearCombination(libsnark::linear_combination<FieldT> &lc)
+{
+  std::vector<libsnark::linear_term<FieldT>> &terms = lc.terms;
+  std::sort(terms.begin(), terms.end(), [](const libsnark::linear_term<FieldT> &x, const libsnark::linear_term<FieldT> &y) {
+    return x.index < y.index;
+  });
+  size_t out = 0;
+  for (size_t i = 0; i < terms.size(); ) {
+    libsnark::linear_term<FieldT> t = terms[i];
+    for (++i; i < terms.size() && terms[i].index == t.index; ++i) {
+      t.coeff += terms[i].coeff;
+    }
+    if (!t.coeff.is_zero()) {
+      terms[out++] = t;
+    }
+  }
+  terms.resize(out);
+}
+
+// for normalized lc
+template<typename FieldT>
+bool isConstantCombination(const libsnark::linear_combination<FieldT> &lc)
+{
+  return lc.terms.empty() || (lc.terms.size() == 1 && lc.terms[0].index == 0);
+}
+
+template<typename FieldT>
+FieldT constantOfCombination(const libsnark::linear_combination<FieldT> &lc)
+{
+  return (!lc.terms.empty() && lc.terms[0].index == 0) ? lc.terms[0].coeff : FieldT::zero();
+}
+
+// a*B - C or b*A - C when A = a or B = b is constant, normalized
+template<typename FieldT>
+bool linearFormOf(const libsnark::r1cs_constraint<FieldT> &constraint, libsnark::linear_combination<FieldT> &form)
+{
+  const libsnark::linear_combination<FieldT>* other;
+  FieldT scale;
+  if (isConstantCombination(constraint.a)) {
+    scale = constantOfCombination(constraint.a);
+    other = &constraint.b;
+  } else if (isConstantCombination(constraint.b)) {
+    scale = constantOfCombination(constraint.b);
+    other = &constraint.a;
+  } else {
+    return false;
+  }
+
+  form.terms.clear();
+  form.terms.reserve(other->terms.size() + constraint.c.terms.size());
+  if (!scale.is_zero()) {
+    for (const libsnark::linear_term<FieldT> &t : other->terms) {
+      form.terms.emplace_back(libsnark::variable<FieldT>(t.index), scale * t.coeff);
+    }
+  }
+  for (const libsnark::linear_term<FieldT> &t : constraint.c.terms) {
+    form.terms.emplace_back(libsnark::variable<FieldT>(t.index), -t.coeff);
+  }
+  normalizeLinearCombination(form);
+  return true;
+}
+
+// replaces every variable that has a substitution, lc is normalized after
+template<typename FieldT>
+bool substituteInto(libsnark::linear_combination<FieldT> &lc, const std::vector<libsnark::linear_combination<FieldT>> &substitutions,
+                    const std::vector<bool> &substituted)
+{
+  bool changed = false;
+  const size_t size = lc.terms.size();
+  for (size_t i = 0; i < size; ++i) {
+    const libsnark::linear_term<FieldT> t = lc.terms[i];
+    if (!substituted[t.index]) {
+      continue;
+    }
+    changed = true;
+    lc.terms[i].coeff = FieldT::zero();
+    for (const libsnark::linear_term<FieldT> &s : substitutions[t.index].terms) {
+      lc.terms.emplace_back(libsnark::variable<FieldT>(s.index), t.coeff * s.coeff);
+    }
+  }
+  normalizeLinearCombination(lc);
+  return changed;
+}
+
+template<typename FieldT>
+void appendCombinationKey(const libsnark::linear_combination<FieldT> &lc, std::string &key)
+{
+  for (const libsnark::linear_term<FieldT> &t : lc.terms) {
+    const libff::bigint<FieldT::num_limbs> coeff = t.coeff.as_bigint();
+    key.append(reinterpret_cast<const char*>(&t.index), sizeof(t.index));
+    key.append(reinterpret_cast<const char*>(coeff.data), sizeof(coeff.data));
+  }
+  key.push_back('|');
+}
+
+template<typename FieldT>
+libsnark::r1cs_constraint_system<FieldT> optimizeConstraintSystem(const libsnark::r1cs_constraint_system<FieldT> &cs,
+                                                                  r1cs_witness_map &map,
+                                                                  r1cs_optimization_report &report,
+                                                                  size_t max_substitution_terms = 16)
+{
+  typedef libsnark::linear_combination<FieldT> lc_t;
+
+  const size_t num_inputs = cs.num_inputs();
+  const size_t num_variables = cs.num_variables();
+  report = r1cs_optimization_report();
+  report.constraints_before = cs.num_constraints();
+  report.variables_before = num_variables;
+
+  std::vector<libsnark::r1cs_constraint<FieldT>> constraints(cs.constraints);
+  std::vector<size_t> occurrences(num_variables + 1, 0);
+  for (libsnark::r1cs_constraint<FieldT> &constraint : constraints) {
+    for (lc_t* lc : { &constraint.a, &constraint.b, &constraint.c }) {
+      normalizeLinearCombination(*lc);
+      for (const libsnark::linear_term<FieldT> &t : lc->terms) {
+        if (t.index > num_variables) {
+          throw std::invalid_argument("constraint uses variable " + std::to_string(t.index) + " of " + std::to_string(num_variables));
+        }
+        ++occurrences[t.index];
+      }
+    }
+  }
+
+  map.substituted = libsnark::r1cs_constraint_system<FieldT>();
+  map.substituted.primary_input_size = num_inputs;
+  map.substituted.auxiliary_input_size = num_variables - num_inputs;
+
+  // 1. substitutions, kept in terms of variables that are not substituted
+  std::vector<lc_t> substitutions(num_variables + 1);
+  std::vector<bool> substituted(num_variables + 1, false);
+  // users[v]: substituted variables whose expression contained v
+  std::vector<std::vector<size_t>> users(num_variables + 1);
+  std::vector<bool> removed(constraints.size(), false);
+
+  lc_t form;
+  for (size_t row = 0; row < constraints.size(); ++row) {
+    libsnark::r1cs_constraint<FieldT> &constraint = constraints[row];
+    substituteInto(constraint.a, substitutions, substituted);
+    substituteInto(constraint.b, substitutions, substituted);
+    substituteInto(constraint.c, substitutions, substituted);
+    if (!linearFormOf(constraint, form) || form.terms.empty() || form.terms.size() > max_substitution_terms + 1) {
+      continue;
+    }
+
+    // the auxiliary variable with the fewest occurrences limits the fill-in
+    size_t pick = form.terms.size();
+    for (size_t i = 0; i < form.terms.size(); ++i) {
+      const size_t v = form.terms[i].index;
+      if (v > num_inputs && (pick == form.terms.size() || occurrences[v] < occurrences[form.terms[pick].index])) {
+        pick = i;
+      }
+    }
+    if (pick == form.terms.size()) {
+      continue;
+    }
+
+    const size_t v = form.terms[pick].index;
+    const FieldT scale = -form.terms[pick].coeff.inverse();
+    lc_t expression;
+    for (size_t i = 0; i < form.terms.size(); ++i) {
+      if (i != pick) {
+        expression.terms.emplace_back(libsnark::variable<FieldT>(form.terms[i].index), scale * form.terms[i].coeff);
+      }
+    }
+    substitutions[v] = expression;
+    substituted[v] = true;
+    removed[row] = true;
+    map.substituted.constraints.push_back(cs.constraints[row]);
+    ++report.substituted_variables;
+
+    // earlier expressions that use v now use its expression
+    for (size_t u : users[v]) {
+      if (substituted[u] && substituteInto(substitutions[u], substitutions, substituted)) {
+        for (const libsnark::linear_term<FieldT> &t : substitutions[u].terms) {
+          users[t.index].push_back(u);
+        }
+      }
+    }
+    users[v].clear();
+    for (const libsnark::linear_term<FieldT> &t : expression.terms) {
+      users[t.index].push_back(v);
+    }
+  }
+
+  // 2. final substitution, trivial and duplicate constraints
+  std::unordered_set<std::string> seen;
+  std::vector<bool> used(num_variables + 1, false);
+  std::string key, key_b;
+  for (size_t row = 0; row < constraints.size(); ++row) {
+    if (removed[row]) {
+      continue;
+    }
+    libsnark::r1cs_constraint<FieldT> &constraint = constraints[row];
+    substituteInto(constraint.a, substitutions, substituted);
+    substituteInto(constraint.b, substitutions, substituted);
+    substituteInto(constraint.c, substitutions, substituted);
+
+    const bool product_zero = constraint.a.terms.empty() || constraint.b.terms.empty();
+    const bool all_constant = isConstantCombination(constraint.a) && isConstantCombination(constraint.b) && isConstantCombination(constraint.c);
+    if ((product_zero && constraint.c.terms.empty()) ||
+        (all_constant && constantOfCombination(constraint.a) * constantOfCombination(constraint.b) == constantOfCombination(constraint.c)) ||
+        (linearFormOf(constraint, form) && form.terms.empty())) {
+      removed[row] = true;
+      ++report.trivial_constraints;
+      continue;
+    }
+
+    key.clear();
+    key_b.clear();
+    appendCombinationKey(constraint.a, key);
+    appendCombinationKey(constraint.b, key_b);
+    if (key_b < key) {
+      std::swap(key, key_b);
+    }
+    key += key_b;
+    appendCombinationKey(constraint.c, key);
+    if (!seen.insert(key).second) {
+      removed[row] = true;
+      ++report.duplicate_constraints;
+      continue;
+    }
+
+    for (const lc_t* lc : { &constraint.a, &constraint.b, &constraint.c }) {
+      for (const libsnark::linear_term<FieldT> &t : lc->terms) {
+        used[t.index] = true;
+      }
+    }
+  }
+
+  // 3. renumbering, the primary inputs stay where they are
+  std::vector<size_t> new_index(num_variables + 1, 0);
+  map.old_num_variables = num_variables;
+  map.num_inputs = num_inputs;
+  map.old_index.clear();
+  for (size_t v = 1; v <= num_variables; ++v) {
+    if (v <= num_inputs || used[v]) {
+      map.old_index.push_back(v);
+      new_index[v] = map.old_index.size();
+    } else if (!substituted[v]) {
+      ++report.unused_variables;
+    }
+  }
+
+  libsnark::r1cs_constraint_system<FieldT> result;
+  result.primary_input_size = num_inputs;
+  result.auxiliary_input_size = map.old_index.size() - num_inputs;
+  for (size_t row = 0; row < constraints.size(); ++row) {
+    if (removed[row]) {
+      continue;
+    }
+    libsnark::r1cs_constraint<FieldT> &constraint = constraints[row];
+    for (lc_t* lc : { &constraint.a, &constraint.b, &constraint.c }) {
+      for (libsnark::linear_term<FieldT> &t : lc->terms) {
+        t.index = new_index[t.index];
+      }
+    }
+#ifdef DEBUG
+    auto annotation = cs.constraint_annotations.find(row);
+    if (annotation != cs.constraint_annotations.end()) {
+      result.constraint_annotations[result.constraints.size()] = annotation->second;
+    }
+#endif
+    result.constraints.push_back(std::move(constraint));
+  }
+#ifdef DEBUG
+  for (size_t i = 0; i < map.old_index.size(); ++i) {
+    auto annotation = cs.variable_annotations.find(map.old_index[i]);
+    if (annotation != cs.variable_annotations.end()) {
+      result.variable_annotations[i + 1] = annotation->second;
+    }
+  }
+#endif
+
+  report.constraints_after = result.num_constraints();
+  report.variables_after = result.num_variables();
+  return result;
+}
+
+// Witness map file: magic, version, then old_num_variables, num_inputs,
+// the number of variables and old_index, the number of substituted
+// constraints and for each of their A, B and C the number of terms followed
+// by index and the 4 limbs of the coefficient per term, all as little
+// endian uint64, and a pk_checksum over everything before it. Version 1
+// maps lack the substituted constraints and are rejected.
+const char r1cs_witness_map_magic[8] = { 'Z', 'K', 'W', 'M', 'A', 'P', '\0', '\0' };
+const uint64_t r1cs_witness_map_version = 2;
+
+inline std::string witnessMapPath(const char* pk_path)
+{
+  return std::string(pk_path) + ".wmap";
+}
+
+inline void writeWitnessMap(const r1cs_witness_map &map, const char* path)
+{
+  std::vector<uint64_t> words;
+  words.reserve(5 + map.old_index.size());
+  uint64_t magic;
+  memcpy(&magic, r1cs_witness_map_magic, 8);
+  words.push_back(magic);
+  words.push_back(r1cs_witness_map_version);
+  words.push_back(map.old_num_variables);
+  words.push_back(map.num_inputs);
+  words.push_back(map.old_index.size());
+  words.insert(words.end(), map.old_index.begin(), map.old_index.end());
+  words.push_back(map.substituted.num_constraints());
+  for (const libsnark::r1cs_constraint<libff::alt_bn128_Fr> &constraint : map.substituted.constraints) {
+    for (const libsnark::linear_combination<libff::alt_bn128_Fr>* lc : { &constraint.a, &constraint.b, &constraint.c }) {
+      words.push_back(lc->terms.size());
+      for (const libsnark::linear_term<libff::alt_bn128_Fr> &t : lc->terms) {
+        words.push_back(t.index);
+        const libff::bigint<libff::alt_bn128_r_limbs> coeff = t.coeff.as_bigint();
+        words.insert(words.end(), coeff.data, coeff.data + libff::alt_bn128_r_limbs);
+      }
+    }
+  }
+  pk_checksum checksum;
+  checksum.update(words.data(), 8 * words.size());
+  words.push_back(checksum.h);
+
+  std::ofstream fh(path, std::ios::binary);
+  fh.write(reinterpret_cast<const char*>(words.data()), 8 * words.size());
+  fh.flush();
+  if (!fh) {
+    throw std::runtime_error(std::string("error writing ") + path);
+  }
+}
+
+inline r1cs_witness_map readWitnessMap(const char* path)
+{
+  const mapped_file file(path);
+  const size_t num_words = file.size() / 8;
+  if (file.size() % 8 != 0 || num_words < 7) {
+    throw std::runtime_error(std::string("witness map: truncated ") + path);
+  }
+  std::vector<uint64_t> words(num_words);
+  memcpy(words.data(), file.data(), file.size());
+
+  pk_checksum checksum;
+  checksum.update(words.data(), 8 * (num_words - 1));
+  if (memcmp(&words[0], r1cs_witness_map_magic, 8) != 0 || words[1] != r1cs_witness_map_version) {
+    throw std::runtime_error(std::string("witness map: bad magic or version in ") + path);
+  }
+  if (words[4] > num_words - 7 || checksum.h != words[num_words - 1]) {
+    throw std::runtime_error(std::string("witness map: corrupted ") + path);
+  }
+
+  r1cs_witness_map map;
+  map.old_num_variables = words[2];
+  map.num_inputs = words[3];
+  if (map.num_inputs > map.old_num_variables) {
+    throw std::runtime_error(std::string("witness map: corrupted ") + path);
+  }
+  map.old_index.assign(words.begin() + 5, words.begin() + 5 + words[4]);
+  for (size_t i = 0; i < map.old_index.size(); ++i) {
+    if (map.old_index[i] == 0 || map.old_index[i] > map.old_num_variables ||
+        (i < map.num_inputs && map.old_index[i] != i + 1) ||
+        (i >= map.num_inputs && map.old_index[i] <= map.num_inputs)) {
+      throw std::runtime_error(std::string("witness map: corrupted ") + path);
+    }
+  }
+
+  // the substituted constraints, up to the checksum
+  const size_t end = num_words - 1;
+  size_t pos = 5 + words[4];
+  const uint64_t num_substituted = words[pos++];
+  if (num_substituted > (end - pos) / 3) {
+    throw std::runtime_error(std::string("witness map: corrupted ") + path);
+  }
+  map.substituted.primary_input_size = map.num_inputs;
+  map.substituted.auxiliary_input_size = map.old_num_variables - map.num_inputs;
+  map.substituted.constraints.resize(num_substituted);
+  for (libsnark::r1cs_constraint<libff::alt_bn128_Fr> &constraint : map.substituted.constraints) {
+    for (libsnark::linear_combination<libff::alt_bn128_Fr>* lc : { &constraint.a, &constraint.b, &constraint.c }) {
+      if (pos >= end || words[pos] > (end - pos - 1) / (1 + libff::alt_bn128_r_limbs)) {
+        throw std::runtime_error(std::string("witness map: corrupted ") + path);
+      }
+      const uint64_t num_terms = words[pos++];
+      lc->terms.reserve(num_terms);
+      for (uint64_t k = 0; k < num_terms; ++k) {
+        const uint64_t index = words[pos++];
+        libff::bigint<libff::alt_bn128_r_limbs> coeff;
+        memcpy(coeff.data, &words[pos], sizeof(coeff.data));
+        pos += libff::alt_bn128_r_limbs;
+        if (index > map.old_num_variables || mpn_cmp(coeff.data, libff::alt_bn128_modulus_r.data, libff::alt_bn128_r_limbs) >= 0) {
+          throw std::runtime_error(std::string("witness map: corrupted ") + path);
+        }
+        lc->terms.emplace_back(libsnark::variable<libff::alt_bn128_Fr>(index), libff::alt_bn128_Fr(coeff));
+      }
+    }
+  }
+  if (pos != end) {
+    throw std::runtime_error(std::string("witness map: corrupted ") + path);
+  }
+  return map;
+}
+
+#endif // ZOKRATES_R1CS_OPTIMIZER_HPP_
@@ -0,0 +1,68 @@
+/**
+ * @file threads.hpp
+ *
+ * Runtime thread count for keygen and proving.
+ *
+ * Under MULTICORE, libsnark's generator and prover and our multiexps run
+ * OpenMP parallel regions; the thread pools (batch prover, witness check)
+ * use std::thread. Both take their default size from proverThreads(), which
+ * is set through setProverThreads() (_set_num_threads in the C ABI) or the
+ * ZOKRATES_THREADS environment variable and defaults to one thread per
+ * hardware thread.
+ *
+ * OpenMP keeps the thread count per calling thread, so entry points that may
+ * be called from arbitrary host threads call applyProverThreads() first.
+ */
+
+#ifndef ZOKRATES_THREADS_HPP_
+#define ZOKRATES_THREADS_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
+inline size_t threadsFromEnvironment()
+{
+  const char* env = getenv("ZOKRATES_THREADS");
+  if (env != nullptr) {
+    const long n = atol(env);
+    if (n > 0) {
+      return n;
+    }
+  }
+  return 0;
+}
+
+// 0 means one per hardware thread
+inline std::atomic<size_t>& proverThreadSetting()
+{
+  static std::atomic<size_t> setting(threadsFromEnvironment());
+  return setting;
+}
+
+inline size_t proverThreads()
+{
+  const size_t n = proverThreadSetting();
+  return n != 0 ? n : std::max<unsigned>(1, std::thread::hardware_concurrency());
+}
+
+// makes OpenMP regions started from the calling thread use proverThreads()
+inline void applyProverThreads()
+{
+#ifdef MULTICORE
+  omp_set_num_threads(proverThreads());
+#endif
+}
+
+inline void setProverThreads(size_t num_threads)
+{
+  proverThreadSetting() = num_threads;
+  applyProverThreads();
+}
+
+#endif // ZOKRATES_THREADS_HPP_
@@ -0,0 +1,177 @@
+/**
+ * @file trace.hpp
+ *
+ * Lightweight spans around the stages of setup and proving.
+ *
+ * Tracing is enabled by setting ZOKRATES_TRACE to an output path. Every
+ * trace_span then records wall time, process CPU time (all threads), the
+ * number of threads available to it and the peak RSS at its end; at process
+ * exit the spans are written as Chrome trace JSON ("X" events), which can be
+ * opened in chrome://tracing or Perfetto, or read by anything that parses
+ * JSON. When ZOKRATES_TRACE is unset a span costs one branch on a cached
+ * flag.
+ *
+ * Spans are thread safe and nest; spans opened on worker threads (batch
+ * proving) show up under their own tid.
+ */
+
+#ifndef ZOKRATES_TRACE_HPP_
+#define ZOKRATES_TRACE_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
+struct trace_event {
+  const char* name;
+  uint64_t tid;
+  double start_us;
+  double wall_us;
+  double cpu_us;
+  int threads;
+  long peak_rss_kb;
+};
+
+class trace_recorder {
+public:
+  static trace_recorder& instance()
+  {
+    static trace_recorder recorder;
+    return recorder;
+  }
+
+  bool enabled() const { return !path.empty(); }
+
+  double nowUs() const
+  {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+  }
+
+  static double cpuUs()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+  }
+
+  static int threads()
+  {
+#ifdef MULTICORE
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+  }
+
+  static long peakRssKb()
+  {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+  }
+
+  void record(const trace_event &event)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back(event);
+  }
+
+  // writes all spans recorded so far, replacing the file
+  void flush()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!enabled()) {
+      return;
+    }
+    FILE* fh = fopen(path.c_str(), "w");
+    if (fh == nullptr) {
+      return;
+    }
+    fprintf(fh, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (size_t i = 0; i < events.size(); ++i) {
+      const trace_event &e = events[i];
+      fprintf(fh, "%s\n{\"name\":\"%s\",\"cat\":\"zokrates\",\"ph\":\"X\",\"pid\":%d,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f,"
+                  "\"args\":{\"cpu_ms\":%.3f,\"threads\":%d,\"peak_rss_kb\":%ld}}",
+              i == 0 ? "" : ",", e.name, int(getpid()), (unsigned long long) e.tid, e.start_us, e.wall_us,
+              e.cpu_us * 1e-3, e.threads, e.peak_rss_kb);
+    }
+    fprintf(fh, "\n]}\n");
+    fclose(fh);
+  }
+
+  ~trace_recorder()
+  {
+    flush();
+  }
+
+private:
+  trace_recorder() : origin(std::chrono::steady_clock::now())
+  {
+    const char* env = getenv("ZOKRATES_TRACE");
+    if (env != nullptr) {
+      path = env;
+    }
+  }
+
+  std::string path;
+  std::chrono::steady_clock::time_point origin;
+  std::mutex mutex;
+  std::vector<trace_event> events;
+};
+
+// Records the time between construction and destruction. name has to be a
+// string literal or otherwise outlive the process.
+class trace_span {
+public:
+  explicit trace_span(const char* name) : name(name)
+  {
+    static const bool enabled = trace_recorder::instance().enabled();
+    active = enabled;
+    if (active) {
+      start_us = trace_recorder::instance().nowUs();
+      start_cpu_us = trace_recorder::cpuUs();
+    }
+  }
+
+  ~trace_span()
+  {
+    if (!active) {
+      return;
+    }
+    trace_recorder &recorder = trace_recorder::instance();
+    trace_event event;
+    event.name = name;
+    event.tid = std::hash<std::thread::id>()(std::this_thread::get_id()) % 1000000;
+    event.start_us = start_us;
+    event.wall_us = recorder.nowUs() - start_us;
+    event.cpu_us = trace_recorder::cpuUs() - start_cpu_us;
+    event.threads = trace_recorder::threads();
+    event.peak_rss_kb = trace_recorder::peakRssKb();
+    recorder.record(event);
+  }
+
+  trace_span(const trace_span&) = delete;
+  trace_span& operator=(const trace_span&) = delete;
+
+private:
+  const char* name;
+  bool active;
+  double start_us = 0;
+  double start_cpu_us = 0;
+};
+
+#endif // ZOKRATES_TRACE_HPP_
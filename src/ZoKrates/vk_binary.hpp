@@ -0,0 +1,226 @@
+/**
+ * @file vk_binary.hpp
+ *
+ * Binary processed verification key.
+ *
+ * Before a proof can be checked, r1cs_ppzksnark_verifier_process_vk computes
+ * the Miller loop line coefficients of the six fixed G2 elements (alphaA,
+ * alphaC, rC_Z, gamma, gamma_beta and the generator). Together with parsing
+ * the key that costs more than the verification itself. This file stores the
+ * result (the precomputations, the IC query and the two G1 points the batch
+ * verifier needs) as raw Montgomery limbs, so loading it is a checked copy.
+ *
+ * Layout: vk_binary_header, then the G2 precomputations (QX, QY, coeffs) of
+ * the generator, alphaA, alphaC, rC_Z, gamma and gamma_beta, the G1
+ * precomputations (PX, PY) of alphaB and gamma_beta, the points alphaB_g1
+ * and gamma_beta_g1, and the IC query (first, rest indices, rest values).
+ */
+
+#ifndef ZOKRATES_VK_BINARY_HPP_
+#define ZOKRATES_VK_BINARY_HPP_
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
+
+#include "batch_verifier.hpp"
+#include "pk_binary.hpp"
+
+static_assert(sizeof(libff::alt_bn128_Fq) == 32, "unexpected alt_bn128_Fq layout");
+static_assert(sizeof(libff::alt_bn128_Fq2) == 64, "unexpected alt_bn128_Fq2 layout");
+static_assert(sizeof(libff::alt_bn128_ate_ell_coeffs) == 3 * 64, "unexpected alt_bn128_ate_ell_coeffs layout");
+
+const char vk_binary_magic[8] = { 'Z', 'K', 'P', 'V', 'K', 'B', 'N', '\0' };
+const uint32_t vk_binary_version = 1;
+
+struct vk_binary_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t modulus_r[4];
+  uint64_t modulus_q[4];
+  // line coefficients per G2 precomputation, the same for all of them
+  uint64_t num_coeffs;
+  uint64_t ic_domain_size;
+  uint64_t ic_num_rest;
+  uint64_t payload_length;
+  uint64_t payload_checksum;
+  // over all header bytes before this field
+  uint64_t header_checksum;
+};
+
+typedef libsnark::r1cs_ppzksnark_processed_verification_key<verifier_pp> processed_verification_key;
+
+inline std::string processedVerificationKeyPath(const char* vk_path)
+{
+  return std::string(vk_path) + ".pvk";
+}
+
+inline bool isBinaryVerificationKeyFile(const char* path)
+{
+  std::ifstream fh(path, std::ios::binary);
+  char magic[sizeof(vk_binary_magic)];
+  return fh.read(magic, sizeof(magic)) && memcmp(magic, vk_binary_magic, sizeof(magic)) == 0;
+}
+
+inline uint64_t verificationKeyPayloadLength(uint64_t num_coeffs, uint64_t ic_num_rest)
+{
+  return 6 * (2 * sizeof(libff::alt_bn128_Fq2) + num_coeffs * sizeof(libff::alt_bn128_ate_ell_coeffs)) +
+         2 * 2 * sizeof(libff::alt_bn128_Fq) +
+         2 * sizeof(libff::alt_bn128_G1) +
+         sizeof(libff::alt_bn128_G1) + ic_num_rest * (8 + sizeof(libff::alt_bn128_G1));
+}
+
+inline void serializeProcessedVerificationKeyToFile(const batch_verification_key &bvk, const char* path)
+{
+  const processed_verification_key &pvk = bvk.pvk;
+  const libff::alt_bn128_ate_G2_precomp* const g2[6] = {
+    &pvk.pp_G2_one_precomp, &pvk.vk_alphaA_g2_precomp, &pvk.vk_alphaC_g2_precomp,
+    &pvk.vk_rC_Z_g2_precomp, &pvk.vk_gamma_g2_precomp, &pvk.vk_gamma_beta_g2_precomp
+  };
+  const libsnark::accumulation_vector<libff::alt_bn128_G1> &ic = pvk.encoded_IC_query;
+
+  vk_binary_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, vk_binary_magic, sizeof(vk_binary_magic));
+  header.version = vk_binary_version;
+  header.header_size = sizeof(header);
+  memcpy(header.modulus_r, libff::alt_bn128_modulus_r.data, sizeof(header.modulus_r));
+  memcpy(header.modulus_q, libff::alt_bn128_modulus_q.data, sizeof(header.modulus_q));
+  header.num_coeffs = g2[0]->coeffs.size();
+  for (const libff::alt_bn128_ate_G2_precomp* precomp : g2) {
+    assert(precomp->coeffs.size() == header.num_coeffs);
+  }
+  header.ic_domain_size = ic.domain_size();
+  header.ic_num_rest = ic.rest.indices.size();
+  header.payload_length = verificationKeyPayloadLength(header.num_coeffs, header.ic_num_rest);
+
+  std::ofstream fh(path, std::ios::binary);
+  if (!fh.is_open()) {
+    throw std::runtime_error(std::string("cannot open ") + path);
+  }
+
+  // header is written last, once the payload checksum is known
+  fh.seekp(sizeof(header));
+  pk_binary_writer out(fh);
+  for (const libff::alt_bn128_ate_G2_precomp* precomp : g2) {
+    out.write(&precomp->QX, sizeof(precomp->QX));
+    out.write(&precomp->QY, sizeof(precomp->QY));
+    out.write(precomp->coeffs.data(), header.num_coeffs * sizeof(precomp->coeffs[0]));
+  }
+  for (const libff::alt_bn128_ate_G1_precomp* precomp : { &pvk.vk_alphaB_g1_precomp, &pvk.vk_gamma_beta_g1_precomp }) {
+    out.write(&precomp->PX, sizeof(precomp->PX));
+    out.write(&precomp->PY, sizeof(precomp->PY));
+  }
+  out.write(&bvk.alphaB_g1, sizeof(bvk.alphaB_g1));
+  out.write(&bvk.gamma_beta_g1, sizeof(bvk.gamma_beta_g1));
+  out.write(&ic.first, sizeof(ic.first));
+  for (size_t i = 0; i < ic.rest.indices.size(); ++i) {
+    const uint64_t index = ic.rest.indices[i];
+    out.write(&index, 8);
+  }
+  out.write(ic.rest.values.data(), header.ic_num_rest * sizeof(libff::alt_bn128_G1));
+  assert(out.written == header.payload_length);
+
+  header.payload_checksum = out.checksum.h;
+  pk_checksum header_sum;
+  header_sum.update(&header, offsetof(vk_binary_header, header_checksum));
+  header.header_checksum = header_sum.h;
+
+  fh.seekp(0);
+  fh.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  fh.flush();
+  if (!fh) {
+    throw std::runtime_error(std::string("error writing ") + path);
+  }
+}
+
+// reads a file written by serializeProcessedVerificationKeyToFile
+inline batch_verification_key readProcessedVerificationKeyFile(const char* path)
+{
+  const mapped_file file(path);
+  vk_binary_header header;
+  if (file.size() < sizeof(header)) {
+    throw std::runtime_error(std::string("binary verification key: truncated ") + path);
+  }
+  memcpy(&header, file.data(), sizeof(header));
+  if (memcmp(header.magic, vk_binary_magic, sizeof(vk_binary_magic)) != 0) {
+    throw std::runtime_error(std::string("binary verification key: bad magic in ") + path);
+  }
+  if (header.version != vk_binary_version || header.header_size != sizeof(vk_binary_header)) {
+    throw std::runtime_error(std::string("binary verification key: unsupported version in ") + path);
+  }
+  pk_checksum header_sum;
+  header_sum.update(&header, offsetof(vk_binary_header, header_checksum));
+  if (header_sum.h != header.header_checksum) {
+    throw std::runtime_error(std::string("binary verification key: header checksum mismatch in ") + path);
+  }
+  if (memcmp(header.modulus_r, libff::alt_bn128_modulus_r.data, sizeof(header.modulus_r)) != 0 ||
+      memcmp(header.modulus_q, libff::alt_bn128_modulus_q.data, sizeof(header.modulus_q)) != 0) {
+    throw std::runtime_error(std::string("binary verification key: written for a different curve in ") + path);
+  }
+  // bounds the counts before they go into the length computation
+  const uint64_t available = file.size() - sizeof(header);
+  if (header.num_coeffs > available / sizeof(libff::alt_bn128_ate_ell_coeffs) ||
+      header.ic_num_rest > available / sizeof(libff::alt_bn128_G1) ||
+      header.ic_num_rest > header.ic_domain_size ||
+      header.payload_length != verificationKeyPayloadLength(header.num_coeffs, header.ic_num_rest) ||
+      header.payload_length != available) {
+    throw std::runtime_error(std::string("binary verification key: truncated ") + path);
+  }
+  const uint8_t* p = file.data() + sizeof(header);
+  pk_checksum payload_sum;
+  payload_sum.update(p, header.payload_length);
+  if (payload_sum.h != header.payload_checksum) {
+    throw std::runtime_error(std::string("binary verification key: payload checksum mismatch in ") + path);
+  }
+
+  auto read = [&p](void* dst, size_t len) {
+    memcpy(dst, p, len);
+    p += len;
+  };
+
+  batch_verification_key bvk;
+  processed_verification_key &pvk = bvk.pvk;
+  libff::alt_bn128_ate_G2_precomp* const g2[6] = {
+    &pvk.pp_G2_one_precomp, &pvk.vk_alphaA_g2_precomp, &pvk.vk_alphaC_g2_precomp,
+    &pvk.vk_rC_Z_g2_precomp, &pvk.vk_gamma_g2_precomp, &pvk.vk_gamma_beta_g2_precomp
+  };
+  for (libff::alt_bn128_ate_G2_precomp* precomp : g2) {
+    read(&precomp->QX, sizeof(precomp->QX));
+    read(&precomp->QY, sizeof(precomp->QY));
+    precomp->coeffs.resize(header.num_coeffs);
+    read(precomp->coeffs.data(), header.num_coeffs * sizeof(precomp->coeffs[0]));
+  }
+  for (libff::alt_bn128_ate_G1_precomp* precomp : { &pvk.vk_alphaB_g1_precomp, &pvk.vk_gamma_beta_g1_precomp }) {
+    read(&precomp->PX, sizeof(precomp->PX));
+    read(&precomp->PY, sizeof(precomp->PY));
+  }
+  read(&bvk.alphaB_g1, sizeof(bvk.alphaB_g1));
+  read(&bvk.gamma_beta_g1, sizeof(bvk.gamma_beta_g1));
+
+  libff::alt_bn128_G1 first;
+  read(&first, sizeof(first));
+  std::vector<size_t> indices(header.ic_num_rest);
+  read(indices.data(), 8 * indices.size());
+  // accumulate_chunk walks the indices in order and relies on them being in range
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (indices[i] >= header.ic_domain_size || (i > 0 && indices[i] <= indices[i - 1])) {
+      throw std::runtime_error(std::string("binary verification key: corrupted IC query in ") + path);
+    }
+  }
+  std::vector<libff::alt_bn128_G1> values(header.ic_num_rest);
+  read(values.data(), values.size() * sizeof(libff::alt_bn128_G1));
+  libsnark::sparse_vector<libff::alt_bn128_G1> rest;
+  rest.indices = std::move(indices);
+  rest.values = std::move(values);
+  rest.domain_size_ = header.ic_domain_size;
+  pvk.encoded_IC_query = libsnark::accumulation_vector<libff::alt_bn128_G1>(std::move(first), std::move(rest));
+  return bvk;
+}
+
+#endif // ZOKRATES_VK_BINARY_HPP_
@@ -9,52 +9,88 @@
 #include <fstream>
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
 #include <iomanip>
+#include <memory>
+#include <mutex>
 
 // contains definition of alt_bn128 ec public parameters
 //#include "libsnark/libsnark/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
 #include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp"
 // contains required interfaces and types (keypair, proof, generator, prover, verifier)
 #include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
+// same for the Groth16 backend
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_gg_ppzksnark/r1cs_gg_ppzksnark.hpp>
+// binary, mmap-able proving key format
+#include "pk_binary.hpp"
+// processed verification key for _verify
+#include "vk_binary.hpp"
+// precomputed fixed-base tables next to a binary proving key
+#include "pk_stream.hpp"
+#include "pk_tables.hpp"
+// FFT twiddle table next to a binary proving key
+#include "pk_domain.hpp"
+// proving many witnesses on a thread pool
+#include "batch_prover.hpp"
+// one inversion per vector of exported points
+#include "affine.hpp"
+// bulk bytes / hex conversion of field elements
+#include "field_conversion.hpp"
+// keypairs stored by constraint system hash
+#include "keypair_cache.hpp"
+// loader for r1cs.json / tests.json
+#include "r1cs_json_reader.hpp"
+#include "r1cs_optimizer.hpp"
+// compressed binary proofs with their inputs
+#include "proof_bundle.hpp"
+// runtime thread count (ZOKRATES_THREADS, _set_num_threads)
+#include "threads.hpp"
+// per stage timing, enabled through ZOKRATES_TRACE
+#include "trace.hpp"
+// parallel witness check with diagnostics
+#include "r1cs_check.hpp"
 
 typedef long integer_coeff_t;
 
 using namespace std;
 using namespace libsnark;
 
+// init_public_params() is only needed once per process. The thread count
+// is per calling thread, so it is applied on every call. libff's profiling
+// is turned off for good on the first call: enter_block/leave_block write
+// global maps, which would race between threads proving or verifying at
+// the same time, and so would flipping the flags per call.
+void initCurveParameters()
+{
+  static std::once_flag initialized;
+  std::call_once(initialized, [] {
+    libff::alt_bn128_pp::init_public_params();
+    libff::inhibit_profiling_info = true;
+    libff::inhibit_profiling_counters = true;
+  });
+  applyProverThreads();
+}
+
 // conversion byte[32] <-> libsnark bigint.
 libff::bigint<libff::alt_bn128_r_limbs> libsnarkBigintFromBytes(const uint8_t* _x)
 {
-  libff::bigint<libff::alt_bn128_r_limbs> x;
+  return bigintFromBytes32(_x);
+}
 
-  for (unsigned i = 0; i < 4; i++) {
-    for (unsigned j = 0; j < 8; j++) {
-      x.data[3 - i] |= uint64_t(_x[i * 8 + j]) << (8 * (7-j));
-    }
-  }
-  return x;
+void libsnarkBigintToBytes(const libff::bigint<libff::alt_bn128_q_limbs> &_x, uint8_t* x)
+{
+  bigintToBytes32(_x, x);
 }
 
+// hex digits without leading zeros; field_hex_buffer converts whole vectors
 std::string HexStringFromLibsnarkBigint(libff::bigint<libff::alt_bn128_r_limbs> _x){
-    uint8_t x[32];
-    for (unsigned i = 0; i < 4; i++)
-        for (unsigned j = 0; j < 8; j++)
-                        x[i * 8 + j] = uint8_t(uint64_t(_x.data[3 - i]) >> (8 * (7 - j)));
-
-        std::stringstream ss;
-        ss << std::setfill('0');
-        for (unsigned i = 0; i<32; i++) {
-                ss << std::hex << std::setw(2) << (int)x[i];
-        }
-
-                std:string str = ss.str();
-                return str.erase(0, min(str.find_first_not_of('0'), str.size()-1));
+  char digits[field_hex_digits];
+  return std::string(digits, bigintToShortHex(_x, digits));
 }
 
-std::string outputPointG1AffineAsHex(libff::alt_bn128_G1 _p)
+// _p has to be in affine coordinates already
+std::string pointG1AsHex(const libff::alt_bn128_G1 &aff)
 {
-        libff::alt_bn128_G1 aff = _p;
-        aff.to_affine_coordinates();
         return
                 "\"0x" +
                 HexStringFromLibsnarkBigint(aff.X.as_bigint()) +
@@ -63,10 +99,9 @@ std::string outputPointG1AffineAsHex(libff::alt_bn128_G1 _p)
                 "\"";
 }
 
-std::string outputPointG2AffineAsHex(libff::alt_bn128_G2 _p)
+// _p has to be in affine coordinates already
+std::string pointG2AsHex(const libff::alt_bn128_G2 &aff)
 {
-        libff::alt_bn128_G2 aff = _p;
-        aff.to_affine_coordinates();
         return
                 "[\"0x" +
                 HexStringFromLibsnarkBigint(aff.X.c1.as_bigint()) + "\", \"0x" +
@@ -75,9 +110,216 @@ std::string outputPointG2AffineAsHex(libff::alt_bn128_G2 _p)
                 HexStringFromLibsnarkBigint(aff.Y.c0.as_bigint()) + "\"]";
 }
 
+std::string outputPointG1AffineAsHex(libff::alt_bn128_G1 _p)
+{
+        libff::alt_bn128_G1 aff = _p;
+        aff.to_affine_coordinates();
+        return pointG1AsHex(aff);
+}
+
+std::string outputPointG2AffineAsHex(libff::alt_bn128_G2 _p)
+{
+        libff::alt_bn128_G2 aff = _p;
+        aff.to_affine_coordinates();
+        return pointG2AsHex(aff);
+}
+
+// like outputPointG1AffineAsHex for every point, with one inversion in total
+std::vector<std::string> outputPointsG1AffineAsHex(std::vector<libff::alt_bn128_G1> points)
+{
+        batchToAffineCoordinates(points);
+        std::vector<std::string> hex;
+        hex.reserve(points.size());
+        for (const libff::alt_bn128_G1 &aff : points) {
+                hex.emplace_back(pointG1AsHex(aff));
+        }
+        return hex;
+}
+
+// like outputPointG2AffineAsHex for every point, with one inversion in total
+std::vector<std::string> outputPointsG2AffineAsHex(std::vector<libff::alt_bn128_G2> points)
+{
+        batchToAffineCoordinates(points);
+        std::vector<std::string> hex;
+        hex.reserve(points.size());
+        for (const libff::alt_bn128_G2 &aff : points) {
+                hex.emplace_back(pointG2AsHex(aff));
+        }
+        return hex;
+}
+
+// All points of a verification key as hex, normalized in one batch per group.
+struct verification_key_hex {
+  std::string A, B, C, gamma, gammaBeta1, gammaBeta2, Z;
+  std::vector<std::string> IC;
+};
+
+verification_key_hex verificationKeyAsHex(const r1cs_ppzksnark_verification_key<libff::alt_bn128_pp> &vk)
+{
+  std::vector<libff::alt_bn128_G1> g1 = { vk.alphaB_g1, vk.gamma_beta_g1 };
+  g1.reserve(2 + 1 + vk.encoded_IC_query.rest.values.size());
+  g1.emplace_back(vk.encoded_IC_query.first);
+  g1.insert(g1.end(), vk.encoded_IC_query.rest.values.begin(), vk.encoded_IC_query.rest.values.end());
+  std::vector<std::string> g1_hex = outputPointsG1AffineAsHex(std::move(g1));
+
+  const std::vector<std::string> g2_hex = outputPointsG2AffineAsHex({ vk.alphaA_g2, vk.alphaC_g2, vk.gamma_g2, vk.gamma_beta_g2, vk.rC_Z_g2 });
+
+  verification_key_hex hex;
+  hex.A = g2_hex[0];
+  hex.B = g1_hex[0];
+  hex.C = g2_hex[1];
+  hex.gamma = g2_hex[2];
+  hex.gammaBeta1 = g1_hex[1];
+  hex.gammaBeta2 = g2_hex[3];
+  hex.Z = g2_hex[4];
+  hex.IC.assign(std::make_move_iterator(g1_hex.begin() + 2), std::make_move_iterator(g1_hex.end()));
+  return hex;
+}
+
+// Proof points as hex, normalized together.
+struct proof_hex {
+  std::string A, A_p, B, B_p, C, C_p, H, K;
+};
+
+proof_hex proofAsHex(const r1cs_ppzksnark_proof<libff::alt_bn128_pp> &proof)
+{
+  const std::vector<std::string> g1_hex = outputPointsG1AffineAsHex({ proof.g_A.g, proof.g_A.h, proof.g_B.h, proof.g_C.g, proof.g_C.h, proof.g_H, proof.g_K });
+
+  proof_hex hex;
+  hex.A = g1_hex[0];
+  hex.A_p = g1_hex[1];
+  hex.B = outputPointG2AffineAsHex(proof.g_B.g);
+  hex.B_p = g1_hex[2];
+  hex.C = g1_hex[3];
+  hex.C_p = g1_hex[4];
+  hex.H = g1_hex[5];
+  hex.K = g1_hex[6];
+  return hex;
+}
+
+// Groth16 verification key as hex. alpha and beta only appear as the pairing
+// e(alpha, beta) in libsnark's verification key, so they are taken from the
+// proving key.
+struct groth16_verification_key_hex {
+  std::string alpha, beta, gamma, delta;
+  std::vector<std::string> gammaABC;
+};
+
+groth16_verification_key_hex groth16VerificationKeyAsHex(const r1cs_gg_ppzksnark_keypair<libff::alt_bn128_pp> &keypair)
+{
+  const r1cs_gg_ppzksnark_verification_key<libff::alt_bn128_pp> &vk = keypair.vk;
+  std::vector<libff::alt_bn128_G1> g1 = { keypair.pk.alpha_g1 };
+  g1.reserve(1 + 1 + vk.gamma_ABC_g1.rest.values.size());
+  g1.emplace_back(vk.gamma_ABC_g1.first);
+  g1.insert(g1.end(), vk.gamma_ABC_g1.rest.values.begin(), vk.gamma_ABC_g1.rest.values.end());
+  std::vector<std::string> g1_hex = outputPointsG1AffineAsHex(std::move(g1));
+
+  const std::vector<std::string> g2_hex = outputPointsG2AffineAsHex({ keypair.pk.beta_g2, vk.gamma_g2, vk.delta_g2 });
+
+  groth16_verification_key_hex hex;
+  hex.alpha = g1_hex[0];
+  hex.beta = g2_hex[0];
+  hex.gamma = g2_hex[1];
+  hex.delta = g2_hex[2];
+  hex.gammaABC.assign(std::make_move_iterator(g1_hex.begin() + 1), std::make_move_iterator(g1_hex.end()));
+  return hex;
+}
+
+struct groth16_proof_hex {
+  std::string A, B, C;
+};
+
+groth16_proof_hex groth16ProofAsHex(const r1cs_gg_ppzksnark_proof<libff::alt_bn128_pp> &proof)
+{
+  const std::vector<std::string> g1_hex = outputPointsG1AffineAsHex({ proof.g_A, proof.g_C });
+
+  groth16_proof_hex hex;
+  hex.A = g1_hex[0];
+  hex.B = outputPointG2AffineAsHex(proof.g_B);
+  hex.C = g1_hex[1];
+  return hex;
+}
+
+// "0x..." strings of the primary inputs, comma separated
+std::string inputsAsHex(const r1cs_primary_input<libff::alt_bn128_Fr> &primary_input)
+{
+  field_hex_buffer digits;
+  digits.assign(primary_input);
+  std::string hex;
+  hex.reserve(primary_input.size() * (field_hex_digits + 4));
+  for (size_t i = 0; i < digits.size(); ++i) {
+    hex += (i == 0 ? "\"0x" : ",\"0x");
+    hex.append(digits.digits(i), digits.length(i));
+    hex += '"';
+  }
+  return hex;
+}
+
+// proof.json contents: the proof points and the primary inputs
+std::string proofAsJson(const r1cs_ppzksnark_proof<libff::alt_bn128_pp> &proof, const r1cs_primary_input<libff::alt_bn128_Fr> &primary_input)
+{
+  const proof_hex hex = proofAsHex(proof);
+  std::stringstream ss;
+  ss << "{\n";
+  ss << " \"a\" :[" << hex.A << "],\n";
+  ss << " \"a_p\"  :[" << hex.A_p << "],\n";
+  ss << " \"b\"  :[" << hex.B << "],\n";
+  ss << " \"b_p\" :[" << hex.B_p << "],\n";
+  ss << " \"c\" :[" << hex.C << "],\n";
+  ss << " \"c_p\" :[" << hex.C_p << "],\n";
+  ss << " \"h\" :[" << hex.H << "],\n";
+  ss << " \"k\" :[" << hex.K << "],\n";
+  ss << " \"input\" :[" << inputsAsHex(primary_input) << "]";
+  ss << "}";
+  return ss.str();
+}
+
+std::string groth16ProofAsJson(const r1cs_gg_ppzksnark_proof<libff::alt_bn128_pp> &proof, const r1cs_primary_input<libff::alt_bn128_Fr> &primary_input)
+{
+  const groth16_proof_hex hex = groth16ProofAsHex(proof);
+  std::stringstream ss;
+  ss << "{\n";
+  ss << " \"a\" :[" << hex.A << "],\n";
+  ss << " \"b\"  :[" << hex.B << "],\n";
+  ss << " \"c\" :[" << hex.C << "],\n";
+  ss << " \"input\" :[" << inputsAsHex(primary_input) << "]";
+  ss << "}";
+  return ss.str();
+}
+
+// appends the non-zero cells of one dense matrix row (variables * 32 bytes) to lin_comb
+void appendDenseRow(linear_combination<libff::alt_bn128_Fr> &lin_comb, const uint8_t* row, int variables)
+{
+  for (int idx = 0; idx < variables; idx++) {
+    libff::bigint<libff::alt_bn128_r_limbs> value = libsnarkBigintFromBytes(row + idx*32);
+    if (!value.is_zero()) {
+      lin_comb.add_term(idx, libff::alt_bn128_Fr(value));
+    }
+  }
+}
+
+// affine x, y as 2 * 32 bytes, same order as outputPointG1AffineAsHex
+void writePointG1AffineAsBytes(libff::alt_bn128_G1 _p, uint8_t* out)
+{
+  _p.to_affine_coordinates();
+  libsnarkBigintToBytes(_p.X.as_bigint(), out);
+  libsnarkBigintToBytes(_p.Y.as_bigint(), out + 32);
+}
+
+// affine x.c1, x.c0, y.c1, y.c0 as 4 * 32 bytes, same order as outputPointG2AffineAsHex
+void writePointG2AffineAsBytes(libff::alt_bn128_G2 _p, uint8_t* out)
+{
+  _p.to_affine_coordinates();
+  libsnarkBigintToBytes(_p.X.c1.as_bigint(), out);
+  libsnarkBigintToBytes(_p.X.c0.as_bigint(), out + 32);
+  libsnarkBigintToBytes(_p.Y.c1.as_bigint(), out + 64);
+  libsnarkBigintToBytes(_p.Y.c0.as_bigint(), out + 96);
+}
+
 //takes input and puts it into constraint system
 r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> createConstraintSystem(const uint8_t* A, const uint8_t* B, const uint8_t* C, int constraints, int variables, int inputs)
 {
+  trace_span span("setup/constraint_system");
   r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> cs;
   cs.primary_input_size = inputs;
   cs.auxiliary_input_size = variables - inputs - 1; // ~one not included
@@ -86,102 +328,174 @@ r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> createConstraintSystem(con
   cout << "num constraints: " << constraints <<endl;
   cout << "num inputs: " << inputs <<endl;
 
+  cs.constraints.reserve(constraints);
   for (int row = 0; row < constraints; row++) {
-    linear_combination<libff::alt_bn128_pp> lin_comb_A, lin_comb_B, lin_comb_C;
-
-    for (int idx=0; idx<variables; idx++) {
-      libff::bigint<libff::alt_bn128_r_limbs> value = libsnarkBigintFromBytes(A+row*variables*32 + idx*32);
-      libff::alt_bn128_pp::init_public_params();
-      cout << "C entry " << idx << " in row " << row << ": " << value << endl;
-      if (!value.is_zero()) {
-        //cout << "A(" << idx << ", " << value << ")" << endl;
-        //lin_comb_A.add_term(idx,value);
-        //linear_term<libff::alt_bn128_pp>(0);
-      }
+    const size_t row_offset = size_t(row) * variables * 32;
+
+    cs.constraints.emplace_back();
+    r1cs_constraint<libff::alt_bn128_Fr> &constraint = cs.constraints.back();
+    appendDenseRow(constraint.a, A + row_offset, variables);
+    appendDenseRow(constraint.b, B + row_offset, variables);
+    appendDenseRow(constraint.c, C + row_offset, variables);
+  }
+  return cs;
+}
+
+// Sizes, offsets and variable indices of a CSR matrix as passed to
+// _setup_sparse; offsets have to be non-decreasing, indices below variables.
+void checkSparseMatrix(const char* name, const uint64_t* offsets, const uint32_t* indices, const uint8_t* coeffs, int constraints, int variables)
+{
+  if (offsets == nullptr) {
+    throw std::invalid_argument(std::string(name) + ": no offsets");
+  }
+  for (int row = 0; row < constraints; row++) {
+    if (offsets[row] > offsets[row + 1]) {
+      throw std::invalid_argument(std::string(name) + ": offsets decrease at row " + std::to_string(row));
     }
-    for (int idx=0; idx<variables; idx++) {
-      libff::bigint<libff::alt_bn128_r_limbs> value = libsnarkBigintFromBytes(B+row*variables*32 + idx*32);
-      cout << "B entry " << idx << " in row " << row << ": " << value << endl;
-      if (!value.is_zero()) {
-        cout << "B(" << idx << ", " << value << ")" << endl;
-        //lin_comb_B.add_term(idx, value);
-      }
+  }
+  const uint64_t num_terms = offsets[constraints] - offsets[0];
+  if (num_terms > 0 && (indices == nullptr || coeffs == nullptr)) {
+    throw std::invalid_argument(std::string(name) + ": no indices or coefficients");
+  }
+  for (uint64_t k = offsets[0]; k < offsets[constraints]; k++) {
+    if (indices[k] >= (uint32_t) variables) {
+      throw std::invalid_argument(std::string(name) + ": variable index " + std::to_string(indices[k]) +
+                                  " out of range, there are " + std::to_string(variables) + " variables");
     }
-    for (int idx=0; idx<variables; idx++) {
-      libff::bigint<libff::alt_bn128_r_limbs> value = libsnarkBigintFromBytes(C+row*variables*32 + idx*32);
-      // cout << "C entry " << idx << " in row " << row << ": " << value << endl;
-      if (!value.is_zero()) {
-        // cout << "C(" << idx << ", " << value << ")" << endl;
-        //lin_comb_C.add_term(idx, value);
-      }
+  }
+}
+
+// A, B and C given in CSR form: entries offsets[row] .. offsets[row+1]-1 of
+// indices/coeffs belong to row `row`, coefficients are 32 byte big endian.
+// Every term's position is known up front, so the coefficients are converted
+// in parallel straight into the flat store.
+std::unique_ptr<flat_r1cs> flatConstraintSystemFromSparse(
+  const uint64_t* A_offsets, const uint32_t* A_indices, const uint8_t* A_coeffs,
+  const uint64_t* B_offsets, const uint32_t* B_indices, const uint8_t* B_coeffs,
+  const uint64_t* C_offsets, const uint32_t* C_indices, const uint8_t* C_coeffs,
+  int constraints, int variables, int inputs)
+{
+  const uint64_t* offsets[3] = { A_offsets, B_offsets, C_offsets };
+  const uint32_t* indices[3] = { A_indices, B_indices, C_indices };
+  const uint8_t* coeffs[3] = { A_coeffs, B_coeffs, C_coeffs };
+
+  if (constraints < 0 || inputs < 0 || variables < inputs + 1) {
+    throw std::invalid_argument("sparse constraint system: needs 0 <= inputs < variables and constraints >= 0");
+  }
+  checkSparseMatrix("A", A_offsets, A_indices, A_coeffs, constraints, variables);
+  checkSparseMatrix("B", B_offsets, B_indices, B_coeffs, constraints, variables);
+  checkSparseMatrix("C", C_offsets, C_indices, C_coeffs, constraints, variables);
+
+  size_t num_terms[3];
+  for (int m = 0; m < 3; m++) {
+    num_terms[m] = offsets[m][constraints] - offsets[m][0];
+  }
+  std::unique_ptr<flat_r1cs> flat(new flat_r1cs(inputs, variables - inputs - 1, constraints, num_terms)); // ~one not included
+
+  for (int m = 0; m < 3; m++) {
+    const uint64_t base = offsets[m][0];
+    uint64_t* row_offsets = flat->offsets(m);
+    for (int row = 0; row < constraints; row++) {
+      row_offsets[row + 1] = offsets[m][row + 1] - base;
+    }
+
+    flat_term* terms = flat->terms(m);
+    const uint32_t* matrix_indices = indices[m] + base;
+    const uint8_t* matrix_coeffs = coeffs[m] + base * 32;
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+    for (size_t k = 0; k < num_terms[m]; k++) {
+      terms[k].index = matrix_indices[k];
+      terms[k].coeff = libff::alt_bn128_Fr(libsnarkBigintFromBytes(matrix_coeffs + k*32));
     }
-    //cs.add_constraint(r1cs_constraint<libff::alt_bn128_pp>(lin_comb_A, lin_comb_B, lin_comb_C));
   }
-  return cs;
+  return flat;
+}
+
+// same as createConstraintSystem, but A, B and C are given in CSR form so that
+// the work done is proportional to the number of non-zero coefficients.
+r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> createConstraintSystemFromSparse(
+  const uint64_t* A_offsets, const uint32_t* A_indices, const uint8_t* A_coeffs,
+  const uint64_t* B_offsets, const uint32_t* B_indices, const uint8_t* B_coeffs,
+  const uint64_t* C_offsets, const uint32_t* C_indices, const uint8_t* C_coeffs,
+  int constraints, int variables, int inputs)
+{
+  trace_span span("setup/constraint_system");
+  const std::unique_ptr<flat_r1cs> flat = flatConstraintSystemFromSparse(
+    A_offsets, A_indices, A_coeffs,
+    B_offsets, B_indices, B_coeffs,
+    C_offsets, C_indices, C_coeffs,
+    constraints, variables, inputs);
+
+  cout << "num variables: " << variables <<endl;
+  cout << "num constraints: " << constraints <<endl;
+  cout << "num inputs: " << inputs <<endl;
+  cout << "num non-zero entries: " << (A_offsets[constraints] - A_offsets[0]) + (B_offsets[constraints] - B_offsets[0]) + (C_offsets[constraints] - C_offsets[0]) <<endl;
+  return constraintSystemFromFlat(flat->view());
 }
 
 // keypair generateKeypair(constraints)
 r1cs_ppzksnark_keypair<libff::alt_bn128_pp> generateKeypair(const r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> &cs){
+  trace_span span("keygen");
   // from r1cs_ppzksnark.hpp
   return r1cs_ppzksnark_generator<libff::alt_bn128_pp>(cs);
 }
 
 template<typename T>
 void writeToFile(std::string path, T& obj) {
-    std::stringstream ss;
-    ss << obj;
     std::ofstream fh;
     fh.open(path, std::ios::binary);
-    ss.rdbuf()->pubseekpos(0, std::ios_base::out);
-    fh << ss.rdbuf();
+    fh << obj;
     fh.flush();
     fh.close();
 }
 
 template<typename T>
 T loadFromFile(std::string path) {
-    std::stringstream ss;
     std::ifstream fh(path, std::ios::binary);
 
     assert(fh.is_open());
 
-    ss << fh.rdbuf();
-    fh.close();
-
-    ss.rdbuf()->pubseekpos(0, std::ios_base::in);
-
     T obj;
-    ss >> obj;
+    fh >> obj;
 
     return obj;
 }
 
-void serializeProvingKeyToFile(r1cs_ppzksnark_proving_key<libff::alt_bn128_pp> pk, const char* pk_path){
-  writeToFile(pk_path, pk);
+// writes the binary format from pk_binary.hpp, which can be mmap'd by the prover
+void serializeProvingKeyToFile(const r1cs_ppzksnark_proving_key<libff::alt_bn128_pp> &pk, const char* pk_path){
+  trace_span span("pk_serialization");
+  serializeProvingKeyToBinaryFile(pk, pk_path);
 }
 
+// accepts the binary format as well as keys written by libsnark's operator<<
 r1cs_ppzksnark_proving_key<libff::alt_bn128_pp> deserializeProvingKeyFromFile(const char* pk_path){
+  trace_span span("pk_deserialization");
+  if (isBinaryProvingKeyFile(pk_path)) {
+    return mapped_proving_key(pk_path).materialize();
+  }
   return loadFromFile<r1cs_ppzksnark_proving_key<libff::alt_bn128_pp>>(pk_path);
 }
 
-void serializeVerificationKeyToFile(r1cs_ppzksnark_verification_key<libff::alt_bn128_pp> vk, const char* vk_path){
+void serializeVerificationKeyToFile(const r1cs_ppzksnark_verification_key<libff::alt_bn128_pp> &vk, const char* vk_path){
+  trace_span span("vk_serialization");
   std::stringstream ss;
 
-  unsigned icLength = vk.encoded_IC_query.rest.indices.size() + 1;
+  const verification_key_hex hex = verificationKeyAsHex(vk);
+  const size_t icLength = hex.IC.size();
 
-  ss << "\t\tvk.A = " << outputPointG2AffineAsHex(vk.alphaA_g2) << endl;
-  ss << "\t\tvk.B = " << outputPointG1AffineAsHex(vk.alphaB_g1) << endl;
-  ss << "\t\tvk.C = " << outputPointG2AffineAsHex(vk.alphaC_g2) << endl;
-  ss << "\t\tvk.gamma = " << outputPointG2AffineAsHex(vk.gamma_g2) << endl;
-  ss << "\t\tvk.gammaBeta1 = " << outputPointG1AffineAsHex(vk.gamma_beta_g1) << endl;
-  ss << "\t\tvk.gammaBeta2 = " << outputPointG2AffineAsHex(vk.gamma_beta_g2) << endl;
-  ss << "\t\tvk.Z = " << outputPointG2AffineAsHex(vk.rC_Z_g2) << endl;
+  ss << "\t\tvk.A = " << hex.A << endl;
+  ss << "\t\tvk.B = " << hex.B << endl;
+  ss << "\t\tvk.C = " << hex.C << endl;
+  ss << "\t\tvk.gamma = " << hex.gamma << endl;
+  ss << "\t\tvk.gammaBeta1 = " << hex.gammaBeta1 << endl;
+  ss << "\t\tvk.gammaBeta2 = " << hex.gammaBeta2 << endl;
+  ss << "\t\tvk.Z = " << hex.Z << endl;
   ss << "\t\tvk.IC.len() = " << icLength << endl;
-  ss << "\t\tvk.IC[0] = " << outputPointG1AffineAsHex(vk.encoded_IC_query.first) << endl;
-  for (size_t i = 1; i < icLength; ++i)
+  for (size_t i = 0; i < icLength; ++i)
   {
-                  auto vkICi = outputPointG1AffineAsHex(vk.encoded_IC_query.rest.values[i - 1]);
-                  ss << "\t\tvk.IC[" << i << "] = " << vkICi << endl;
+                  ss << "\t\tvk.IC[" << i << "] = " << hex.IC[i] << endl;
   }
 
   std::ofstream fh;
@@ -190,26 +504,29 @@ void serializeVerificationKeyToFile(r1cs_ppzksnark_verification_key<libff::alt_b
   fh << ss.rdbuf();
   fh.flush();
   fh.close();
+
+  // what _load_verification_key reads, the text above cannot be loaded back
+  serializeProcessedVerificationKeyToFile(batch_verification_key(vk), processedVerificationKeyPath(vk_path).c_str());
 }
 
 // compliant with solidty verification example
-void exportVerificationKey(r1cs_ppzksnark_keypair<libff::alt_bn128_pp> keypair){
-        unsigned icLength = keypair.vk.encoded_IC_query.rest.indices.size() + 1;
+void exportVerificationKey(const r1cs_ppzksnark_keypair<libff::alt_bn128_pp> &keypair){
+        trace_span span("export/vk");
+        const verification_key_hex hex = verificationKeyAsHex(keypair.vk);
+        const size_t icLength = hex.IC.size();
 
         cout << "\tVerification key in Solidity compliant format:{" << endl;
-        cout << "\t\tvk.A = Pairing.G2Point(" << outputPointG2AffineAsHex(keypair.vk.alphaA_g2) << ");" << endl;
-        cout << "\t\tvk.B = Pairing.G1Point(" << outputPointG1AffineAsHex(keypair.vk.alphaB_g1) << ");" << endl;
-        cout << "\t\tvk.C = Pairing.G2Point(" << outputPointG2AffineAsHex(keypair.vk.alphaC_g2) << ");" << endl;
-        cout << "\t\tvk.gamma = Pairing.G2Point(" << outputPointG2AffineAsHex(keypair.vk.gamma_g2) << ");" << endl;
-        cout << "\t\tvk.gammaBeta1 = Pairing.G1Point(" << outputPointG1AffineAsHex(keypair.vk.gamma_beta_g1) << ");" << endl;
-        cout << "\t\tvk.gammaBeta2 = Pairing.G2Point(" << outputPointG2AffineAsHex(keypair.vk.gamma_beta_g2) << ");" << endl;
-        cout << "\t\tvk.Z = Pairing.G2Point(" << outputPointG2AffineAsHex(keypair.vk.rC_Z_g2) << ");" << endl;
+        cout << "\t\tvk.A = Pairing.G2Point(" << hex.A << ");" << endl;
+        cout << "\t\tvk.B = Pairing.G1Point(" << hex.B << ");" << endl;
+        cout << "\t\tvk.C = Pairing.G2Point(" << hex.C << ");" << endl;
+        cout << "\t\tvk.gamma = Pairing.G2Point(" << hex.gamma << ");" << endl;
+        cout << "\t\tvk.gammaBeta1 = Pairing.G1Point(" << hex.gammaBeta1 << ");" << endl;
+        cout << "\t\tvk.gammaBeta2 = Pairing.G2Point(" << hex.gammaBeta2 << ");" << endl;
+        cout << "\t\tvk.Z = Pairing.G2Point(" << hex.Z << ");" << endl;
         cout << "\t\tvk.IC = new Pairing.G1Point[](" << icLength << ");" << endl;
-        cout << "\t\tvk.IC[0] = Pairing.G1Point(" << outputPointG1AffineAsHex(keypair.vk.encoded_IC_query.first) << ");" << endl;
-        for (size_t i = 1; i < icLength; ++i)
+        for (size_t i = 0; i < icLength; ++i)
         {
-                auto vkICi = outputPointG1AffineAsHex(keypair.vk.encoded_IC_query.rest.values[i - 1]);
-                cout << "\t\tvk.IC[" << i << "] = Pairing.G1Point(" << vkICi << ");" << endl;
+                cout << "\t\tvk.IC[" << i << "] = Pairing.G1Point(" << hex.IC[i] << ");" << endl;
         }
         cout << "\t\t}" << endl;
 
@@ -227,80 +544,787 @@ void exportInput(r1cs_primary_input<libff::alt_bn128_pp> input){
 } */
 
 
-void printProof(r1cs_ppzksnark_proof<libff::alt_bn128_pp> proof){
+void printProof(const r1cs_ppzksnark_proof<libff::alt_bn128_pp> &proof){
+                trace_span span("export/proof");
+                const proof_hex hex = proofAsHex(proof);
                 cout << "Proof:"<< endl;
-                cout << "proof.A = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_A.g)<< ");" << endl;
-                cout << "proof.A_p = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_A.h)<< ");" << endl;
-                cout << "proof.B = Pairing.G2Point(" << outputPointG2AffineAsHex(proof.g_B.g)<< ");" << endl;
-                cout << "proof.B_p = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_B.h)<<");" << endl;
-                cout << "proof.C = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_C.g)<< ");" << endl;
-                cout << "proof.C_p = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_C.h)<<");" << endl;
-                cout << "proof.H = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_H)<<");"<< endl;
-                cout << "proof.K = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_K)<<");"<< endl;
+                cout << "proof.A = Pairing.G1Point(" << hex.A << ");" << endl;
+                cout << "proof.A_p = Pairing.G1Point(" << hex.A_p << ");" << endl;
+                cout << "proof.B = Pairing.G2Point(" << hex.B << ");" << endl;
+                cout << "proof.B_p = Pairing.G1Point(" << hex.B_p << ");" << endl;
+                cout << "proof.C = Pairing.G1Point(" << hex.C << ");" << endl;
+                cout << "proof.C_p = Pairing.G1Point(" << hex.C_p << ");" << endl;
+                cout << "proof.H = Pairing.G1Point(" << hex.H << ");" << endl;
+                cout << "proof.K = Pairing.G1Point(" << hex.K << ");" << endl;
 }
 
-/*bool _setup(const uint8_t* A, const uint8_t* B, const uint8_t* C, int constraints, int variables, int inputs, const char* pk_path, const char* vk_path)
-{
-  //libsnark::inhibit_profiling_info = true;
-  //libsnark::inhibit_profiling_counters = true;
+void serializeGroth16VerificationKeyToFile(const r1cs_gg_ppzksnark_keypair<libff::alt_bn128_pp> &keypair, const char* vk_path){
+  std::stringstream ss;
 
-  //initialize curve parameters
-  libff::alt_bn128_pp::init_public_params();
+  const groth16_verification_key_hex hex = groth16VerificationKeyAsHex(keypair);
+  const size_t gammaABCLength = hex.gammaABC.size();
+
+  ss << "\t\tvk.alpha = " << hex.alpha << endl;
+  ss << "\t\tvk.beta = " << hex.beta << endl;
+  ss << "\t\tvk.gamma = " << hex.gamma << endl;
+  ss << "\t\tvk.delta = " << hex.delta << endl;
+  ss << "\t\tvk.gammaABC.len() = " << gammaABCLength << endl;
+  for (size_t i = 0; i < gammaABCLength; ++i)
+  {
+                  ss << "\t\tvk.gammaABC[" << i << "] = " << hex.gammaABC[i] << endl;
+  }
+
+  std::ofstream fh;
+  fh.open(vk_path, std::ios::binary);
+  ss.rdbuf()->pubseekpos(0, std::ios_base::out);
+  fh << ss.rdbuf();
+  fh.flush();
+  fh.close();
+}
+
+// compliant with the Groth16 solidity verifier
+void exportGroth16VerificationKey(const r1cs_gg_ppzksnark_keypair<libff::alt_bn128_pp> &keypair){
+        const groth16_verification_key_hex hex = groth16VerificationKeyAsHex(keypair);
+        const size_t gammaABCLength = hex.gammaABC.size();
+
+        cout << "\tVerification key in Solidity compliant format:{" << endl;
+        cout << "\t\tvk.alpha = Pairing.G1Point(" << hex.alpha << ");" << endl;
+        cout << "\t\tvk.beta = Pairing.G2Point(" << hex.beta << ");" << endl;
+        cout << "\t\tvk.gamma = Pairing.G2Point(" << hex.gamma << ");" << endl;
+        cout << "\t\tvk.delta = Pairing.G2Point(" << hex.delta << ");" << endl;
+        cout << "\t\tvk.gammaABC = new Pairing.G1Point[](" << gammaABCLength << ");" << endl;
+        for (size_t i = 0; i < gammaABCLength; ++i)
+        {
+                cout << "\t\tvk.gammaABC[" << i << "] = Pairing.G1Point(" << hex.gammaABC[i] << ");" << endl;
+        }
+        cout << "\t\t}" << endl;
+}
+
+void printGroth16Proof(const r1cs_gg_ppzksnark_proof<libff::alt_bn128_pp> &proof){
+                const groth16_proof_hex hex = groth16ProofAsHex(proof);
+                cout << "Proof:"<< endl;
+                cout << "proof.A = Pairing.G1Point(" << hex.A << ");" << endl;
+                cout << "proof.B = Pairing.G2Point(" << hex.B << ");" << endl;
+                cout << "proof.C = Pairing.G1Point(" << hex.C << ");" << endl;
+}
 
-  r1cs_constraint_system<libff::alt_bn128_pp> cs;
-  cs = createConstraintSystem(A, B ,C , constraints, variables, inputs);
+// generates a keypair for cs, writes pk and vk to disk and prints the solidity vk
+bool setupFromConstraintSystem(const r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> &cs, int constraints, int inputs, const char* pk_path, const char* vk_path)
+{
+  trace_span span("setup");
+  assert(cs.num_variables() >= (size_t) inputs);
+  assert(cs.num_inputs() == (size_t) inputs);
+  assert(cs.num_constraints() == (size_t) constraints);
 
-  assert(cs.num_variables() >= inputs);
-  assert(cs.num_inputs() == inputs);
-  assert(cs.num_constraints() == constraints);
+  // create keypair, or reuse the one generated for the same circuit when
+  // ZOKRATES_KEY_CACHE names a cache directory
+  const char* cache_dir = getenv("ZOKRATES_KEY_CACHE");
+  // with ZOKRATES_OPTIMIZE_R1CS=1 the keys are generated for the optimized
+  // constraint system, the witness map goes next to the proving key
+  const char* optimize = getenv("ZOKRATES_OPTIMIZE_R1CS");
+  r1cs_witness_map witness_map;
+  r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> optimized;
+  const bool use_optimized = optimize != nullptr && strcmp(optimize, "0") != 0;
+  if (use_optimized) {
+    trace_span optimize_span("setup/optimize_r1cs");
+    r1cs_optimization_report report;
+    optimized = optimizeConstraintSystem(cs, witness_map, report);
+    printR1csOptimizationReport(report, cout);
+  }
+  const r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> &setup_cs = use_optimized ? optimized : cs;
 
-  // create keypair
-  r1cs_ppzksnark_keypair<alt_bn128_pp> keypair = r1cs_ppzksnark_generator<alt_bn128_pp>(cs);
+  r1cs_ppzksnark_keypair<libff::alt_bn128_pp> keypair = cache_dir ? keypair_cache(cache_dir).get(setup_cs) : generateKeypair(setup_cs);
 
   // Export vk and pk to files
   serializeProvingKeyToFile(keypair.pk, pk_path);
   serializeVerificationKeyToFile(keypair.vk, vk_path);
+  const std::string map_path = witnessMapPath(pk_path);
+  if (use_optimized) {
+    writeWitnessMap(witness_map, map_path.c_str());
+  } else {
+    // a map left over from an earlier optimized setup would not fit this key
+    std::remove(map_path.c_str());
+  }
 
   // Print VerificationKey in Solidity compatible format
   exportVerificationKey(keypair);
 
   return true;
-}*/
-/*
-bool _generate_proof(const char* pk_path, const uint8_t* public_inputs, int public_inputs_length, const uint8_t* private_inputs, int private_inputs_length)
+}
+
+bool _setup(const uint8_t* A, const uint8_t* B, const uint8_t* C, int constraints, int variables, int inputs, const char* pk_path, const char* vk_path)
 {
-//  libsnark::inhibit_profiling_info = true;
-//  libsnark::inhibit_profiling_counters = true;
+  //libsnark::inhibit_profiling_info = true;
+  //libsnark::inhibit_profiling_counters = true;
 
   //initialize curve parameters
-  libff::alt_bn128_pp::init_public_params();
-  r1cs_ppzksnark_proving_key<libff::alt_bn128_pp> pk = deserializeProvingKeyFromFile(pk_path);
+  initCurveParameters();
+
+  r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> cs = createConstraintSystem(A, B ,C , constraints, variables, inputs);
+
+  return setupFromConstraintSystem(cs, constraints, inputs, pk_path, vk_path);
+}
+
+bool _setup_sparse(const uint64_t* A_offsets, const uint32_t* A_indices, const uint8_t* A_coeffs,
+            const uint64_t* B_offsets, const uint32_t* B_indices, const uint8_t* B_coeffs,
+            const uint64_t* C_offsets, const uint32_t* C_indices, const uint8_t* C_coeffs,
+            int constraints, int variables, int inputs, const char* pk_path, const char* vk_path)
+{
+  try {
+    //initialize curve parameters
+    initCurveParameters();
+
+    r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> cs = createConstraintSystemFromSparse(
+      A_offsets, A_indices, A_coeffs,
+      B_offsets, B_indices, B_coeffs,
+      C_offsets, C_indices, C_coeffs,
+      constraints, variables, inputs);
+
+    return setupFromConstraintSystem(cs, constraints, inputs, pk_path, vk_path);
+  } catch (const std::exception &e) {
+    cerr << "_setup_sparse: " << e.what() << endl;
+    return false;
+  }
+}
+
+bool _setup_from_json(const char* r1cs_path, int variables, const char* pk_path, const char* vk_path)
+{
+  try {
+    initCurveParameters();
+
+    r1cs_ppzksnark_constraint_system<libff::alt_bn128_pp> cs = [&]() {
+      trace_span span("setup/constraint_system");
+      return r1cs_from_json_file<libff::alt_bn128_Fr>(r1cs_path, variables > 0 ? variables - 1 : 0);
+    }();
+    cout << "num variables: " << cs.num_variables() + 1 <<endl;
+    cout << "num constraints: " << cs.num_constraints() <<endl;
+    cout << "num inputs: " << cs.num_inputs() <<endl;
+
+    return setupFromConstraintSystem(cs, cs.num_constraints(), cs.num_inputs(), pk_path, vk_path);
+  } catch (const std::exception &e) {
+    cerr << "_setup_from_json: " << e.what() << endl;
+    return false;
+  }
+}
+
+// Groth16 counterpart of setupFromConstraintSystem. The proving key is
+// written with libsnark's operator<<, the binary format is ppzksnark only.
+bool setupGroth16FromConstraintSystem(const r1cs_gg_ppzksnark_constraint_system<libff::alt_bn128_pp> &cs, int constraints, int inputs, const char* pk_path, const char* vk_path)
+{
+  trace_span span("groth16/setup");
+  assert(cs.num_variables() >= (size_t) inputs);
+  assert(cs.num_inputs() == (size_t) inputs);
+  assert(cs.num_constraints() == (size_t) constraints);
+
+  r1cs_gg_ppzksnark_keypair<libff::alt_bn128_pp> keypair = [&]() {
+    trace_span keygen_span("groth16/keygen");
+    return r1cs_gg_ppzksnark_generator<libff::alt_bn128_pp>(cs);
+  }();
+
+  writeToFile(pk_path, keypair.pk);
+  serializeGroth16VerificationKeyToFile(keypair, vk_path);
+
+  exportGroth16VerificationKey(keypair);
+
+  return true;
+}
+
+bool _groth16_setup(const uint8_t* A, const uint8_t* B, const uint8_t* C, int constraints, int variables, int inputs, const char* pk_path, const char* vk_path)
+{
+  initCurveParameters();
+
+  r1cs_gg_ppzksnark_constraint_system<libff::alt_bn128_pp> cs = createConstraintSystem(A, B ,C , constraints, variables, inputs);
+
+  return setupGroth16FromConstraintSystem(cs, constraints, inputs, pk_path, vk_path);
+}
+
+bool _groth16_setup_sparse(const uint64_t* A_offsets, const uint32_t* A_indices, const uint8_t* A_coeffs,
+            const uint64_t* B_offsets, const uint32_t* B_indices, const uint8_t* B_coeffs,
+            const uint64_t* C_offsets, const uint32_t* C_indices, const uint8_t* C_coeffs,
+            int constraints, int variables, int inputs, const char* pk_path, const char* vk_path)
+{
+  try {
+    initCurveParameters();
 
-  // assign variables based on witness values, excludes ~one
-  r1cs_variable_assignment<libff::alt_bn128_pp> full_variable_assignment;
-  for (int i = 1; i < public_inputs_length; i++) {
-    full_variable_assignment.push_back(libff::alt_bn128_pp(libsnarkBigintFromBytes(public_inputs + i*32)));
+    r1cs_gg_ppzksnark_constraint_system<libff::alt_bn128_pp> cs = createConstraintSystemFromSparse(
+      A_offsets, A_indices, A_coeffs,
+      B_offsets, B_indices, B_coeffs,
+      C_offsets, C_indices, C_coeffs,
+      constraints, variables, inputs);
+
+    return setupGroth16FromConstraintSystem(cs, constraints, inputs, pk_path, vk_path);
+  } catch (const std::exception &e) {
+    cerr << "_groth16_setup_sparse: " << e.what() << endl;
+    return false;
+  }
+}
+
+// A proving key kept resident between proofs. Binary keys are mapped and
+// used in place, keys in libsnark's text format are deserialized once.
+// Fixed-base tables are picked up when <pk_path>.tables exists. Keys loaded
+// with a memory budget are streamed from disk for every proof instead, their
+// view only carries the sizes, indices and flat constraint system. When the key
+// was set up for an optimized constraint system, <pk_path>.wmap translates
+// witnesses of the original one. Binary keys get their QAP domain built
+// once, or mapped from <pk_path>.domain, and shared by all their proofs.
+struct proving_key_handle {
+  std::unique_ptr<mapped_proving_key> mapped;
+  std::unique_ptr<mapped_proving_key_tables> tables;
+  std::unique_ptr<streamed_proving_key> streamed;
+  std::unique_ptr<r1cs_witness_map> witness_map;
+  std::unique_ptr<mapped_proving_key_domain> mapped_domain;
+  std::unique_ptr<qap_domain> domain;
+  r1cs_ppzksnark_proving_key<libff::alt_bn128_pp> pk;
+  proving_key_view view;
+
+  // constraintSystemDigest of the key, computed on first use; the same as
+  // the key cache's hash of the circuit the key was set up for
+  const uint8_t* circuitId() const
+  {
+    std::call_once(circuit_id_once, [this] {
+      if (view.flat_constraints) {
+        constraintSystemDigest(*view.flat_constraints, circuit_id);
+      } else {
+        constraintSystemDigest(*view.constraint_system, circuit_id);
+      }
+    });
+    return circuit_id;
+  }
+
+private:
+  mutable std::once_flag circuit_id_once;
+  mutable uint8_t circuit_id[sha256_hasher::digest_size];
+};
+
+void loadWitnessMap(proving_key_handle* handle, const char* pk_path)
+{
+  const std::string map_path = witnessMapPath(pk_path);
+  if (access(map_path.c_str(), R_OK) != 0) {
+    return;
+  }
+  handle->witness_map.reset(new r1cs_witness_map(readWitnessMap(map_path.c_str())));
+  if (handle->witness_map->num_inputs != handle->view.num_inputs() || handle->witness_map->num_variables() != handle->view.num_variables()) {
+    throw std::runtime_error(map_path + " does not belong to " + pk_path);
+  }
+}
+
+// for keys with flat constraints, i.e. binary ones
+void loadQapDomain(proving_key_handle* handle, const char* pk_path, uint64_t pk_header_checksum)
+{
+  const size_t min_size = handle->view.flat_constraints->domainMinSize();
+  const std::string domain_path = provingKeyDomainPath(pk_path);
+  if (access(domain_path.c_str(), R_OK) == 0) {
+    try {
+      handle->mapped_domain.reset(new mapped_proving_key_domain(domain_path.c_str(), min_size, pk_header_checksum));
+      handle->view.domain = &handle->mapped_domain->domain();
+    } catch (const std::exception &e) {
+      cerr << "ignoring " << domain_path << ": " << e.what() << endl;
+    }
+  }
+  if (!handle->view.domain) {
+    handle->domain.reset(new qap_domain(min_size));
+    handle->view.domain = handle->domain.get();
+  }
+  // the H multi-exponentiation takes one point per coefficient of H
+  if (handle->view.H_query.size != handle->view.domain->m + 1) {
+    throw std::runtime_error(std::string(pk_path) + ": H query size does not match the QAP domain");
+  }
+}
+
+proving_key_handle* loadProvingKeyHandle(const char* pk_path)
+{
+  trace_span span("pk_load");
+  initCurveParameters();
+
+  std::unique_ptr<proving_key_handle> handle(new proving_key_handle());
+  if (isBinaryProvingKeyFile(pk_path)) {
+    handle->mapped.reset(new mapped_proving_key(pk_path));
+    const std::string tables_path = provingKeyTablesPath(pk_path);
+    if (access(tables_path.c_str(), R_OK) == 0) {
+      try {
+        handle->tables.reset(new mapped_proving_key_tables(tables_path.c_str(), *handle->mapped));
+        handle->mapped->attachTables(&handle->tables->tables());
+      } catch (const std::exception &e) {
+        cerr << "ignoring " << tables_path << ": " << e.what() << endl;
+      }
+    }
+    handle->view = handle->mapped->view();
+    loadQapDomain(handle.get(), pk_path, handle->mapped->headerChecksum());
+  } else {
+    handle->pk = loadFromFile<r1cs_ppzksnark_proving_key<libff::alt_bn128_pp>>(pk_path);
+    handle->view = viewOfProvingKey(handle->pk);
   }
-  for (int i = 0; i < private_inputs_length; i++) {
-    full_variable_assignment.push_back(<libff::alt_bn128_pp>(libsnarkBigintFromBytes(private_inputs + i*32)));
+  loadWitnessMap(handle.get(), pk_path);
+  return handle.release();
+}
+
+proving_key_handle* loadStreamedProvingKeyHandle(const char* pk_path, size_t memory_budget)
+{
+  trace_span span("pk_load");
+  initCurveParameters();
+
+  if (!isBinaryProvingKeyFile(pk_path)) {
+    throw std::invalid_argument(std::string(pk_path) + " is not a binary proving key, streaming needs one");
   }
+  std::unique_ptr<proving_key_handle> handle(new proving_key_handle());
+  handle->streamed.reset(new streamed_proving_key(pk_path, memory_budget));
+  handle->view = handle->streamed->view();
+  loadQapDomain(handle.get(), pk_path, handle->streamed->headerChecksum());
+  loadWitnessMap(handle.get(), pk_path);
+  return handle.release();
+}
 
+// assign variables based on witness values. public_inputs starts with ~one, which is skipped.
+void witnessFromBytes(const uint8_t* public_inputs, int public_inputs_length, const uint8_t* private_inputs, int private_inputs_length,
+                      r1cs_primary_input<libff::alt_bn128_Fr> &primary_input, r1cs_auxiliary_input<libff::alt_bn128_Fr> &auxiliary_input)
+{
+  trace_span span("witness");
   // split up variables into primary and auxiliary inputs. Does *NOT* include the constant 1
   // Public variables belong to primary input, private variables are auxiliary input.
-  r1cs_primary_input<libff::alt_bn128_pp> primary_input(full_variable_assignment.begin(), full_variable_assignment.begin() + public_inputs_length-1);
-  r1cs_primary_input<libff::alt_bn128_pp> auxiliary_input(full_variable_assignment.begin() + public_inputs_length-1, full_variable_assignment.end());
+  fieldsFromBytes(public_inputs + 32, std::max(public_inputs_length - 1, 0), primary_input);
+  fieldsFromBytes(private_inputs, std::max(private_inputs_length, 0), auxiliary_input);
+}
+
+// the witness is given for the original constraint system when the key has a witness map
+void checkWitnessSize(const proving_key_handle* handle, int public_inputs_length, int private_inputs_length)
+{
+  const size_t num_variables = handle->witness_map ? handle->witness_map->old_num_variables : handle->view.num_variables();
+  if (public_inputs_length < 1 ||
+      size_t(public_inputs_length - 1) != handle->view.num_inputs() ||
+      size_t(public_inputs_length - 1 + private_inputs_length) != num_variables) {
+    throw std::invalid_argument("witness does not match the proving key's constraint system");
+  }
+}
+
+// A witness of the original constraint system, translated to the key's
+// optimized one. It has to satisfy the linear constraints the optimizer
+// substituted away, which the key's constraint system no longer checks.
+void reduceWitness(const r1cs_witness_map &map, const r1cs_primary_input<libff::alt_bn128_Fr> &primary_input,
+                   r1cs_auxiliary_input<libff::alt_bn128_Fr> &auxiliary_input)
+{
+  const r1cs_check_result<libff::alt_bn128_Fr> result = map.checkSubstituted(primary_input, auxiliary_input, 1, 1);
+  if (!result.satisfied) {
+    throw std::invalid_argument("witness does not satisfy the original constraint system" +
+                                (result.failures.empty() ? ": " + result.error
+                                                         : " (substituted linear constraint " + std::to_string(result.failures[0].index) + ")"));
+  }
+  auxiliary_input = map.reduce(primary_input, auxiliary_input);
+}
+
+// checked and parsed witness, translated to the key's constraint system
+void witnessForHandle(const proving_key_handle* handle, const uint8_t* public_inputs, int public_inputs_length, const uint8_t* private_inputs, int private_inputs_length,
+                      r1cs_primary_input<libff::alt_bn128_Fr> &primary_input, r1cs_auxiliary_input<libff::alt_bn128_Fr> &auxiliary_input)
+{
+  checkWitnessSize(handle, public_inputs_length, private_inputs_length);
+  witnessFromBytes(public_inputs, public_inputs_length, private_inputs, private_inputs_length, primary_input, auxiliary_input);
+  if (handle->witness_map) {
+    reduceWitness(*handle->witness_map, primary_input, auxiliary_input);
+  }
+}
+
+r1cs_ppzksnark_proof<libff::alt_bn128_pp> proveWithHandle(const proving_key_handle* handle,
+                                                          const r1cs_primary_input<libff::alt_bn128_Fr> &primary_input,
+                                                          const r1cs_auxiliary_input<libff::alt_bn128_Fr> &auxiliary_input)
+{
+  if (handle->streamed) {
+    return proveStreamed(*handle->streamed, primary_input, auxiliary_input);
+  }
+  return proveWithKeyView(handle->view, primary_input, auxiliary_input);
+}
+
+r1cs_ppzksnark_proof<libff::alt_bn128_pp> proveWithHandle(const proving_key_handle* handle, const uint8_t* public_inputs, int public_inputs_length, const uint8_t* private_inputs, int private_inputs_length)
+{
+  r1cs_primary_input<libff::alt_bn128_Fr> primary_input;
+  r1cs_auxiliary_input<libff::alt_bn128_Fr> auxiliary_input;
+  witnessForHandle(handle, public_inputs, public_inputs_length, private_inputs, private_inputs_length, primary_input, auxiliary_input);
+
+  return proveWithHandle(handle, primary_input, auxiliary_input);
+}
+
+// A, A_p, B, B_p, C, C_p, H, K as affine big endian coordinates
+void writeProofAsBytes(const r1cs_ppzksnark_proof<libff::alt_bn128_pp> &proof, uint8_t* out)
+{
+  trace_span span("export/proof");
+  writePointG1AffineAsBytes(proof.g_A.g, out);
+  writePointG1AffineAsBytes(proof.g_A.h, out + 64);
+  writePointG2AffineAsBytes(proof.g_B.g, out + 128);
+  writePointG1AffineAsBytes(proof.g_B.h, out + 256);
+  writePointG1AffineAsBytes(proof.g_C.g, out + 320);
+  writePointG1AffineAsBytes(proof.g_C.h, out + 384);
+  writePointG1AffineAsBytes(proof.g_H, out + 448);
+  writePointG1AffineAsBytes(proof.g_K, out + 512);
+}
+
+// inverse of writePointG1AffineAsBytes; (0, 1) is the point at infinity
+libff::alt_bn128_G1 readPointG1AffineFromBytes(const uint8_t* in)
+{
+  const libff::alt_bn128_Fq x = fieldFromBytes<libff::alt_bn128_Fq>(in);
+  const libff::alt_bn128_Fq y = fieldFromBytes<libff::alt_bn128_Fq>(in + 32);
+  if (x.is_zero() && y == libff::alt_bn128_Fq::one()) {
+    return libff::alt_bn128_G1::zero();
+  }
+  return libff::alt_bn128_G1(x, y, libff::alt_bn128_Fq::one());
+}
+
+// inverse of writePointG2AffineAsBytes. Unlike G1, G2 has points on the curve
+// outside the prime order subgroup, those are rejected.
+libff::alt_bn128_G2 readPointG2AffineFromBytes(const uint8_t* in)
+{
+  const libff::alt_bn128_Fq2 x(fieldFromBytes<libff::alt_bn128_Fq>(in + 32), fieldFromBytes<libff::alt_bn128_Fq>(in));
+  const libff::alt_bn128_Fq2 y(fieldFromBytes<libff::alt_bn128_Fq>(in + 96), fieldFromBytes<libff::alt_bn128_Fq>(in + 64));
+  if (x.is_zero() && y == libff::alt_bn128_Fq2::one()) {
+    return libff::alt_bn128_G2::zero();
+  }
+  const libff::alt_bn128_G2 p(x, y, libff::alt_bn128_Fq2::one());
+  if (!p.is_well_formed() || !(libff::alt_bn128_modulus_r * p).is_zero()) {
+    throw std::invalid_argument("proof: G2 point not in the prime order subgroup");
+  }
+  return p;
+}
+
+// inverse of writeProofAsBytes; points off the curve are caught by is_well_formed
+r1cs_ppzksnark_proof<libff::alt_bn128_pp> readProofFromBytes(const uint8_t* in)
+{
+  r1cs_ppzksnark_proof<libff::alt_bn128_pp> proof;
+  proof.g_A.g = readPointG1AffineFromBytes(in);
+  proof.g_A.h = readPointG1AffineFromBytes(in + 64);
+  proof.g_B.g = readPointG2AffineFromBytes(in + 128);
+  proof.g_B.h = readPointG1AffineFromBytes(in + 256);
+  proof.g_C.g = readPointG1AffineFromBytes(in + 320);
+  proof.g_C.h = readPointG1AffineFromBytes(in + 384);
+  proof.g_H = readPointG1AffineFromBytes(in + 448);
+  proof.g_K = readPointG1AffineFromBytes(in + 512);
+  return proof;
+}
+
+void* _load_proving_key(const char* pk_path)
+{
+  try {
+    return loadProvingKeyHandle(pk_path);
+  } catch (const std::exception &e) {
+    cerr << "_load_proving_key: " << e.what() << endl;
+    return nullptr;
+  }
+}
+
+void* _load_proving_key_with_budget(const char* pk_path, int64_t memory_budget)
+{
+  if (memory_budget <= 0) {
+    return nullptr;
+  }
+  try {
+    return loadStreamedProvingKeyHandle(pk_path, memory_budget);
+  } catch (const std::exception &e) {
+    cerr << "_load_proving_key_with_budget: " << e.what() << endl;
+    return nullptr;
+  }
+}
+
+bool _precompute_proving_key(const char* pk_path, int num_shifts)
+{
+  try {
+    initCurveParameters();
+    const mapped_proving_key pk(pk_path, true);
+    const std::string tables_path = provingKeyTablesPath(pk_path);
+    const std::string tmp_path = tables_path + ".tmp" + std::to_string(getpid());
+    writeProvingKeyTables(pk, tmp_path.c_str(), num_shifts);
+    if (std::rename(tmp_path.c_str(), tables_path.c_str()) != 0) {
+      throw std::runtime_error("cannot move tables to " + tables_path);
+    }
+
+    const size_t min_size = pk.view().flat_constraints->domainMinSize();
+    const std::string domain_path = provingKeyDomainPath(pk_path);
+    const std::string domain_tmp_path = domain_path + ".tmp" + std::to_string(getpid());
+    if (writeProvingKeyDomain(qap_domain(min_size), min_size, pk.headerChecksum(), domain_tmp_path.c_str())) {
+      if (std::rename(domain_tmp_path.c_str(), domain_path.c_str()) != 0) {
+        throw std::runtime_error("cannot move the domain to " + domain_path);
+      }
+    }
+    return true;
+  } catch (const std::exception &e) {
+    cerr << "_precompute_proving_key: " << e.what() << endl;
+    return false;
+  }
+}
+
+bool _prove(const void* key, const uint8_t* public_inputs, int public_inputs_length, const uint8_t* private_inputs, int private_inputs_length, uint8_t* proof, int proof_length)
+{
+  if (key == nullptr || proof_length < PPZKSNARK_PROOF_SIZE) {
+    return false;
+  }
+
+  try {
+    applyProverThreads();
+    const proving_key_handle* handle = static_cast<const proving_key_handle*>(key);
+    writeProofAsBytes(proveWithHandle(handle, public_inputs, public_inputs_length, private_inputs, private_inputs_length), proof);
+    return true;
+  } catch (const std::exception &e) {
+    cerr << "_prove: " << e.what() << endl;
+    return false;
+  }
+}
+
+bool _check_witness(const void* key, const uint8_t* public_inputs, int public_inputs_length, const uint8_t* private_inputs, int private_inputs_length)
+{
+  if (key == nullptr) {
+    return false;
+  }
+
+  try {
+    applyProverThreads();
+    const proving_key_handle* handle = static_cast<const proving_key_handle*>(key);
+    r1cs_primary_input<libff::alt_bn128_Fr> primary_input;
+    r1cs_auxiliary_input<libff::alt_bn128_Fr> auxiliary_input;
+    checkWitnessSize(handle, public_inputs_length, private_inputs_length);
+    witnessFromBytes(public_inputs, public_inputs_length, private_inputs, private_inputs_length, primary_input, auxiliary_input);
+
+    // with an optimized key, the original witness first has to satisfy the
+    // substituted linear constraints; failures are numbered among those
+    if (handle->witness_map) {
+      const r1cs_check_result<libff::alt_bn128_Fr> result = handle->witness_map->checkSubstituted(primary_input, auxiliary_input);
+      if (!result.satisfied) {
+        cerr << "_check_witness: substituted linear constraints of the original system fail" << endl;
+        printR1csCheckResult(result, cerr);
+        return false;
+      }
+      auxiliary_input = handle->witness_map->reduce(primary_input, auxiliary_input);
+    }
+
+    const r1cs_check_result<libff::alt_bn128_Fr> result = handle->view.flat_constraints ?
+      checkR1csSatisfied(*handle->view.flat_constraints, primary_input, auxiliary_input) :
+      checkR1csSatisfied(*handle->view.constraint_system, primary_input, auxiliary_input);
+    if (!result.satisfied) {
+      printR1csCheckResult(result, cerr);
+    }
+    return result.satisfied;
+  } catch (const std::exception &e) {
+    cerr << "_check_witness: " << e.what() << endl;
+    return false;
+  }
+}
+
+bool _prove_batch(const void* key, int count, const uint8_t* public_inputs, int public_inputs_length, const uint8_t* private_inputs, int private_inputs_length, uint8_t* proofs, int64_t proofs_length, int num_threads)
+{
+  if (key == nullptr || count < 0 || num_threads < 0 || proofs_length < int64_t(count) * PPZKSNARK_PROOF_SIZE) {
+    return false;
+  }
+
+  try {
+    applyProverThreads();
+    const proving_key_handle* handle = static_cast<const proving_key_handle*>(key);
+    checkWitnessSize(handle, public_inputs_length, private_inputs_length);
+
+    std::vector<prover_witness> witnesses(count);
+    for (int i = 0; i < count; i++) {
+      witnessForHandle(handle, public_inputs + size_t(i) * public_inputs_length * 32, public_inputs_length,
+                       private_inputs + size_t(i) * private_inputs_length * 32, private_inputs_length,
+                       witnesses[i].primary_input, witnesses[i].auxiliary_input);
+    }
+
+    // streamed keys prove one witness at a time, to stay within the budget
+    std::vector<r1cs_ppzksnark_proof<libff::alt_bn128_pp>> batch;
+    if (handle->streamed) {
+      for (const prover_witness &w : witnesses) {
+        batch.push_back(proveWithHandle(handle, w.primary_input, w.auxiliary_input));
+      }
+    } else {
+      batch = proveBatch(handle->view, witnesses, num_threads);
+    }
+    for (int i = 0; i < count; i++) {
+      writeProofAsBytes(batch[i], proofs + size_t(i) * PPZKSNARK_PROOF_SIZE);
+    }
+    return true;
+  } catch (const std::exception &e) {
+    cerr << "_prove_batch: " << e.what() << endl;
+    return false;
+  }
+}
+
+int64_t _prove_bundle(const void* key, const uint8_t* public_inputs, int public_inputs_length, const uint8_t* private_inputs, int private_inputs_length, uint8_t* bundle, int64_t bundle_length)
+{
+  if (key == nullptr || public_inputs_length < 1 || bundle_length < int64_t(proofBundleSize(public_inputs_length - 1))) {
+    return -1;
+  }
+
+  try {
+    applyProverThreads();
+    const proving_key_handle* handle = static_cast<const proving_key_handle*>(key);
+    r1cs_primary_input<libff::alt_bn128_Fr> primary_input;
+    r1cs_auxiliary_input<libff::alt_bn128_Fr> auxiliary_input;
+    witnessForHandle(handle, public_inputs, public_inputs_length, private_inputs, private_inputs_length, primary_input, auxiliary_input);
+
+    const r1cs_ppzksnark_proof<libff::alt_bn128_pp> proof = proveWithHandle(handle, primary_input, auxiliary_input);
+    encodeProofBundle(proof, primary_input, handle->circuitId(), bundle);
+    return proofBundleSize(primary_input.size());
+  } catch (const std::exception &e) {
+    cerr << "_prove_bundle: " << e.what() << endl;
+    return -1;
+  }
+}
+
+bool _proof_bundle_to_json(const uint8_t* bundle, int64_t bundle_length, const char* json_path)
+{
+  try {
+    initCurveParameters();
+    const proof_bundle decoded = decodeProofBundle(bundle, bundle_length);
+
+    std::ofstream fh(json_path, std::ios::binary);
+    fh << proofAsJson(decoded.proof, decoded.primary_input);
+    fh.flush();
+    if (!fh) {
+      throw std::runtime_error(std::string("error writing ") + json_path);
+    }
+    return true;
+  } catch (const std::exception &e) {
+    cerr << "_proof_bundle_to_json: " << e.what() << endl;
+    return false;
+  }
+}
+
+// accepts the .pvk file itself or the vk_path given to _setup. Goes through
+// initCurveParameters like the proving key loaders, so the profiling
+// counters are off before the first _verify.
+void* _load_verification_key(const char* vk_path)
+{
+  try {
+    trace_span span("vk_load");
+    initCurveParameters();
+    const std::string path = isBinaryVerificationKeyFile(vk_path) ? std::string(vk_path) : processedVerificationKeyPath(vk_path);
+    return new batch_verification_key(readProcessedVerificationKeyFile(path.c_str()));
+  } catch (const std::exception &e) {
+    cerr << "_load_verification_key: " << e.what() << endl;
+    return nullptr;
+  }
+}
+
+bool _verify(const void* vk, const uint8_t* proof, int proof_length, const uint8_t* inputs, int inputs_length)
+{
+  if (vk == nullptr || proof_length < PPZKSNARK_PROOF_SIZE || inputs_length < 0) {
+    return false;
+  }
+
+  try {
+    trace_span span("verify");
+    const batch_verification_key* bvk = static_cast<const batch_verification_key*>(vk);
+    if (size_t(inputs_length) != bvk->pvk.encoded_IC_query.domain_size()) {
+      throw std::invalid_argument("number of inputs does not match the verification key");
+    }
+    r1cs_primary_input<libff::alt_bn128_Fr> primary_input;
+    primary_input.reserve(inputs_length);
+    for (int i = 0; i < inputs_length; i++) {
+      primary_input.emplace_back(fieldFromBytes<libff::alt_bn128_Fr>(inputs + i*32));
+    }
+    const r1cs_ppzksnark_proof<libff::alt_bn128_pp> decoded = readProofFromBytes(proof);
+    return r1cs_ppzksnark_online_verifier_strong_IC<libff::alt_bn128_pp>(bvk->pvk, primary_input, decoded);
+  } catch (const std::exception &e) {
+    cerr << "_verify: " << e.what() << endl;
+    return false;
+  }
+}
+
+void _free_verification_key(void* vk)
+{
+  delete static_cast<batch_verification_key*>(vk);
+}
 
-  // for debugging
-  // cout << "full variable assignment:"<< endl << full_variable_assignment;
-  // cout << "primary input:"<< endl << primary_input;
-  // cout << "auxiliary input:"<< endl << auxiliary_input;
+void _set_num_threads(int num_threads)
+{
+  setProverThreads(num_threads > 0 ? num_threads : 0);
+}
 
-  // Proof Generation
-  r1cs_ppzksnark_proof<alt_bn128_pp> proof = r1cs_ppzksnark_prover<alt_bn128_pp>(pk, primary_input, auxiliary_input);
+int _get_num_threads()
+{
+  return proverThreads();
+}
 
-  // print proof
-  printProof(proof);
-  // TODO? print inputs
+void _free_key(void* key)
+{
+  delete static_cast<proving_key_handle*>(key);
+}
+
+bool _generate_proof(const char* pk_path, const uint8_t* public_inputs, int public_inputs_length, const uint8_t* private_inputs, int private_inputs_length)
+{
+//  libsnark::inhibit_profiling_info = true;
+//  libsnark::inhibit_profiling_counters = true;
+
+  try {
+    std::unique_ptr<proving_key_handle> handle(loadProvingKeyHandle(pk_path));
+
+    // Proof Generation
+    r1cs_ppzksnark_proof<libff::alt_bn128_pp> proof = proveWithHandle(handle.get(), public_inputs, public_inputs_length, private_inputs, private_inputs_length);
+
+    // print proof
+    printProof(proof);
+    // TODO? print inputs
+  } catch (const std::exception &e) {
+    cerr << "_generate_proof: " << e.what() << endl;
+    return false;
+  }
 
   return true;
-} */
+}
+
+bool _generate_proof_from_json(const char* pk_path, const char* tests_path)
+{
+  try {
+    std::unique_ptr<proving_key_handle> handle(loadProvingKeyHandle(pk_path));
+    const size_t num_inputs = handle->view.num_inputs();
+
+    r1cs_variable_assignment<libff::alt_bn128_Fr> assignment = [&]() {
+      trace_span span("witness");
+      return array_from_json_file<libff::alt_bn128_Fr>(tests_path);
+    }();
+    const size_t num_variables = handle->witness_map ? handle->witness_map->old_num_variables : handle->view.num_variables();
+    if (assignment.size() != num_variables) {
+      throw std::invalid_argument("witness does not match the proving key's constraint system");
+    }
+    const r1cs_primary_input<libff::alt_bn128_Fr> primary_input(assignment.begin(), assignment.begin() + num_inputs);
+    r1cs_auxiliary_input<libff::alt_bn128_Fr> auxiliary_input(assignment.begin() + num_inputs, assignment.end());
+    if (handle->witness_map) {
+      reduceWitness(*handle->witness_map, primary_input, auxiliary_input);
+    }
+
+    printProof(proveWithHandle(handle.get(), primary_input, auxiliary_input));
+  } catch (const std::exception &e) {
+    cerr << "_generate_proof_from_json: " << e.what() << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool _groth16_generate_proof(const char* pk_path, const uint8_t* public_inputs, int public_inputs_length, const uint8_t* private_inputs, int private_inputs_length)
+{
+  try {
+    initCurveParameters();
+    const r1cs_gg_ppzksnark_proving_key<libff::alt_bn128_pp> pk = loadFromFile<r1cs_gg_ppzksnark_proving_key<libff::alt_bn128_pp>>(pk_path);
+
+    const r1cs_gg_ppzksnark_constraint_system<libff::alt_bn128_pp> &cs = pk.constraint_system;
+    if (public_inputs_length < 1 ||
+        size_t(public_inputs_length - 1) != cs.num_inputs() ||
+        size_t(public_inputs_length - 1 + private_inputs_length) != cs.num_variables()) {
+      throw std::invalid_argument("witness does not match the proving key's constraint system");
+    }
+
+    r1cs_primary_input<libff::alt_bn128_Fr> primary_input;
+    r1cs_auxiliary_input<libff::alt_bn128_Fr> auxiliary_input;
+    witnessFromBytes(public_inputs, public_inputs_length, private_inputs, private_inputs_length, primary_input, auxiliary_input);
+
+    r1cs_gg_ppzksnark_proof<libff::alt_bn128_pp> proof = [&]() {
+      trace_span span("groth16/prove");
+      return r1cs_gg_ppzksnark_prover<libff::alt_bn128_pp>(pk, primary_input, auxiliary_input);
+    }();
+
+    printGroth16Proof(proof);
+  } catch (const std::exception &e) {
+    cerr << "_groth16_generate_proof: " << e.what() << endl;
+    return false;
+  }
+
+  return true;
+}
+
+void _flush_trace()
+{
+  trace_recorder::instance().flush();
+}
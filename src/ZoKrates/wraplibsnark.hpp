@@ -12,6 +12,15 @@ extern "C" {
 #include <stdbool.h>
 #include <stdint.h>
 
+// If the environment variable ZOKRATES_KEY_CACHE names a directory, keypairs
+// are looked up there by constraint system hash and only generated on a miss.
+// With ZOKRATES_OPTIMIZE_R1CS=1 the keys are generated for an optimized
+// constraint system (see r1cs_optimizer.hpp) and <pk_path>.wmap is written;
+// the prover then checks witnesses of the original system against the
+// linear constraints that were substituted away and translates them by
+// itself. The verification key is that of the optimized system, so it
+// differs from the one a plain setup writes.
+// Next to vk_path, <vk_path>.pvk is written for _load_verification_key.
 bool _setup(const uint8_t* A,
             const uint8_t* B,
             const uint8_t* C,
@@ -22,6 +31,27 @@ bool _setup(const uint8_t* A,
             const char* vk_path
           );
 
+// Like _setup, but A, B and C are passed in CSR form: for each matrix, row i
+// consists of the entries offsets[i] .. offsets[i+1]-1 of indices (variable
+// index, ~one is 0) and coeffs (32 byte big endian each). offsets has
+// constraints+1 non-decreasing entries. Returns false without writing keys
+// if an offset decreases or an index is not below variables.
+bool _setup_sparse(const uint64_t* A_offsets, const uint32_t* A_indices, const uint8_t* A_coeffs,
+            const uint64_t* B_offsets, const uint32_t* B_indices, const uint8_t* B_coeffs,
+            const uint64_t* C_offsets, const uint32_t* C_indices, const uint8_t* C_coeffs,
+            int constraints,
+            int variables,
+            int inputs,
+            const char* pk_path,
+            const char* vk_path
+          );
+
+// Like _setup, with the constraint system read from an r1cs.json file as
+// written by r1cs_to_json, which records the number of inputs. variables
+// counts ~one like in _setup; 0 takes the highest variable index used by a
+// constraint.
+bool _setup_from_json(const char* r1cs_path, int variables, const char* pk_path, const char* vk_path);
+
 bool _generate_proof(const char* pk_path,
             const uint8_t* public_inputs,
             int public_inputs_length,
@@ -29,6 +59,160 @@ bool _generate_proof(const char* pk_path,
             int private_inputs_length
           );
 
+// Like _generate_proof, with the full assignment (without ~one) read from a
+// tests.json file as written by array_to_json.
+bool _generate_proof_from_json(const char* pk_path, const char* tests_path);
+
+// Groth16 (r1cs_gg_ppzksnark) variants of _setup, _setup_sparse and
+// _generate_proof. The verification key printed and written to vk_path has
+// alpha, beta, gamma, delta and gammaABC; proofs consist of A, B and C. The
+// proving key is stored in libsnark's text format, the key cache and the
+// _load_proving_key family are ppzksnark only.
+bool _groth16_setup(const uint8_t* A,
+            const uint8_t* B,
+            const uint8_t* C,
+            int constraints,
+            int variables,
+            int inputs,
+            const char* pk_path,
+            const char* vk_path
+          );
+
+bool _groth16_setup_sparse(const uint64_t* A_offsets, const uint32_t* A_indices, const uint8_t* A_coeffs,
+            const uint64_t* B_offsets, const uint32_t* B_indices, const uint8_t* B_coeffs,
+            const uint64_t* C_offsets, const uint32_t* C_indices, const uint8_t* C_coeffs,
+            int constraints,
+            int variables,
+            int inputs,
+            const char* pk_path,
+            const char* vk_path
+          );
+
+bool _groth16_generate_proof(const char* pk_path,
+            const uint8_t* public_inputs,
+            int public_inputs_length,
+            const uint8_t* private_inputs,
+            int private_inputs_length
+          );
+
+// Size of a proof written by _prove: A, A_p, B, B_p, C, C_p, H, K as affine
+// big endian coordinates, 32 bytes each (B is in G2 and takes 4 of them).
+#define PPZKSNARK_PROOF_SIZE 576
+
+// Loads the proving key once and keeps it, together with the curve
+// parameters, resident behind the returned handle. Binary keys are mmap'd.
+// Returns NULL on failure. Release with _free_key.
+// Fixed-base tables in <pk_path>.tables are used when present and valid.
+void* _load_proving_key(const char* pk_path);
+
+// Like _load_proving_key, for binary keys larger than the available memory:
+// only the constraint system and query indices are loaded, and every proof
+// reads the query points from disk in chunks. memory_budget (in bytes) covers
+// the loaded sections and the chunks; it fails if that leaves less than
+// 1 MiB for the chunks. Proofs are the same as with a resident key, but slower.
+// The handle works with every _prove* function; _prove_batch proves the
+// witnesses one after the other.
+void* _load_proving_key_with_budget(const char* pk_path, int64_t memory_budget);
+
+// Writes fixed-base tables for the binary proving key at pk_path to
+// <pk_path>.tables. num_shifts (1 to 64) trades memory for proving time: the
+// tables take about num_shifts times the size of the key's queries. For
+// power of two QAP domains the FFT twiddle table goes to <pk_path>.domain,
+// which _load_proving_key then maps instead of computing it.
+bool _precompute_proving_key(const char* pk_path, int num_shifts);
+
+// Proves for the given witness (same layout as _generate_proof) and writes
+// the proof into proof, which must hold at least PPZKSNARK_PROOF_SIZE bytes.
+// The key is only read, so one handle can be used from several threads.
+// Loading a key turns libff's profiling output off for the process, since
+// its counters are global and not thread safe.
+bool _prove(const void* key,
+            const uint8_t* public_inputs,
+            int public_inputs_length,
+            const uint8_t* private_inputs,
+            int private_inputs_length,
+            uint8_t* proof,
+            int proof_length
+          );
+
+// Checks the witness (same layout as _prove) against the key's constraint
+// system on all cores, without proving. Returns false and prints the failing
+// constraints with their A.s, B.s and C.s values to stderr if it does not
+// satisfy them. Much cheaper than _prove, so it can gate proof requests.
+bool _check_witness(const void* key,
+            const uint8_t* public_inputs,
+            int public_inputs_length,
+            const uint8_t* private_inputs,
+            int private_inputs_length
+          );
+
+// Proves count witnesses for the same key on num_threads worker threads
+// (0: one per hardware thread). Witness i is read from
+// public_inputs + i*public_inputs_length*32 and
+// private_inputs + i*private_inputs_length*32, its proof is written to
+// proofs + i*PPZKSNARK_PROOF_SIZE.
+bool _prove_batch(const void* key,
+            int count,
+            const uint8_t* public_inputs,
+            int public_inputs_length,
+            const uint8_t* private_inputs,
+            int private_inputs_length,
+            uint8_t* proofs,
+            int64_t proofs_length,
+            int num_threads
+          );
+
+// Like _prove, but writes the proof as a compressed bundle with the public
+// inputs (without ~one) and the key's circuit id, see proof_bundle.hpp.
+// bundle needs room for 332 + 32 * (public_inputs_length - 1) bytes.
+// Returns the number of bytes written, or -1 on failure.
+int64_t _prove_bundle(const void* key,
+            const uint8_t* public_inputs,
+            int public_inputs_length,
+            const uint8_t* private_inputs,
+            int private_inputs_length,
+            uint8_t* bundle,
+            int64_t bundle_length
+          );
+
+// Decodes and validates a bundle and writes it in the proof.json format.
+bool _proof_bundle_to_json(const uint8_t* bundle, int64_t bundle_length, const char* json_path);
+
+// Loads the processed verification key that _setup writes to
+// <vk_path>.pvk (the path of the .pvk itself works as well). It holds the
+// pairing precomputation of the key's fixed G2 elements, so _verify neither
+// parses nor preprocesses anything. Returns NULL on failure. Release with
+// _free_verification_key.
+void* _load_verification_key(const char* vk_path);
+
+// Checks a proof written by _prove (PPZKSNARK_PROOF_SIZE bytes) for the
+// public inputs, 32 bytes big endian each and without ~one. Returns false for
+// an invalid proof as well as for malformed arguments. The key is only read,
+// so one handle can be used from several threads: _load_verification_key
+// turns off libff's profiling, whose global counters the verifier would
+// otherwise update on every call.
+bool _verify(const void* vk,
+            const uint8_t* proof,
+            int proof_length,
+            const uint8_t* inputs,
+            int inputs_length
+          );
+
+void _free_verification_key(void* vk);
+
+// Number of threads used by keygen and proving (under MULTICORE) and by
+// _prove_batch and _check_witness when they are not given a count. 0 or
+// less selects one thread per hardware thread, which is also the default
+// unless the environment variable ZOKRATES_THREADS is set.
+void _set_num_threads(int num_threads);
+int _get_num_threads();
+
+void _free_key(void* key);
+
+// Writes the spans recorded so far to the file named by ZOKRATES_TRACE (the
+// trace is also written at process exit). No-op if tracing is disabled.
+void _flush_trace();
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,471 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifndef NO_PROCPS
+#include <proc/readproc.h>
+#endif
+
+// ZoKrates
+#include <ZoKrates/wraplibsnark.cpp>
+
+#include "bench_circuits.hpp"
+#include "r1cs_json.hpp"
+
+using namespace libsnark;
+using namespace libff;
+
+/**
+ * End-to-end benchmark: sweeps the circuit size from 2^min_log to 2^max_log
+ * constraints and times every stage of the pipeline separately, together
+ * with the resident set size after each stage. Results are written as JSON
+ * so that runs of different releases can be compared.
+ *
+ * With --tables N the proving key is also precomputed into fixed-base tables
+ * with N shifts (see pk_tables.hpp) and proving is timed again with them.
+ *
+ * With --stream-budget MB proving is also timed with the key streamed from
+ * disk within a budget of MB megabytes (see pk_stream.hpp), and the result
+ * is checked against the mapped key's for the same QAP witness.
+ *
+ * With --scaling-log L the sweep is replaced by a strong scaling run: one
+ * circuit of 2^L constraints, keygen and proving timed with 1, 2, 4, ...
+ * threads up to --max-threads (default: all hardware threads).
+ *
+ * With --fft-max-log L only the FFTs of the H step are timed, for domains
+ * of 2^16 to 2^L elements: libfqfft's domain against a qap_domain built once
+ * (see qap_domain.hpp), with their results compared.
+ *
+ * The results record the field kernel in use (see field_kernels.hpp); run
+ * with ZOKRATES_FIELD_KERNEL=portable to compare against the portable one.
+ *
+ * usage: bench [--circuit inner_product|sha256] [--min-log 10] [--max-log 22] [--tables 0] [--stream-budget 0] [--out bench.json]
+ *        bench [--circuit inner_product|sha256] --scaling-log 18 [--max-threads N] [--out scaling.json]
+ *        bench --fft-max-log 22 [--out fft.json]
+ */
+
+typedef libff::Fr<alt_bn128_pp> FieldT;
+
+// resident set size in kB, through procps when it is available
+size_t current_rss_kb()
+{
+#ifndef NO_PROCPS
+    struct proc_t usage;
+    look_up_our_self(&usage);
+    return usage.rss * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#endif
+}
+
+// high water mark of the process so far, in kB
+size_t peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+struct bench_phase {
+    std::string name;
+    double seconds;
+    size_t rss_kb;
+};
+
+struct bench_result {
+    size_t log_constraints;
+    size_t num_constraints;
+    size_t num_variables;
+    size_t num_inputs;
+    std::vector<bench_phase> phases;
+    size_t peak_rss_kb;
+};
+
+template<typename F>
+void run_phase(bench_result &result, const std::string &name, F f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.phases.push_back({ name, seconds, current_rss_kb() });
+    std::cout << "  " << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << seconds << " s" << std::setw(12) << result.phases.back().rss_kb << " kB" << std::endl;
+}
+
+bench_result run_bench(const std::string &circuit_name, size_t log_constraints, size_t table_shifts, size_t stream_budget_mb)
+{
+    bench_result result;
+    result.log_constraints = log_constraints;
+
+    std::unique_ptr<bench_circuit<FieldT>> circuit = make_bench_circuit<FieldT>(circuit_name, size_t(1) << log_constraints);
+    const protoboard<FieldT> &pb = circuit->pb;
+
+    run_phase(result, "constraint_generation", [&]() { circuit->generate_r1cs_constraints(); });
+    run_phase(result, "witness_generation", [&]() { circuit->generate_r1cs_witness(); });
+
+    const r1cs_constraint_system<FieldT> cs = pb.get_constraint_system();
+    const r1cs_primary_input<FieldT> primary_input = pb.primary_input();
+    const r1cs_auxiliary_input<FieldT> auxiliary_input = pb.auxiliary_input();
+    result.num_constraints = cs.num_constraints();
+    result.num_variables = cs.num_variables();
+    result.num_inputs = cs.num_inputs();
+
+    r1cs_ppzksnark_keypair<alt_bn128_pp> keypair;
+    run_phase(result, "key_generation", [&]() { keypair = generateKeypair(cs); });
+
+    const std::string pk_path = "bench_pk.bin", vk_path = "bench_vk.txt";
+    run_phase(result, "key_serialization", [&]() {
+        serializeProvingKeyToFile(keypair.pk, pk_path.c_str());
+        serializeVerificationKeyToFile(keypair.vk, vk_path.c_str());
+    });
+    keypair.pk = r1cs_ppzksnark_proving_key<alt_bn128_pp>();
+
+    r1cs_ppzksnark_proving_key<alt_bn128_pp> pk;
+    run_phase(result, "key_deserialization", [&]() { pk = deserializeProvingKeyFromFile(pk_path.c_str()); });
+    pk = r1cs_ppzksnark_proving_key<alt_bn128_pp>();
+
+    std::unique_ptr<mapped_proving_key> mapped;
+    run_phase(result, "key_mapping", [&]() { mapped.reset(new mapped_proving_key(pk_path.c_str())); });
+
+    r1cs_ppzksnark_proof<alt_bn128_pp> proof;
+    run_phase(result, "proving", [&]() { proof = proveWithKeyView(mapped->view(), primary_input, auxiliary_input); });
+
+    // the QAP witness from libsnark's constraint system and from the flat one in the mapped key;
+    // both have to be the key's, in which the generator may have swapped A and B
+    {
+        r1cs_constraint_system<FieldT> key_cs = cs;
+        key_cs.swap_AB_if_beneficial();
+        const FieldT d1 = FieldT::random_element(), d2 = FieldT::random_element(), d3 = FieldT::random_element();
+        std::unique_ptr<qap_witness<FieldT>> nested, flat;
+        run_phase(result, "qap_witness_nested", [&]() {
+            nested.reset(new qap_witness<FieldT>(r1cs_to_qap_witness_map(key_cs, primary_input, auxiliary_input, d1, d2, d3)));
+        });
+        run_phase(result, "qap_witness_flat", [&]() {
+            flat.reset(new qap_witness<FieldT>(flatQapWitnessMap(*mapped->view().flat_constraints, primary_input, auxiliary_input, d1, d2, d3)));
+        });
+        if (nested->coefficients_for_H != flat->coefficients_for_H) {
+            throw std::runtime_error("flat QAP witness differs from libsnark's");
+        }
+    }
+
+    bool verified = false;
+    run_phase(result, "verification", [&]() { verified = r1cs_ppzksnark_verifier_strong_IC<alt_bn128_pp>(keypair.vk, primary_input, proof); });
+    if (!verified) {
+        throw std::runtime_error("proof does not verify");
+    }
+
+    // the low latency path: processed key loaded from disk, then one pairing check
+    {
+        std::unique_ptr<batch_verification_key> loaded;
+        run_phase(result, "pvk_load", [&]() {
+            loaded.reset(new batch_verification_key(readProcessedVerificationKeyFile(processedVerificationKeyPath(vk_path.c_str()).c_str())));
+        });
+        run_phase(result, "verification_processed", [&]() {
+            verified = r1cs_ppzksnark_online_verifier_strong_IC<alt_bn128_pp>(loaded->pvk, primary_input, proof);
+        });
+        if (!verified) {
+            throw std::runtime_error("proof does not verify with the loaded processed key");
+        }
+    }
+
+    if (stream_budget_mb > 0) {
+        const streamed_proving_key streamed(pk_path.c_str(), stream_budget_mb << 20);
+        run_phase(result, "proving_streamed", [&]() { proof = proveStreamed(streamed, primary_input, auxiliary_input); });
+
+        const qap_witness<FieldT> qap_wit = qapWitnessForProof(mapped->view(), primary_input, auxiliary_input);
+        prover_scratch scratch;
+        if (!(proofFromQapWitnessStreamed(streamed, qap_wit, scratch) == proofFromQapWitness(mapped->view(), qap_wit, scratch))) {
+            throw std::runtime_error("streamed proof differs from the mapped key's");
+        }
+    }
+
+    if (table_shifts > 0) {
+        const std::string tables_path = provingKeyTablesPath(pk_path.c_str());
+        run_phase(result, "table_generation", [&]() { writeProvingKeyTables(*mapped, tables_path.c_str(), table_shifts); });
+
+        mapped_proving_key_tables tables(tables_path.c_str(), *mapped);
+        mapped->attachTables(&tables.tables());
+        run_phase(result, "proving_with_tables", [&]() { proof = proveWithKeyView(mapped->view(), primary_input, auxiliary_input); });
+        mapped->attachTables(nullptr);
+
+        if (!r1cs_ppzksnark_verifier_strong_IC<alt_bn128_pp>(keypair.vk, primary_input, proof)) {
+            throw std::runtime_error("proof computed with tables does not verify");
+        }
+    }
+
+    run_phase(result, "json_export", [&]() {
+        r1cs_to_json(cs, cs.num_inputs(), "bench_r1cs.json");
+        array_to_json(pb.full_variable_assignment(), "bench_tests.json");
+        verificationKeyAsHex(keypair.vk);
+        proofAsHex(proof);
+    });
+
+    run_phase(result, "json_import", [&]() {
+        const r1cs_constraint_system<FieldT> imported = r1cs_from_json_file<FieldT>("bench_r1cs.json", cs.num_variables());
+        const r1cs_variable_assignment<FieldT> assignment = array_from_json_file<FieldT>("bench_tests.json");
+        if (imported.num_constraints() != cs.num_constraints() || assignment.size() != cs.num_variables() ||
+            !imported.is_satisfied(r1cs_primary_input<FieldT>(assignment.begin(), assignment.begin() + imported.num_inputs()),
+                                   r1cs_auxiliary_input<FieldT>(assignment.begin() + imported.num_inputs(), assignment.end()))) {
+            throw std::runtime_error("json round trip does not match");
+        }
+    });
+
+    result.peak_rss_kb = peak_rss_kb();
+    return result;
+}
+
+struct scaling_point {
+    size_t threads;
+    double keygen_seconds;
+    double proving_seconds;
+};
+
+std::vector<scaling_point> run_scaling(const std::string &circuit_name, size_t log_constraints, size_t max_threads)
+{
+    std::unique_ptr<bench_circuit<FieldT>> circuit = make_bench_circuit<FieldT>(circuit_name, size_t(1) << log_constraints);
+    circuit->generate_r1cs_constraints();
+    circuit->generate_r1cs_witness();
+    const r1cs_constraint_system<FieldT> cs = circuit->pb.get_constraint_system();
+    const r1cs_primary_input<FieldT> primary_input = circuit->pb.primary_input();
+    const r1cs_auxiliary_input<FieldT> auxiliary_input = circuit->pb.auxiliary_input();
+
+    std::cout << "threads      keygen     speedup     proving     speedup  efficiency" << std::endl;
+    std::vector<scaling_point> points;
+    for (size_t threads = 1; ; threads = std::min(2 * threads, max_threads))
+    {
+        setProverThreads(threads);
+
+        scaling_point point;
+        point.threads = threads;
+        auto start = std::chrono::steady_clock::now();
+        const r1cs_ppzksnark_keypair<alt_bn128_pp> keypair = generateKeypair(cs);
+        point.keygen_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        const r1cs_ppzksnark_proof<alt_bn128_pp> proof = proveWithKeyView(viewOfProvingKey(keypair.pk), primary_input, auxiliary_input);
+        point.proving_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!r1cs_ppzksnark_verifier_strong_IC<alt_bn128_pp>(keypair.vk, primary_input, proof)) {
+            throw std::runtime_error("proof does not verify");
+        }
+        points.push_back(point);
+
+        const double proving_speedup = points[0].proving_seconds / point.proving_seconds;
+        std::cout << std::setw(7) << threads << std::fixed << std::setprecision(3)
+                  << std::setw(10) << point.keygen_seconds << " s" << std::setw(10) << points[0].keygen_seconds / point.keygen_seconds << "x"
+                  << std::setw(10) << point.proving_seconds << " s" << std::setw(10) << proving_speedup << "x"
+                  << std::setw(11) << 100 * proving_speedup / threads << "%" << std::endl;
+
+        if (threads == max_threads) {
+            break;
+        }
+    }
+    return points;
+}
+
+void write_scaling_results(const std::string &path, const std::string &circuit_name, size_t log_constraints, const std::vector<scaling_point> &points)
+{
+    std::ofstream fh(path);
+    fh << "{\n  \"circuit\": \"" << circuit_name << "\",\n  \"curve\": \"alt_bn128\",\n"
+       << "  \"log_constraints\": " << log_constraints << ",\n  \"scaling\": [";
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        fh << (i == 0 ? "\n" : ",\n") << std::setprecision(6)
+           << "    {\"threads\": " << points[i].threads
+           << ", \"keygen_seconds\": " << points[i].keygen_seconds
+           << ", \"proving_seconds\": " << points[i].proving_seconds
+           << ", \"keygen_speedup\": " << points[0].keygen_seconds / points[i].keygen_seconds
+           << ", \"proving_speedup\": " << points[0].proving_seconds / points[i].proving_seconds << "}";
+    }
+    fh << "\n  ]\n}\n";
+}
+
+struct fft_point {
+    size_t log_size;
+    double libfqfft_seconds;
+    double domain_build_seconds;
+    double qap_domain_seconds;
+};
+
+// iFFT, cosetFFT and icosetFFT, the transforms of one vector in the H step
+template<typename Domain>
+void h_step_transforms(Domain &domain, std::vector<FieldT> &a)
+{
+    domain.iFFT(a);
+    domain.cosetFFT(a, FieldT::multiplicative_generator);
+    domain.icosetFFT(a, FieldT::multiplicative_generator);
+}
+
+std::vector<fft_point> run_fft_sweep(size_t max_log)
+{
+    std::cout << "  log2 m    libfqfft       build  qap_domain     speedup" << std::endl;
+    std::vector<fft_point> points;
+    for (size_t log_size = std::min<size_t>(16, max_log); log_size <= max_log; ++log_size)
+    {
+        const size_t m = size_t(1) << log_size;
+        std::vector<FieldT> input(m);
+        for (FieldT &x : input) {
+            x = FieldT::random_element();
+        }
+
+        fft_point point;
+        point.log_size = log_size;
+        std::vector<FieldT> before = input, after = input;
+        auto start = std::chrono::steady_clock::now();
+        {
+            // as r1cs_to_qap_witness_map does it: a fresh domain every proof
+            const std::shared_ptr<libfqfft::evaluation_domain<FieldT>> domain = libfqfft::get_evaluation_domain<FieldT>(m);
+            h_step_transforms(*domain, before);
+        }
+        point.libfqfft_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        const qap_domain domain(m);
+        point.domain_build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        h_step_transforms(domain, after);
+        point.qap_domain_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (before != after) {
+            throw std::runtime_error("qap_domain FFT differs from libfqfft's");
+        }
+        points.push_back(point);
+        std::cout << std::setw(8) << log_size << std::fixed << std::setprecision(4)
+                  << std::setw(10) << point.libfqfft_seconds << " s"
+                  << std::setw(10) << point.domain_build_seconds << " s"
+                  << std::setw(10) << point.qap_domain_seconds << " s"
+                  << std::setw(11) << std::setprecision(2) << point.libfqfft_seconds / point.qap_domain_seconds << "x" << std::endl;
+    }
+    return points;
+}
+
+void write_fft_results(const std::string &path, const std::vector<fft_point> &points)
+{
+    std::ofstream fh(path);
+    fh << "{\n  \"curve\": \"alt_bn128\",\n  \"threads\": " << proverThreads() << ",\n";
+    fh << "  \"field_kernel\": \"" << fieldKernelName(fieldKernel()) << "\",\n  \"fft\": [";
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        fh << (i == 0 ? "\n" : ",\n") << std::setprecision(6)
+           << "    {\"log_size\": " << points[i].log_size
+           << ", \"libfqfft_seconds\": " << points[i].libfqfft_seconds
+           << ", \"domain_build_seconds\": " << points[i].domain_build_seconds
+           << ", \"qap_domain_seconds\": " << points[i].qap_domain_seconds << "}";
+    }
+    fh << "\n  ]\n}\n";
+}
+
+void write_results(const std::string &path, const std::string &circuit_name, const std::vector<bench_result> &results)
+{
+    std::ofstream fh(path);
+    fh << "{\n  \"circuit\": \"" << circuit_name << "\",\n  \"curve\": \"alt_bn128\",\n";
+#ifdef MULTICORE
+    fh << "  \"multicore\": true,\n";
+#else
+    fh << "  \"multicore\": false,\n";
+#endif
+    fh << "  \"threads\": " << proverThreads() << ",\n";
+    fh << "  \"field_kernel\": \"" << fieldKernelName(fieldKernel()) << "\",\n";
+    fh << "  \"results\": [";
+    for (size_t r = 0; r < results.size(); ++r)
+    {
+        const bench_result &result = results[r];
+        fh << (r == 0 ? "\n" : ",\n");
+        fh << "    {\"log_constraints\": " << result.log_constraints
+           << ", \"num_constraints\": " << result.num_constraints
+           << ", \"num_variables\": " << result.num_variables
+           << ", \"num_inputs\": " << result.num_inputs
+           << ", \"peak_rss_kb\": " << result.peak_rss_kb
+           << ", \"phases\": {";
+        for (size_t p = 0; p < result.phases.size(); ++p)
+        {
+            fh << (p == 0 ? "" : ", ") << "\"" << result.phases[p].name << "\": {\"seconds\": "
+               << std::setprecision(6) << result.phases[p].seconds << ", \"rss_kb\": " << result.phases[p].rss_kb << "}";
+        }
+        fh << "}}";
+    }
+    fh << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::string circuit_name = "inner_product";
+    std::string out_path = "bench.json";
+    size_t min_log = 10, max_log = 22;
+    size_t table_shifts = 0;
+    size_t stream_budget_mb = 0;
+    size_t scaling_log = 0, max_threads = 0;
+    size_t fft_max_log = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--circuit") {
+            circuit_name = argv[i + 1];
+        } else if (arg == "--min-log") {
+            min_log = std::atol(argv[i + 1]);
+        } else if (arg == "--max-log") {
+            max_log = std::atol(argv[i + 1]);
+        } else if (arg == "--tables") {
+            table_shifts = std::atol(argv[i + 1]);
+        } else if (arg == "--stream-budget") {
+            stream_budget_mb = std::atol(argv[i + 1]);
+        } else if (arg == "--scaling-log") {
+            scaling_log = std::atol(argv[i + 1]);
+        } else if (arg == "--fft-max-log") {
+            fft_max_log = std::atol(argv[i + 1]);
+        } else if (arg == "--max-threads") {
+            max_threads = std::atol(argv[i + 1]);
+        } else if (arg == "--out") {
+            out_path = argv[i + 1];
+        } else {
+            std::cerr << "usage: bench [--circuit inner_product|sha256] [--min-log 10] [--max-log 22] [--tables 0] [--stream-budget 0] [--out bench.json]" << std::endl;
+            std::cerr << "       bench [--circuit inner_product|sha256] --scaling-log 18 [--max-threads N] [--out scaling.json]" << std::endl;
+            std::cerr << "       bench --fft-max-log 22 [--out fft.json]" << std::endl;
+            return 1;
+        }
+    }
+
+    initCurveParameters();
+    std::cout << "field kernel: " << fieldKernelName(fieldKernel()) << std::endl;
+
+    if (fft_max_log > 0)
+    {
+        std::cout << "H step FFTs, " << proverThreads() << " threads" << std::endl;
+        write_fft_results(out_path, run_fft_sweep(fft_max_log));
+        return 0;
+    }
+
+    if (scaling_log > 0)
+    {
+        if (max_threads == 0) {
+            max_threads = std::max<unsigned>(1, std::thread::hardware_concurrency());
+        }
+        std::cout << circuit_name << ", 2^" << scaling_log << " constraints, 1 to " << max_threads << " threads" << std::endl;
+        write_scaling_results(out_path, circuit_name, scaling_log, run_scaling(circuit_name, scaling_log, max_threads));
+        return 0;
+    }
+
+    std::vector<bench_result> results;
+    for (size_t log_constraints = min_log; log_constraints <= max_log; ++log_constraints)
+    {
+        std::cout << circuit_name << ", 2^" << log_constraints << " constraints" << std::endl;
+        results.push_back(run_bench(circuit_name, log_constraints, table_shifts, stream_budget_mb));
+        // rewritten after every size, so that a long sweep leaves usable results if it is cut short
+        write_results(out_path, circuit_name, results);
+    }
+
+    return 0;
+}
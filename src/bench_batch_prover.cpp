@@ -0,0 +1,140 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// ZoKrates
+#include <ZoKrates/wraplibsnark.cpp>
+#include <ZoKrates/batch_verifier.hpp>
+#include <ZoKrates/proof_pipeline.hpp>
+
+#include "bench_circuits.hpp"
+
+using namespace libsnark;
+using namespace libff;
+
+/**
+ * Throughput of the batch prover: proofs per second against the number of
+ * worker threads, for one inner product circuit and one proving key. The
+ * last batch of proofs is then verified one by one and as a single batch.
+ *
+ * Finally the whole flow (witness generation, proving, export to a proof
+ * bundle stream) is run once job after job and once through the pipelined
+ * prover, which reports the throughput of every stage.
+ *
+ * usage: bench_batch_prover [num_constraints] [num_proofs] [max_threads]
+ */
+
+typedef libff::Fr<alt_bn128_pp> FieldT;
+
+int main(int argc, char** argv)
+{
+    const size_t num_constraints = argc > 1 ? std::atol(argv[1]) : 1 << 12;
+    const size_t num_proofs = argc > 2 ? std::atol(argv[2]) : 64;
+    const size_t max_threads = argc > 3 ? std::atol(argv[3]) : std::max<unsigned>(1, std::thread::hardware_concurrency());
+
+    initCurveParameters();
+
+    inner_product_circuit<FieldT> circuit(num_constraints);
+    circuit.generate_r1cs_constraints();
+    circuit.generate_r1cs_witness();
+    const protoboard<FieldT> &pb = circuit.pb;
+    assert(pb.is_satisfied());
+
+    r1cs_ppzksnark_keypair<alt_bn128_pp> keypair = generateKeypair(pb.get_constraint_system());
+
+    std::vector<prover_witness> witnesses(num_proofs);
+    for (prover_witness &w : witnesses)
+    {
+        w.primary_input = pb.primary_input();
+        w.auxiliary_input = pb.auxiliary_input();
+    }
+
+    std::cout << "num constraints: " << pb.num_constraints() << ", num proofs: " << num_proofs << "\n";
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "seconds" << std::setw(14) << "proofs/sec" << "\n";
+
+    std::vector<r1cs_ppzksnark_proof<alt_bn128_pp>> proofs;
+    for (size_t threads = 1; threads <= max_threads; threads = (threads * 2 <= max_threads || threads == max_threads) ? threads * 2 : max_threads)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        proofs = proveBatch(keypair.pk, witnesses, threads);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        assert(r1cs_ppzksnark_verifier_strong_IC<alt_bn128_pp>(keypair.vk, witnesses.back().primary_input, proofs.back()));
+        std::cout << std::setw(8) << threads << std::setw(14) << std::fixed << std::setprecision(3) << seconds
+                  << std::setw(14) << num_proofs / seconds << "\n";
+    }
+
+    std::vector<r1cs_primary_input<FieldT>> primary_inputs(num_proofs, pb.primary_input());
+    const batch_verification_key bvk(keypair.vk);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < num_proofs; ++i)
+    {
+        if (!r1cs_ppzksnark_online_verifier_strong_IC<alt_bn128_pp>(bvk.pvk, primary_inputs[i], proofs[i]))
+        {
+            std::cout << "proof " << i << " does not verify\n";
+        }
+    }
+    const double single_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    const bool batch_ok = batchVerifyProofs(bvk, primary_inputs, proofs);
+    const double batch_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "verify one by one: " << single_seconds << " s, " << num_proofs / single_seconds << " proofs/sec\n";
+    std::cout << "verify as a batch: " << batch_seconds << " s, " << num_proofs / batch_seconds << " proofs/sec"
+              << (batch_ok ? "" : " (batch rejected)") << "\n";
+
+    // end to end, each job generates its own witness and exports its proof
+    const uint8_t circuit_id[32] = { 0 };
+    auto source = [&](size_t i, prover_witness &w) {
+        if (i == num_proofs)
+        {
+            return false;
+        }
+        circuit.generate_r1cs_witness();
+        w.primary_input = circuit.pb.primary_input();
+        w.auxiliary_input = circuit.pb.auxiliary_input();
+        return true;
+    };
+
+    std::ostringstream sequential_out;
+    proof_bundle_stream_writer sequential_writer(sequential_out);
+    applyProverThreads();
+    start = std::chrono::steady_clock::now();
+    {
+        prover_scratch scratch;
+        const proving_key_view view = viewOfProvingKey(keypair.pk);
+        prover_witness w;
+        for (size_t i = 0; source(i, w); ++i)
+        {
+            sequential_writer.write(proveWithKeyView(view, w.primary_input, w.auxiliary_input, scratch), w.primary_input, circuit_id);
+        }
+    }
+    const double sequential_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "\nend to end, one job after the other: " << sequential_seconds << " s, "
+              << num_proofs / sequential_seconds << " proofs/sec\n";
+
+    std::ostringstream pipelined_out;
+    proof_bundle_stream_writer pipelined_writer(pipelined_out);
+    bool last_ok = true;
+    proof_pipeline pipeline(viewOfProvingKey(keypair.pk));
+    const pipeline_stats stats = pipeline.run(source, [&](size_t i, const prover_witness &w, const r1cs_ppzksnark_proof<alt_bn128_pp> &proof) {
+        pipelined_writer.write(proof, w.primary_input, circuit_id);
+        if (i + 1 == num_proofs)
+        {
+            last_ok = r1cs_ppzksnark_verifier_strong_IC<alt_bn128_pp>(keypair.vk, w.primary_input, proof);
+        }
+    });
+    std::cout << "end to end, pipelined:\n";
+    printPipelineStats(stats);
+    if (!last_ok)
+    {
+        std::cout << "pipelined proof does not verify\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file bench_circuits.hpp
+ *
+ * Circuits of configurable size for the benchmarks. Constraint and witness
+ * generation are separate steps so that they can be timed on their own.
+ */
+
+#ifndef BENCH_CIRCUITS_HPP_
+#define BENCH_CIRCUITS_HPP_
+
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <libsnark/gadgetlib1/gadgets/basic_gadgets.hpp>
+#include <libsnark/gadgetlib1/gadgets/hashes/sha256/sha256_gadget.hpp>
+
+template<typename FieldT>
+class bench_circuit {
+public:
+    virtual ~bench_circuit() {}
+
+    // allocates the variables and generates the constraints
+    virtual void generate_r1cs_constraints() = 0;
+    // fills in a random satisfying assignment
+    virtual void generate_r1cs_witness() = 0;
+
+    libsnark::protoboard<FieldT> pb;
+};
+
+// the circuit of test_r1cs_ppzksnark in main.cpp: res = <A, B>
+template<typename FieldT>
+class inner_product_circuit : public bench_circuit<FieldT> {
+public:
+    explicit inner_product_circuit(size_t num_constraints) : n(num_constraints - 1) {}
+
+    void generate_r1cs_constraints()
+    {
+        res.allocate(this->pb, "res");
+        A.allocate(this->pb, n, "A");
+        B.allocate(this->pb, n, "B");
+        this->pb.set_input_sizes(1);
+
+        gadget.reset(new libsnark::inner_product_gadget<FieldT>(this->pb, A, B, res, "compute_inner_product"));
+        gadget->generate_r1cs_constraints();
+    }
+
+    void generate_r1cs_witness()
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            this->pb.val(A[i]) = FieldT::random_element();
+            this->pb.val(B[i]) = FieldT::random_element();
+        }
+        gadget->generate_r1cs_witness();
+    }
+
+private:
+    size_t n;
+    libsnark::pb_variable_array<FieldT> A;
+    libsnark::pb_variable_array<FieldT> B;
+    libsnark::pb_variable<FieldT> res;
+    std::unique_ptr<libsnark::inner_product_gadget<FieldT>> gadget;
+};
+
+// a chain of SHA256 compressions, digest[i+1] = H(digest[i], block[i]),
+// with as many links as fit into num_constraints. digest[0] is the input.
+template<typename FieldT>
+class sha256_chain_circuit : public bench_circuit<FieldT> {
+public:
+    explicit sha256_chain_circuit(size_t num_constraints) : target(num_constraints) {}
+
+    void generate_r1cs_constraints()
+    {
+        digests.emplace_back(new libsnark::digest_variable<FieldT>(this->pb, libsnark::SHA256_digest_size, "digest_0"));
+        this->pb.set_input_sizes(libsnark::SHA256_digest_size);
+
+        do {
+            const std::string i = std::to_string(hashes.size());
+            blocks.emplace_back(new libsnark::digest_variable<FieldT>(this->pb, libsnark::SHA256_digest_size, "block_" + i));
+            digests.emplace_back(new libsnark::digest_variable<FieldT>(this->pb, libsnark::SHA256_digest_size, "digest_" + i));
+            hashes.emplace_back(new libsnark::sha256_two_to_one_hash_gadget<FieldT>(this->pb, *digests[hashes.size()], *blocks.back(), *digests.back(), "hash_" + i));
+            hashes.back()->generate_r1cs_constraints();
+        } while (this->pb.num_constraints() < target);
+    }
+
+    void generate_r1cs_witness()
+    {
+        digests[0]->generate_r1cs_witness(random_bits());
+        for (size_t i = 0; i < hashes.size(); ++i)
+        {
+            blocks[i]->generate_r1cs_witness(random_bits());
+            hashes[i]->generate_r1cs_witness();
+        }
+    }
+
+private:
+    static libff::bit_vector random_bits()
+    {
+        libff::bit_vector bits(libsnark::SHA256_digest_size);
+        for (size_t i = 0; i < bits.size(); ++i)
+        {
+            bits[i] = std::rand() & 1;
+        }
+        return bits;
+    }
+
+    size_t target;
+    std::vector<std::unique_ptr<libsnark::digest_variable<FieldT>>> digests;
+    std::vector<std::unique_ptr<libsnark::digest_variable<FieldT>>> blocks;
+    std::vector<std::unique_ptr<libsnark::sha256_two_to_one_hash_gadget<FieldT>>> hashes;
+};
+
+template<typename FieldT>
+std::unique_ptr<bench_circuit<FieldT>> make_bench_circuit(const std::string &name, size_t num_constraints)
+{
+    std::unique_ptr<bench_circuit<FieldT>> circuit;
+    if (name == "inner_product") {
+        circuit.reset(new inner_product_circuit<FieldT>(num_constraints));
+    } else if (name == "sha256") {
+        circuit.reset(new sha256_chain_circuit<FieldT>(num_constraints));
+    } else {
+        throw std::invalid_argument("unknown circuit " + name);
+    }
+    return circuit;
+}
+
+#endif // BENCH_CIRCUITS_HPP_
@@ -0,0 +1,177 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// ZoKrates
+#include <ZoKrates/wraplibsnark.cpp>
+
+using namespace libsnark;
+using namespace libff;
+
+/**
+ * Field element conversions for witness import and input export: the per
+ * element byte and stringstream loops the wrapper used to run against the
+ * bulk kernels from field_conversion.hpp, on num_elements random elements.
+ * Hex parsing, which the wrapper did not have, is compared with a digit by
+ * digit loop. Results of both are compared.
+ *
+ * usage: bench_conversion [num_elements]
+ */
+
+typedef libff::alt_bn128_Fr FieldT;
+
+// the conversions as they were before field_conversion.hpp
+libff::bigint<4> referenceBigintFromBytes(const uint8_t* _x)
+{
+    libff::bigint<4> x;
+    for (unsigned i = 0; i < 4; i++) {
+        for (unsigned j = 0; j < 8; j++) {
+            x.data[3 - i] |= uint64_t(_x[i * 8 + j]) << (8 * (7-j));
+        }
+    }
+    return x;
+}
+
+void referenceBigintToBytes(const libff::bigint<4> &_x, uint8_t* x)
+{
+    for (unsigned i = 0; i < 4; i++) {
+        for (unsigned j = 0; j < 8; j++) {
+            x[i * 8 + j] = uint8_t(uint64_t(_x.data[3 - i]) >> (8 * (7 - j)));
+        }
+    }
+}
+
+std::string referenceHexString(const libff::bigint<4> &_x)
+{
+    uint8_t x[32];
+    referenceBigintToBytes(_x, x);
+    std::stringstream ss;
+    ss << std::setfill('0');
+    for (unsigned i = 0; i < 32; i++) {
+        ss << std::hex << std::setw(2) << (int)x[i];
+    }
+    std::string str = ss.str();
+    return str.erase(0, std::min(str.find_first_not_of('0'), str.size()-1));
+}
+
+// one digit at a time, for fieldsFromHex
+libff::bigint<4> referenceBigintFromHex(const char* in)
+{
+    libff::bigint<4> x;
+    for (size_t i = 0; i < field_hex_digits; ++i) {
+        const char c = in[i];
+        const uint64_t digit = c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+        for (int j = 3; j > 0; --j) {
+            x.data[j] = (x.data[j] << 4) | (x.data[j - 1] >> 60);
+        }
+        x.data[0] = (x.data[0] << 4) | digit;
+    }
+    return x;
+}
+
+template<typename F>
+double seconds(F f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const char* name, size_t n, double reference, double bulk)
+{
+    std::cout << std::setw(16) << name
+              << std::setw(14) << n / reference / 1e6
+              << std::setw(14) << n / bulk / 1e6
+              << std::setw(10) << std::setprecision(3) << reference / bulk << "x\n";
+}
+
+int main(int argc, char** argv)
+{
+    const size_t n = argc > 1 ? std::atol(argv[1]) : 1 << 20;
+
+    initCurveParameters();
+    applyProverThreads();
+
+    std::vector<FieldT> values(n);
+    for (FieldT &v : values) {
+        v = FieldT::random_element();
+    }
+    // small values as well, they exercise stripping the leading zeros
+    for (size_t i = 0; i < n; i += 7) {
+        values[i] = FieldT(long(i));
+    }
+    std::vector<uint8_t> bytes(field_bytes * n);
+    for (size_t i = 0; i < n; ++i) {
+        referenceBigintToBytes(values[i].as_bigint(), bytes.data() + field_bytes * i);
+    }
+
+    std::cout << "num elements: " << n << ", threads: " << proverThreads() << "\n";
+    std::cout << std::setw(16) << "conversion" << std::setw(14) << "ref M/s" << std::setw(14) << "bulk M/s" << std::setw(11) << "speedup" << "\n";
+
+    {
+        std::vector<FieldT> reference, bulk;
+        const double t_ref = seconds([&]() {
+            reference.reserve(n);
+            for (size_t i = 0; i < n; ++i) {
+                reference.emplace_back(referenceBigintFromBytes(bytes.data() + field_bytes * i));
+            }
+        });
+        const double t_bulk = seconds([&]() { fieldsFromBytes(bytes.data(), n, bulk); });
+        if (reference != bulk) {
+            throw std::runtime_error("bytes to field: results differ");
+        }
+        report("bytes -> Fr", n, t_ref, t_bulk);
+    }
+
+    {
+        std::vector<uint8_t> reference(field_bytes * n), bulk(field_bytes * n);
+        const double t_ref = seconds([&]() {
+            for (size_t i = 0; i < n; ++i) {
+                referenceBigintToBytes(values[i].as_bigint(), reference.data() + field_bytes * i);
+            }
+        });
+        const double t_bulk = seconds([&]() { fieldsToBytes(values, bulk.data()); });
+        if (reference != bulk) {
+            throw std::runtime_error("field to bytes: results differ");
+        }
+        report("Fr -> bytes", n, t_ref, t_bulk);
+    }
+
+    {
+        std::vector<std::string> reference(n);
+        field_hex_buffer bulk;
+        const double t_ref = seconds([&]() {
+            for (size_t i = 0; i < n; ++i) {
+                reference[i] = referenceHexString(values[i].as_bigint());
+            }
+        });
+        const double t_bulk = seconds([&]() { bulk.assign(values); });
+        for (size_t i = 0; i < n; ++i) {
+            if (reference[i] != std::string(bulk.digits(i), bulk.length(i))) {
+                throw std::runtime_error("field to hex: results differ at " + std::to_string(i));
+            }
+        }
+        report("Fr -> hex", n, t_ref, t_bulk);
+    }
+
+    {
+        std::vector<char> hex(field_hex_digits * n);
+        fieldsToHex(values, hex.data());
+        std::vector<FieldT> reference, bulk;
+        const double t_ref = seconds([&]() {
+            reference.reserve(n);
+            for (size_t i = 0; i < n; ++i) {
+                reference.emplace_back(referenceBigintFromHex(hex.data() + field_hex_digits * i));
+            }
+        });
+        const double t_bulk = seconds([&]() { fieldsFromHex(hex.data(), n, bulk); });
+        if (reference != bulk || bulk != values) {
+            throw std::runtime_error("hex to field: results differ");
+        }
+        report("hex -> Fr", n, t_ref, t_bulk);
+    }
+
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+// ZoKrates
+#include <ZoKrates/wraplibsnark.cpp>
+
+using namespace libsnark;
+using namespace libff;
+
+/**
+ * Field arithmetic: libff's Fr and Fq multiplication against the kernels
+ * from field_kernels.hpp (portable, and MULX/ADX when the CPU has it), as
+ * throughput over num_elements independent products and as latency of a
+ * chain of dependent ones, plus squaring and Fq2 through fieldMul/fieldSqr.
+ * Single threaded; all results are compared with libff's.
+ *
+ * usage: bench_field [num_elements]
+ */
+
+typedef void (*mont_kernel)(uint64_t*, const uint64_t*, const uint64_t*, const montgomery_modulus&);
+
+template<typename F>
+double seconds(F f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const std::string &name, size_t n, double libff_seconds, double kernel_seconds)
+{
+    std::cout << std::setw(24) << name << std::fixed << std::setprecision(2)
+              << std::setw(12) << 1e9 * libff_seconds / n
+              << std::setw(12) << 1e9 * kernel_seconds / n
+              << std::setw(10) << libff_seconds / kernel_seconds << "x\n";
+}
+
+template<typename FieldT>
+std::vector<FieldT> randomElements(size_t n)
+{
+    std::vector<FieldT> v(n);
+    for (FieldT &x : v) {
+        x = FieldT::random_element();
+    }
+    // the largest element as well
+    v[0] = -FieldT::one();
+    return v;
+}
+
+template<typename FieldT, mont_kernel kernel>
+void benchKernel(const std::string &name, const montgomery_modulus &mod, const std::vector<FieldT> &a, const std::vector<FieldT> &b)
+{
+    const size_t n = a.size();
+    std::vector<FieldT> expected(n), actual(n);
+    const double t_libff = seconds([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            expected[i] = a[i] * b[i];
+        }
+    });
+    const double t_kernel = seconds([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            kernel(actual[i].mont_repr.data, a[i].mont_repr.data, b[i].mont_repr.data, mod);
+        }
+    });
+    if (actual != expected) {
+        throw std::runtime_error(name + ": results differ");
+    }
+    report(name + " mul", n, t_libff, t_kernel);
+
+    FieldT x = a[1], y = a[1];
+    const double t_libff_chain = seconds([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            x *= b[1];
+        }
+    });
+    const double t_kernel_chain = seconds([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            kernel(y.mont_repr.data, y.mont_repr.data, b[1].mont_repr.data, mod);
+        }
+    });
+    if (x != y) {
+        throw std::runtime_error(name + ": chained results differ");
+    }
+    report(name + " mul chain", n, t_libff_chain, t_kernel_chain);
+}
+
+// through the dispatching fieldMul/fieldSqr
+template<typename FieldT>
+void benchDispatch(const std::string &name, const std::vector<FieldT> &a, const std::vector<FieldT> &b)
+{
+    const size_t n = a.size();
+    std::vector<FieldT> expected(n), actual(n);
+    const double t_libff = seconds([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            expected[i] = a[i] * b[i];
+        }
+    });
+    const double t_kernel = seconds([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            actual[i] = fieldMul(a[i], b[i]);
+        }
+    });
+    if (actual != expected) {
+        throw std::runtime_error(name + ": fieldMul differs");
+    }
+    report(name + " fieldMul", n, t_libff, t_kernel);
+
+    const double t_libff_sqr = seconds([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            expected[i] = a[i].squared();
+        }
+    });
+    const double t_kernel_sqr = seconds([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            actual[i] = fieldSqr(a[i]);
+        }
+    });
+    if (actual != expected) {
+        throw std::runtime_error(name + ": fieldSqr differs");
+    }
+    report(name + " fieldSqr", n, t_libff_sqr, t_kernel_sqr);
+}
+
+int main(int argc, char** argv)
+{
+    const size_t n = argc > 1 ? std::atol(argv[1]) : 1 << 20;
+
+    initCurveParameters();
+
+    if (memcmp(alt_bn128_r_kernel_modulus.p, alt_bn128_modulus_r.data, 32) != 0 || alt_bn128_r_kernel_modulus.inv != alt_bn128_Fr::inv ||
+        memcmp(alt_bn128_q_kernel_modulus.p, alt_bn128_modulus_q.data, 32) != 0 || alt_bn128_q_kernel_modulus.inv != alt_bn128_Fq::inv) {
+        throw std::runtime_error("kernel moduli differ from libff's");
+    }
+
+    const std::vector<alt_bn128_Fr> ra = randomElements<alt_bn128_Fr>(n), rb = randomElements<alt_bn128_Fr>(n);
+    const std::vector<alt_bn128_Fq> qa = randomElements<alt_bn128_Fq>(n), qb = randomElements<alt_bn128_Fq>(n);
+    const std::vector<alt_bn128_Fq2> q2a = randomElements<alt_bn128_Fq2>(n), q2b = randomElements<alt_bn128_Fq2>(n);
+
+    std::cout << "num elements: " << n << ", field kernel: " << fieldKernelName(fieldKernel()) << "\n";
+    std::cout << std::setw(24) << "operation" << std::setw(12) << "libff ns" << std::setw(12) << "kernel ns" << std::setw(11) << "speedup" << "\n";
+
+    benchKernel<alt_bn128_Fr, montMulPortable>("Fr portable", alt_bn128_r_kernel_modulus, ra, rb);
+    benchKernel<alt_bn128_Fq, montMulPortable>("Fq portable", alt_bn128_q_kernel_modulus, qa, qb);
+#ifdef ZOKRATES_FIELD_KERNEL_ADX
+    if (cpuHasBmi2Adx()) {
+        benchKernel<alt_bn128_Fr, montMulAdx>("Fr adx", alt_bn128_r_kernel_modulus, ra, rb);
+        benchKernel<alt_bn128_Fq, montMulAdx>("Fq adx", alt_bn128_q_kernel_modulus, qa, qb);
+    } else {
+        std::cout << "no BMI2/ADX, skipping the adx kernel\n";
+    }
+#endif
+    benchDispatch("Fr", ra, rb);
+    benchDispatch("Fq", qa, qb);
+    benchDispatch("Fq2", q2a, q2b);
+
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_gg_ppzksnark/r1cs_gg_ppzksnark.hpp>
 
 //hash
 #include <libsnark/gadgetlib1/gadgets/hashes/sha256/sha256_gadget.hpp>
@@ -6,9 +7,15 @@
 //key gen 
 #include "libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp" //hold key
 
+#include <dirent.h>
+
 // ZoKrates
 #include <ZoKrates/wraplibsnark.cpp>
 
+// r1cs.json / tests.json
+#include "r1cs_json.hpp"
+#include "witness_batch.hpp"
+
 
 using namespace libsnark;
 using namespace libff;
@@ -27,209 +34,184 @@ using namespace libff;
  */
 
 template<typename FieldT>
-void constraint_to_json(linear_combination<FieldT> constraints, std::stringstream &ss)
-{
-    ss << "{";
-    uint count = 0;
-    for (const linear_term<FieldT>& lt : constraints.terms)
+void exportInput(const r1cs_primary_input<FieldT> &input){
+    field_hex_buffer digits;
+    digits.assign(input);
+    cout << "\tInput in Solidity compliant format:{" << endl;
+    for (size_t i = 0; i < digits.size(); ++i)
     {
-        if (count != 0) {
-            ss << ",";
-        }
-        if (lt.coeff != 0 && lt.coeff != 1) {
-            ss << '"' << lt.index << '"' << ":" << "-1";
-        }
-        else {
-            ss << '"' << lt.index << '"' << ":" << lt.coeff;
-        }
-        count++;
+              cout << "\t\tinput[" << i << "] = ";
+              cout.write(digits.digits(i), digits.length(i));
+              cout << ";\n";
     }
-    ss << "}";
+    cout << "\t\t}" << endl;
 }
 
-template <typename FieldT>
-void array_to_json(protoboard<FieldT> pb, uint input_variables,  std::string path)
-{
+bool replace(std::string& str, const std::string& from, const std::string& to) {
+    size_t start_pos = str.find(from);
+    if(start_pos == std::string::npos)
+        return false;
+    str.replace(start_pos, from.length(), to);
+    return true;
+}
 
-    std::stringstream ss;
+void proof_to_json(const r1cs_ppzksnark_proof<libff::alt_bn128_pp> &proof, const r1cs_primary_input<libff::alt_bn128_Fr> &primary_input, std::string path) {
     std::ofstream fh;
     fh.open(path, std::ios::binary);
-
-    r1cs_variable_assignment<FieldT> values = pb.full_variable_assignment();
-    ss << "\n{\"TestVariables\":[";
-
-    for (size_t i = 0; i < values.size(); ++i)
-    {
-
-        ss << values[i].as_bigint();
-        if (i <  values.size() - 1) { ss << ",";}
-    }
-
-    ss << "]}\n";
-    ss.rdbuf()->pubseekpos(0, std::ios_base::out);
-
-    fh << ss.rdbuf();
+    fh << proofAsJson(proof, primary_input);
     fh.flush();
     fh.close();
 }
 
-template<typename FieldT>
-void r1cs_to_json(protoboard<FieldT> pb, uint input_variables, std::string path)
-    {
-    // output inputs, right now need to compile with debug flag so that the `variable_annotations`
-    // exists. Having trouble setting that up so will leave for now.
-    r1cs_constraint_system<FieldT> constraints = pb.get_constraint_system();
+void buildVerificationContract(const r1cs_ppzksnark_keypair<libff::alt_bn128_pp> &keypair, std::string path ) {
+
     std::stringstream ss;
     std::ofstream fh;
     fh.open(path, std::ios::binary);
-
-    ss << "\n{\"variables\":[";
+    const verification_key_hex hex = verificationKeyAsHex(keypair.vk);
     
-    for (size_t i = 0; i < input_variables + 1; ++i) 
+    ss << "{\n";
+    ss << " \"a\" :[" << hex.A << "],\n";
+    ss << " \"b\"  :[" << hex.B << "],\n";
+    ss << " \"c\" :[" << hex.C << "],\n";
+    ss << " \"g\" :[" << hex.gamma << "],\n";
+    ss << " \"gb1\" :[" << hex.gammaBeta1 << "],\n";
+    ss << " \"gb2\" :[" << hex.gammaBeta2 << "],\n";
+    ss << " \"z\" :[" << hex.Z << "],\n";
+
+    ss <<  "\"IC\" :[" << hex.IC[0];
+    
+    for (size_t i = 1; i < hex.IC.size(); ++i)
     {   
-        ss << '"' << constraints.variable_annotations[i].c_str() << '"';
-        if (i < input_variables ) {
-            ss << ", ";
-        }
-    }
-    ss << "],\n";
-    ss << "\"constraints\":[";
-     
-    for (size_t c = 0; c < constraints.num_constraints(); ++c)
-    {
-        ss << "[";// << "\"A\"=";
-        constraint_to_json(constraints.constraints[c].a, ss);
-        ss << ",";// << "\"B\"=";
-        constraint_to_json(constraints.constraints[c].b, ss);
-        ss << ",";// << "\"A\"=";;
-        constraint_to_json(constraints.constraints[c].c, ss);
-        if (c == constraints.num_constraints()-1 ) {
-            ss << "]\n";
-        } else {
-            ss << "],\n";
-        }
-    }
-    ss << "]}";
+        ss << "," <<  hex.IC[i];
+    } 
+    ss << "]";
+
+
+    ss << "}";
     ss.rdbuf()->pubseekpos(0, std::ios_base::out);
     fh << ss.rdbuf();
     fh.flush();
     fh.close();
-}
 
-template<typename FieldT>
-void exportInput(r1cs_primary_input<FieldT> input){
-    cout << "\tInput in Solidity compliant format:{" << endl;
-    for (size_t i = 0; i < input.size(); ++i)
-    {
-              cout << "\t\tinput[" << i << "] = " << HexStringFromLibsnarkBigint(input[i].as_bigint()) << ";" << endl;
-    }
-    cout << "\t\t}" << endl;
-}
 
-bool replace(std::string& str, const std::string& from, const std::string& to) {
-    size_t start_pos = str.find(from);
-    if(start_pos == std::string::npos)
-        return false;
-    str.replace(start_pos, from.length(), to);
-    return true;
 }
 
-void proof_to_json(r1cs_ppzksnark_proof<libff::alt_bn128_pp> proof) {
-    std::cout << "proof.A = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_A.g)<< ");" << endl;
-    std::cout << "proof.A_p = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_A.h)<< ");" << endl;
-    std::cout << "proof.B = Pairing.G2Point(" << outputPointG2AffineAsHex(proof.g_B.g)<< ");" << endl;
-    std::cout << "proof.B_p = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_B.h)<<");" << endl;
-    std::cout << "proof.C = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_C.g)<< ");" << endl;
-    std::cout << "proof.C_p = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_C.h)<<");" << endl;
-    std::cout << "proof.H = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_H)<<");"<< endl;
-    std::cout << "proof.K = Pairing.G1Point(" << outputPointG1AffineAsHex(proof.g_K)<<");"<< endl; 
+void groth16_proof_to_json(const r1cs_gg_ppzksnark_proof<libff::alt_bn128_pp> &proof, const r1cs_primary_input<libff::alt_bn128_Fr> &primary_input, std::string path) {
+    std::ofstream fh;
+    fh.open(path, std::ios::binary);
+    fh << groth16ProofAsJson(proof, primary_input);
+    fh.flush();
+    fh.close();
+}
 
+void buildGroth16VerificationContract(const r1cs_gg_ppzksnark_keypair<libff::alt_bn128_pp> &keypair, std::string path) {
 
-    std::string path = "proof.json";
     std::stringstream ss;
     std::ofstream fh;
     fh.open(path, std::ios::binary);
-    
+    const groth16_verification_key_hex hex = groth16VerificationKeyAsHex(keypair);
+
     ss << "{\n";
-    ss << " \"a\" :[" << outputPointG1AffineAsHex(proof.g_A.g) << "],\n";
-    ss << " \"a_p\"  :[" << outputPointG1AffineAsHex(proof.g_A.h)<< "],\n";
-    ss << " \"b\"  :[" << outputPointG2AffineAsHex(proof.g_B.g)<< "],\n";
-    ss << " \"b_p\" :[" << outputPointG1AffineAsHex(proof.g_B.h)<< "],\n";
-    ss << " \"c\" :[" << outputPointG1AffineAsHex(proof.g_C.g)<< "],\n";
-    ss << " \"c_p\" :[" << outputPointG1AffineAsHex(proof.g_C.h)<< "],\n";
-    ss << " \"h\" :[" << outputPointG1AffineAsHex(proof.g_H)<< "],\n";
-    ss << " \"k\" :[" << outputPointG1AffineAsHex(proof.g_K)<< "],\n";
-    ss << " \"input\" :" << "[]"; //TODO: add inputs 
+    ss << " \"alpha\" :[" << hex.alpha << "],\n";
+    ss << " \"beta\" :[" << hex.beta << "],\n";
+    ss << " \"gamma\" :[" << hex.gamma << "],\n";
+    ss << " \"delta\" :[" << hex.delta << "],\n";
+
+    ss <<  "\"gammaABC\" :[" << hex.gammaABC[0];
+    for (size_t i = 1; i < hex.gammaABC.size(); ++i)
+    {
+        ss << "," <<  hex.gammaABC[i];
+    }
+    ss << "]";
+
     ss << "}";
     ss.rdbuf()->pubseekpos(0, std::ios_base::out);
     fh << ss.rdbuf();
     fh.flush();
     fh.close();
-
 }
 
-void buildVerificationContract(r1cs_ppzksnark_keypair<libff::alt_bn128_pp> keypair, std::string path ) {
-
+template<typename FieldT>
+void dump_groth16_key(const protoboard<FieldT> &pb, std::string path)
+{
     std::stringstream ss;
     std::ofstream fh;
     fh.open(path, std::ios::binary);
-    unsigned icLength = keypair.vk.encoded_IC_query.rest.indices.size() + 1;
-    
-    ss << "{\n";
-    ss << " \"a\" :[" << outputPointG2AffineAsHex(keypair.vk.alphaA_g2) << "],\n";
-    ss << " \"b\"  :[" << outputPointG1AffineAsHex(keypair.vk.alphaB_g1) << "],\n";
-    ss << " \"c\" :[" << outputPointG2AffineAsHex(keypair.vk.alphaC_g2) << "],\n";
-    ss << " \"g\" :[" << outputPointG2AffineAsHex(keypair.vk.gamma_g2)<< "],\n";
-    ss << " \"gb1\" :[" << outputPointG1AffineAsHex(keypair.vk.gamma_beta_g1)<< "],\n";
-    ss << " \"gb2\" :[" << outputPointG2AffineAsHex(keypair.vk.gamma_beta_g2)<< "],\n";
-    ss << " \"z\" :[" << outputPointG2AffineAsHex(keypair.vk.rC_Z_g2)<< "],\n";
-
-    ss <<  "\"IC\" :[" << outputPointG1AffineAsHex(keypair.vk.encoded_IC_query.first);
-    
-    for (size_t i = 1; i < icLength; ++i)
-    {   
-        auto vkICi = outputPointG1AffineAsHex(keypair.vk.encoded_IC_query.rest.values[i - 1]);
-        ss << "," <<  vkICi;
-    } 
-    ss << "]";
 
+    r1cs_gg_ppzksnark_keypair<libff::alt_bn128_pp> keypair = r1cs_gg_ppzksnark_generator<libff::alt_bn128_pp>(pb.get_constraint_system());
+    writeToFile("pk_path", keypair.pk);
+    serializeGroth16VerificationKeyToFile(keypair, "vk_path");
+
+    r1cs_primary_input <FieldT> primary_input = pb.primary_input();
+    r1cs_auxiliary_input <FieldT> auxiliary_input = pb.auxiliary_input();
+    ss << "primaryinputs" << primary_input;
+    ss << "aux input" << auxiliary_input;
+
+    r1cs_gg_ppzksnark_proof<libff::alt_bn128_pp> proof = r1cs_gg_ppzksnark_prover<libff::alt_bn128_pp>(keypair.pk, primary_input, auxiliary_input);
+
+    buildGroth16VerificationContract(keypair, "vk.json");
+    groth16_proof_to_json(proof, primary_input, "proof.json");
 
-    ss << "}";
     ss.rdbuf()->pubseekpos(0, std::ios_base::out);
     fh << ss.rdbuf();
     fh.flush();
     fh.close();
-
-
 }
 
+// proof system used by dump_key
+enum proof_backend {
+    BACKEND_PPZKSNARK,
+    BACKEND_GROTH16
+};
+
+// Keypairs are cached like in _setup: only in cache_dir, or when it is empty
+// in the directory ZOKRATES_KEY_CACHE names, if any.
 template<typename FieldT>
 //void dump_key(r1cs_constraint_system<FieldT> cs)
-void dump_key(protoboard<FieldT> pb, std::string path)
+void dump_key(const protoboard<FieldT> &pb, std::string path, proof_backend backend = BACKEND_PPZKSNARK, std::string cache_dir = "")
 {
+    if (backend == BACKEND_GROTH16) {
+        dump_groth16_key(pb, path);
+        return;
+    }
 
-    r1cs_constraint_system<FieldT> constraints = pb.get_constraint_system();
     std::stringstream ss;
     std::ofstream fh;
     fh.open(path, std::ios::binary);
 
 
-    r1cs_ppzksnark_keypair<libff::alt_bn128_pp> keypair = generateKeypair(pb.get_constraint_system());
+    if (cache_dir.empty() && getenv("ZOKRATES_KEY_CACHE") != nullptr) {
+        cache_dir = getenv("ZOKRATES_KEY_CACHE");
+    }
+    // with a cache, keygen only runs if no keypair for this exact constraint system is cached
+    r1cs_ppzksnark_keypair<libff::alt_bn128_pp> keypair;
+    if (cache_dir.empty()) {
+        keypair = generateKeypair(pb.get_constraint_system());
+    } else {
+        bool cache_hit = false;
+        keypair = keypair_cache(cache_dir).get(pb.get_constraint_system(), &cache_hit);
+        std::cout << (cache_hit ? "reusing cached keypair" : "generated keypair") << " from " << cache_dir << "\n";
+    }
     serializeProvingKeyToFile(keypair.pk, "pk_path");
     serializeVerificationKeyToFile(keypair.vk, "vk_path");
 
-    pb.primary_input();
-    pb.auxiliary_input();
-
     r1cs_primary_input <FieldT> primary_input = pb.primary_input();
     r1cs_auxiliary_input <FieldT> auxiliary_input = pb.auxiliary_input();
     ss << "primaryinputs" << primary_input;
     ss << "aux input" << auxiliary_input;
 
-    r1cs_ppzksnark_proof<libff::alt_bn128_pp> proof = r1cs_ppzksnark_prover<libff::alt_bn128_pp>(keypair.pk, primary_input, auxiliary_input);
+    r1cs_ppzksnark_proof<libff::alt_bn128_pp> proof = proveWithKeyView(viewOfProvingKey(keypair.pk), primary_input, auxiliary_input);
 
+    trace_span export_span("export/json");
     buildVerificationContract(keypair, "vk.json");
-    proof_to_json (proof);
+    proof_to_json(proof, primary_input, "proof.json");
+
+    // the same proof as compressed bundle
+    uint8_t circuit_id[sha256_hasher::digest_size];
+    constraintSystemDigest(keypair.pk.constraint_system, circuit_id);
+    std::ofstream bundle_fh("proof.bin", std::ios::binary);
+    proof_bundle_stream_writer(bundle_fh).write(proof, primary_input, circuit_id);
 
     ss.rdbuf()->pubseekpos(0, std::ios_base::out);
     fh << ss.rdbuf();
@@ -260,7 +242,10 @@ void test_r1cs_ppzksnark(size_t num_constraints)
     // note a!=A && b!=B
     inner_product_gadget<libff::Fr<FieldT> > compute_inner_product(pb, A, B, res, "compute_inner_product");
 
-    compute_inner_product.generate_r1cs_constraints();
+    {
+        trace_span span("constraint_generation");
+        compute_inner_product.generate_r1cs_constraints();
+    }
     
     for (size_t i = 0; i < new_num_constraints; ++i)
     {
@@ -269,14 +254,47 @@ void test_r1cs_ppzksnark(size_t num_constraints)
         pb.val(B[i]) = 1;
     }
     // Gernerate a witness for these values.
-    compute_inner_product.generate_r1cs_witness();
-    compute_inner_product.generate_r1cs_witness();
-    assert(pb.is_satisfied());
+    {
+        trace_span span("witness_generation");
+        compute_inner_product.generate_r1cs_witness();
+    }
+    r1cs_check_result<libff::Fr<FieldT>> check;
+    {
+        trace_span span("witness_check");
+        check = checkR1csSatisfied(pb.get_constraint_system(), pb.primary_input(), pb.auxiliary_input());
+    }
+    if (!check.satisfied) {
+        printR1csCheckResult(check, std::cerr);
+        return;
+    }
+    // what the optimizer (ZOKRATES_OPTIMIZE_R1CS in setup) would make of the circuit
+    {
+        trace_span span("optimize_r1cs");
+        r1cs_witness_map witness_map;
+        r1cs_optimization_report report;
+        const r1cs_constraint_system<libff::Fr<FieldT>> optimized = optimizeConstraintSystem(pb.get_constraint_system(), witness_map, report);
+        printR1csOptimizationReport(report, std::cout);
+        assert(optimized.is_satisfied(pb.primary_input(), witness_map.reduce(pb.primary_input(), pb.auxiliary_input())));
+    }
     std::cout << "num vars: " << pb.num_variables() << "\n";   // output r1cs as json
-    r1cs_to_json(pb, 7, "r1cs.json");
-    array_to_json(pb, 7, "tests.json");
+    {
+        trace_span span("export/r1cs_json");
+        r1cs_to_json(pb, pb.num_inputs(), "r1cs.json", proverThreads());
+    }
+    {
+        trace_span span("import/r1cs_json");
+        const r1cs_constraint_system<libff::Fr<FieldT>> imported = r1cs_from_json_file<libff::Fr<FieldT>>("r1cs.json", pb.num_variables());
+        if (imported.num_inputs() != pb.num_inputs() || imported.num_constraints() != pb.num_constraints() ||
+            !imported.is_satisfied(pb.primary_input(), pb.auxiliary_input())) {
+            throw std::runtime_error("r1cs.json: the constraint system read back differs from the one written");
+        }
+    }
+    {
+        trace_span span("export/tests_json");
+        array_to_json(pb.full_variable_assignment(), "tests.json");
+    }
     // output input variable for testing
-    // dump_key(pb, "key.json");
+    // dump_key(pb, "key.json", BACKEND_GROTH16);
     r1cs_primary_input <libff::Fr<FieldT>> primary_input = pb.primary_input();
     r1cs_auxiliary_input <libff::Fr<FieldT>> auxiliary_input = pb.auxiliary_input();
 
@@ -287,10 +305,308 @@ void test_r1cs_ppzksnark(size_t num_constraints)
     
 }
 
-int main () {
+// x * (y_1 + ... + y_n) = z with x = 2 and y_i = i + 1: B touches more
+// variables than A, so the generator keeps the constraint system with A and
+// B swapped
+template<typename FieldT>
+void swap_test_circuit(protoboard<FieldT> &pb, size_t n)
+{
+    pb_variable<FieldT> x, z;
+    pb_variable_array<FieldT> y;
+    x.allocate(pb, "x");
+    y.allocate(pb, n, "y");
+    z.allocate(pb, "z");
+    pb.set_input_sizes(1);
+
+    linear_combination<FieldT> sum;
+    FieldT total = FieldT::zero();
+    for (size_t i = 0; i < n; ++i)
+    {
+        sum = sum + y[i];
+        pb.val(y[i]) = FieldT(long(i + 1));
+        total += pb.val(y[i]);
+    }
+    pb.add_r1cs_constraint(r1cs_constraint<FieldT>(x, sum, z), "x * sum(y) = z");
+    pb.val(x) = FieldT(2);
+    pb.val(z) = pb.val(x) * total;
+}
+
+// the keypair cache has to find the key of a swapped circuit again
+template<typename FieldT>
+void test_keypair_cache_swap(size_t n, std::string cache_dir)
+{
+    typedef libff::Fr<FieldT> Fr;
+    protoboard<Fr> pb;
+    swap_test_circuit(pb, n);
+
+    const r1cs_constraint_system<Fr> cs = pb.get_constraint_system();
+    r1cs_constraint_system<Fr> swapped = cs;
+    swapped.swap_AB_if_beneficial();
+    if (swapped.constraints[0].a.terms.size() != n) {
+        throw std::runtime_error("keypair cache test: the circuit does not make the generator swap A and B");
+    }
+    if (constraintSystemHash(swapped) != constraintSystemHash(cs)) {
+        throw std::runtime_error("keypair cache test: swapping A and B changes the hash");
+    }
+
+    keypair_cache cache(cache_dir);
+    bool hit = false;
+    cache.get(cs);
+    const r1cs_ppzksnark_keypair<libff::alt_bn128_pp> keypair = cache.get(cs, &hit);
+    if (!hit) {
+        throw std::runtime_error("keypair cache test: no hit for a circuit whose A and B are swapped");
+    }
+    if (constraintSystemHash(keypair.pk.constraint_system) != constraintSystemHash(cs)) {
+        throw std::runtime_error("keypair cache test: the cached key belongs to a different circuit");
+    }
+}
+
+// Proof bundles carry the circuit's cache key as circuit id, whether the id
+// is taken from the keypair (like dump_key does) or from a loaded key handle,
+// although both hold the swapped constraint system.
+template<typename FieldT>
+void test_circuit_id(size_t n, std::string cache_dir)
+{
+    typedef libff::Fr<FieldT> Fr;
+    protoboard<Fr> pb;
+    swap_test_circuit(pb, n);
+    const r1cs_constraint_system<Fr> cs = pb.get_constraint_system();
+    uint8_t expected[sha256_hasher::digest_size];
+    constraintSystemDigest(cs, expected);
+
+    keypair_cache cache(cache_dir);
+    const r1cs_ppzksnark_keypair<libff::alt_bn128_pp> keypair = cache.get(cs);
+    uint8_t circuit_id[sha256_hasher::digest_size];
+    constraintSystemDigest(keypair.pk.constraint_system, circuit_id);
+    if (memcmp(circuit_id, expected, sizeof(expected)) != 0) {
+        throw std::runtime_error("circuit id test: the keypair's circuit id differs from its cache key");
+    }
+
+    std::vector<uint8_t> public_inputs(32 * (1 + pb.num_inputs())), private_inputs(32 * pb.auxiliary_input().size());
+    r1cs_primary_input<Fr> primary_input = pb.primary_input();
+    primary_input.insert(primary_input.begin(), Fr::one());
+    fieldsToBytes(primary_input, public_inputs.data());
+    fieldsToBytes(pb.auxiliary_input(), private_inputs.data());
+
+    void* key = _load_proving_key(cache.provingKeyPath(constraintSystemHash(cs)).c_str());
+    if (key == nullptr) {
+        throw std::runtime_error("circuit id test: cannot load the cached proving key");
+    }
+    std::vector<uint8_t> bundle(proofBundleSize(pb.num_inputs()));
+    const int64_t len = _prove_bundle(key, public_inputs.data(), 1 + pb.num_inputs(), private_inputs.data(), pb.auxiliary_input().size(),
+                                      bundle.data(), bundle.size());
+    _free_key(key);
+    if (len < 0) {
+        throw std::runtime_error("circuit id test: _prove_bundle failed");
+    }
+    if (memcmp(decodeProofBundle(bundle.data(), len).circuit_id, expected, sizeof(expected)) != 0) {
+        throw std::runtime_error("circuit id test: the bundle's circuit id differs from the cache key");
+    }
+}
+
+// y = x + 1, z = y * y: the optimizer substitutes y away, so the optimized
+// system cannot tell that a witness with the wrong y is invalid. The witness
+// map has to, also after a round trip through a .wmap file.
+template<typename FieldT>
+void test_witness_map_check(std::string map_path)
+{
+    typedef libff::Fr<FieldT> Fr;
+    protoboard<Fr> pb;
+    pb_variable<Fr> x, y, z;
+    x.allocate(pb, "x");
+    y.allocate(pb, "y");
+    z.allocate(pb, "z");
+    pb.set_input_sizes(1);
+    pb.add_r1cs_constraint(r1cs_constraint<Fr>(1, x + 1, y), "y = x + 1");
+    pb.add_r1cs_constraint(r1cs_constraint<Fr>(y, y, z), "z = y * y");
+
+    r1cs_witness_map witness_map;
+    r1cs_optimization_report report;
+    const r1cs_constraint_system<Fr> optimized = optimizeConstraintSystem(pb.get_constraint_system(), witness_map, report);
+    if (report.substituted_variables != 1 || witness_map.substituted.num_constraints() != 1) {
+        throw std::runtime_error("witness map test: y was not substituted");
+    }
+    writeWitnessMap(witness_map, map_path.c_str());
+    const r1cs_witness_map read_map = readWitnessMap(map_path.c_str());
+    std::remove(map_path.c_str());
+
+    const r1cs_primary_input<Fr> primary_input = { Fr(3) };
+    const r1cs_auxiliary_input<Fr> good = { Fr(4), Fr(16) }, bad = { Fr(5), Fr(16) };
+    for (const r1cs_witness_map* map : { &witness_map, &read_map }) {
+        if (!map->checkSubstituted(primary_input, good).satisfied ||
+            !optimized.is_satisfied(primary_input, map->reduce(primary_input, good))) {
+            throw std::runtime_error("witness map test: a valid witness is rejected");
+        }
+        // the optimized system alone accepts the bad witness
+        if (!optimized.is_satisfied(primary_input, map->reduce(primary_input, bad)) ||
+            map->checkSubstituted(primary_input, bad).satisfied) {
+            throw std::runtime_error("witness map test: a witness violating y = x + 1 is not rejected");
+        }
+    }
+}
+
+// test_r1cs_ppzksnark's circuit, split for generateWitnessBatch: variables
+// and gadget are allocated on the given protoboard, constraints only on request
+template<typename FieldT>
+class inner_product_test_circuit {
+public:
+    inner_product_test_circuit(protoboard<FieldT> &pb, size_t num_constraints) : pb(pb), n(num_constraints - 1)
+    {
+        res.allocate(pb, "res");
+        A.allocate(pb, n, "A");
+        B.allocate(pb, n, "B");
+        pb.set_input_sizes(1);
+        compute_inner_product.reset(new inner_product_gadget<FieldT>(pb, A, B, res, "compute_inner_product"));
+    }
+
+    void generate_r1cs_constraints()
+    {
+        compute_inner_product->generate_r1cs_constraints();
+    }
+
+    // A = k + 1, B[i] = k * i + 1; instance 0 is test_r1cs_ppzksnark's all ones
+    void generate_r1cs_witness(size_t k)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            pb.val(A[i]) = FieldT(long(k + 1));
+            pb.val(B[i]) = FieldT(long(k * i + 1));
+        }
+        compute_inner_product->generate_r1cs_witness();
+    }
+
+private:
+    protoboard<FieldT> &pb;
+    size_t n;
+    pb_variable_array<FieldT> A;
+    pb_variable_array<FieldT> B;
+    pb_variable<FieldT> res;
+    std::unique_ptr<inner_product_gadget<FieldT>> compute_inner_product;
+};
+
+// test vectors for num_instances input sets of test_r1cs_ppzksnark's circuit,
+// with the constraints generated once and the witnesses on proverThreads()
+// threads, written to tests_batch.json and witnesses.bin. tests_batch.json is
+// read back and has to match the batch.
+template<typename FieldT>
+void test_r1cs_witness_batch(size_t num_constraints, size_t num_instances)
+{
+    typedef libff::Fr<FieldT> Fr;
+    auto make_circuit = [num_constraints](protoboard<Fr> &pb) {
+        return std::unique_ptr<inner_product_test_circuit<Fr>>(new inner_product_test_circuit<Fr>(pb, num_constraints));
+    };
+
+    // generateWitnessBatch leaves libff's profiling to the caller; it is
+    // not thread safe
+    libff::inhibit_profiling_info = true;
+    libff::inhibit_profiling_counters = true;
+
+    r1cs_constraint_system<Fr> cs;
+    {
+        trace_span span("constraint_generation");
+        cs = circuitConstraintSystem<Fr>(make_circuit);
+    }
+    witness_batch<Fr> batch;
+    {
+        trace_span span("witness_batch");
+        batch = generateWitnessBatch(cs, num_instances, make_circuit);
+    }
+    std::cout << num_instances << " witnesses of " << batch.num_variables << " variables on " << proverThreads() << " threads\n";
+    {
+        trace_span span("export/tests_batch_json");
+        instances_to_json(batch, "tests_batch.json", proverThreads());
+    }
+    {
+        trace_span span("import/tests_batch_json");
+        const std::vector<r1cs_variable_assignment<Fr>> imported = instances_from_json_file<Fr>("tests_batch.json");
+        if (imported.size() != batch.count) {
+            throw std::runtime_error("tests_batch.json: read " + std::to_string(imported.size()) + " instances, wrote " + std::to_string(batch.count));
+        }
+        for (size_t k = 0; k < batch.count; ++k) {
+            if (imported[k].size() != batch.num_variables || !std::equal(imported[k].begin(), imported[k].end(), batch.instance(k))) {
+                throw std::runtime_error("tests_batch.json: instance " + std::to_string(k) + " differs from the one written");
+            }
+        }
+    }
+    {
+        trace_span span("export/witness_stream");
+        std::ofstream fh("witnesses.bin", std::ios::binary);
+        witnessBatchToStream(batch, fh);
+    }
+}
+
+// removes path and everything below it
+void removeSelfTestDirectory(const std::string &path)
+{
+    if (DIR* d = opendir(path.c_str())) {
+        while (const dirent* entry = readdir(d)) {
+            const std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            const std::string child = path + "/" + name;
+            if (std::remove(child.c_str()) != 0) {
+                removeSelfTestDirectory(child);
+            }
+        }
+        closedir(d);
+    }
+    std::remove(path.c_str());
+}
+
+// the keypair cache, circuit id and witness map checks, on a temporary
+// directory that is removed afterwards
+void run_self_tests()
+{
+    char dir_template[] = "/tmp/zokrates_self_test.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+        throw std::runtime_error("self test: cannot create a temporary directory");
+    }
+    const std::string dir = dir_template;
+    try {
+        test_keypair_cache_swap<alt_bn128_pp>(4, dir + "/key_cache");
+        test_circuit_id<alt_bn128_pp>(4, dir + "/key_cache");
+        test_witness_map_check<alt_bn128_pp>(dir + "/test.wmap");
+    } catch (...) {
+        removeSelfTestDirectory(dir);
+        throw;
+    }
+    removeSelfTestDirectory(dir);
+}
+
+// usage: main [--instances N] [--self-test]
+int main(int argc, char** argv) {
+
+    size_t num_instances = 0;
+    bool self_test = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--self-test") {
+            self_test = true;
+            continue;
+        }
+        char* end = nullptr;
+        if (std::string(argv[i]) == "--instances" && i + 1 < argc &&
+            argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') {
+            errno = 0;
+            num_instances = std::strtoul(argv[++i], &end, 10);
+        }
+        if (end == nullptr || *end != '\0' || errno == ERANGE) {
+            std::cerr << "usage: main [--instances N] [--self-test]" << std::endl;
+            return 1;
+        }
+    }
 
     libff::alt_bn128_pp::init_public_params();
+    // ZOKRATES_THREADS, or all hardware threads
+    applyProverThreads();
     test_r1cs_ppzksnark<alt_bn128_pp>(4);
+    if (self_test) {
+        run_self_tests();
+    }
+    if (num_instances > 0) {
+        test_r1cs_witness_batch<alt_bn128_pp>(4, num_instances);
+    }
 
     return 0;
 }
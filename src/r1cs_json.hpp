@@ -0,0 +1,322 @@
+/**
+ * @file r1cs_json.hpp
+ *
+ * Streaming export of a constraint system (r1cs.json) and of a variable
+ * assignment (tests.json).
+ *
+ * The writers work from const references and format straight into a fixed
+ * size buffer that is flushed to the file whenever it fills up, so memory
+ * use does not grow with the size of the circuit. Constraints can be
+ * formatted by several threads: each round, every thread formats a shard of
+ * json_shard_constraints rows into its own buffer, and the shards are then
+ * written in order.
+ */
+
+#ifndef R1CS_JSON_HPP_
+#define R1CS_JSON_HPP_
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp>
+#include <libsnark/gadgetlib1/protoboard.hpp>
+
+const size_t json_buffer_size = 1 << 20;
+const size_t json_shard_constraints = 1 << 14;
+
+// appends to a std::string, used for the per-thread shards
+class json_string_sink {
+public:
+    explicit json_string_sink(std::string &s) : s(s) {}
+
+    void write(const char* p, size_t len) { s.append(p, len); }
+
+private:
+    std::string &s;
+};
+
+// writes to a file through a fixed size buffer
+class json_file_sink {
+public:
+    explicit json_file_sink(const std::string &path, size_t capacity = json_buffer_size) :
+        fh(path, std::ios::binary), buffer(capacity), used(0)
+    {
+        if (!fh.is_open()) {
+            throw std::runtime_error("cannot open " + path);
+        }
+    }
+
+    ~json_file_sink()
+    {
+        flush();
+    }
+
+    void write(const char* p, size_t len)
+    {
+        if (used + len > buffer.size()) {
+            flush();
+            if (len > buffer.size()) {
+                fh.write(p, len);
+                return;
+            }
+        }
+        memcpy(buffer.data() + used, p, len);
+        used += len;
+    }
+
+    void flush()
+    {
+        fh.write(buffer.data(), used);
+        fh.flush();
+        used = 0;
+    }
+
+private:
+    std::ofstream fh;
+    std::vector<char> buffer;
+    size_t used;
+};
+
+template<typename Sink>
+void json_write(Sink &out, const char* s)
+{
+    out.write(s, strlen(s));
+}
+
+template<typename Sink>
+void json_write_unsigned(Sink &out, uint64_t x)
+{
+    char digits[20];
+    size_t len = 0;
+    do {
+        digits[sizeof(digits) - ++len] = char('0' + x % 10);
+        x /= 10;
+    } while (x != 0);
+    out.write(digits + sizeof(digits) - len, len);
+}
+
+// decimal digits of x, as printed by operator<<(ostream, bigint)
+template<typename Sink, mp_size_t n>
+void json_write_bigint(Sink &out, const libff::bigint<n> &x)
+{
+    mp_limb_t limbs[n + 1];
+    memcpy(limbs, x.data, n * sizeof(mp_limb_t));
+    mp_size_t size = n;
+    while (size > 0 && limbs[size - 1] == 0) {
+        --size;
+    }
+    if (size == 0) {
+        out.write("0", 1);
+        return;
+    }
+
+    unsigned char digits[n * GMP_NUMB_BITS / 3 + 2];
+    size_t len = mpn_get_str(digits, 10, limbs, size);
+    size_t first = 0;
+    while (first + 1 < len && digits[first] == 0) {
+        ++first;
+    }
+    for (size_t i = first; i < len; ++i) {
+        digits[i] += '0';
+    }
+    out.write(reinterpret_cast<const char*>(digits + first), len - first);
+}
+
+template<typename Sink, typename FieldT>
+void constraint_to_json(Sink &out, const libsnark::linear_combination<FieldT> &lc)
+{
+    out.write("{", 1);
+    for (size_t i = 0; i < lc.terms.size(); ++i)
+    {
+        if (i != 0) {
+            out.write(",", 1);
+        }
+        out.write("\"", 1);
+        json_write_unsigned(out, lc.terms[i].index);
+        out.write("\":", 2);
+        json_write_bigint(out, lc.terms[i].coeff.as_bigint());
+    }
+    out.write("}", 1);
+}
+
+// rows [begin, end) of the "constraints" array
+template<typename Sink, typename FieldT>
+void constraints_to_json(Sink &out, const libsnark::r1cs_constraint_system<FieldT> &cs, size_t begin, size_t end)
+{
+    for (size_t c = begin; c < end; ++c)
+    {
+        out.write("[", 1);
+        constraint_to_json(out, cs.constraints[c].a);
+        out.write(",", 1);
+        constraint_to_json(out, cs.constraints[c].b);
+        out.write(",", 1);
+        constraint_to_json(out, cs.constraints[c].c);
+        if (c == cs.num_constraints() - 1) {
+            out.write("]\n", 2);
+        } else {
+            out.write("],\n", 3);
+        }
+    }
+}
+
+// "num_inputs" is the number of primary inputs; "variables" names ~one and
+// the first input_variables variables after it
+template<typename FieldT>
+void r1cs_to_json(const libsnark::r1cs_constraint_system<FieldT> &cs, size_t input_variables, const std::string &path, size_t num_threads = 1)
+{
+    json_file_sink out(path);
+
+    json_write(out, "\n{\"num_inputs\":");
+    json_write_unsigned(out, cs.num_inputs());
+    // variable names are only recorded when compiled with DEBUG
+    json_write(out, ",\n\"variables\":[");
+    for (size_t i = 0; i < input_variables + 1; ++i)
+    {
+        out.write("\"", 1);
+#ifdef DEBUG
+        auto it = cs.variable_annotations.find(i);
+        if (it != cs.variable_annotations.end()) {
+            out.write(it->second.data(), it->second.size());
+        }
+#endif
+        out.write("\"", 1);
+        if (i < input_variables) {
+            out.write(", ", 2);
+        }
+    }
+    json_write(out, "],\n\"constraints\":[");
+
+    const size_t num_constraints = cs.num_constraints();
+    num_threads = std::max<size_t>(1, std::min(num_threads, (num_constraints + json_shard_constraints - 1) / json_shard_constraints));
+    if (num_threads == 1)
+    {
+        constraints_to_json(out, cs, 0, num_constraints);
+    }
+    else
+    {
+        std::vector<std::string> shards(num_threads);
+        for (size_t round = 0; round < num_constraints; round += num_threads * json_shard_constraints)
+        {
+            std::vector<std::thread> pool;
+            for (size_t t = 0; t < num_threads; ++t)
+            {
+                pool.emplace_back([&, t]() {
+                    const size_t begin = std::min(num_constraints, round + t * json_shard_constraints);
+                    const size_t end = std::min(num_constraints, begin + json_shard_constraints);
+                    shards[t].clear();
+                    json_string_sink sink(shards[t]);
+                    constraints_to_json(sink, cs, begin, end);
+                });
+            }
+            for (size_t t = 0; t < num_threads; ++t)
+            {
+                pool[t].join();
+                out.write(shards[t].data(), shards[t].size());
+            }
+        }
+    }
+    json_write(out, "]}");
+}
+
+template<typename FieldT>
+void array_to_json(const libsnark::r1cs_variable_assignment<FieldT> &values, const std::string &path)
+{
+    json_file_sink out(path);
+
+    json_write(out, "\n{\"TestVariables\":[");
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        json_write_bigint(out, values[i].as_bigint());
+        if (i < values.size() - 1) {
+            out.write(",", 1);
+        }
+    }
+    json_write(out, "]}\n");
+}
+
+// instances [begin, end) of the "TestInstances" array
+template<typename Sink, typename FieldT>
+void instances_to_json(Sink &out, const FieldT* values, size_t num_variables, size_t count, size_t begin, size_t end)
+{
+    for (size_t k = begin; k < end; ++k)
+    {
+        const FieldT* instance = values + k * num_variables;
+        out.write("[", 1);
+        for (size_t i = 0; i < num_variables; ++i)
+        {
+            json_write_bigint(out, instance[i].as_bigint());
+            if (i < num_variables - 1) {
+                out.write(",", 1);
+            }
+        }
+        if (k == count - 1) {
+            out.write("]\n", 2);
+        } else {
+            out.write("],\n", 3);
+        }
+    }
+}
+
+// {"TestInstances":[[...],...]}, count full assignments without ~one of
+// num_variables values each, stored back to back; every inner array is what
+// array_to_json writes as TestVariables. Sharded over threads like
+// r1cs_to_json.
+template<typename FieldT>
+void instances_to_json(const FieldT* values, size_t num_variables, size_t count, const std::string &path, size_t num_threads = 1)
+{
+    json_file_sink out(path);
+
+    json_write(out, "\n{\"TestInstances\":[");
+    // about json_shard_constraints values per shard
+    const size_t shard = std::max<size_t>(1, json_shard_constraints / std::max<size_t>(1, num_variables));
+    num_threads = std::max<size_t>(1, std::min(num_threads, (count + shard - 1) / shard));
+    if (num_threads == 1)
+    {
+        instances_to_json(out, values, num_variables, count, 0, count);
+    }
+    else
+    {
+        std::vector<std::string> shards(num_threads);
+        for (size_t round = 0; round < count; round += num_threads * shard)
+        {
+            std::vector<std::thread> pool;
+            for (size_t t = 0; t < num_threads; ++t)
+            {
+                pool.emplace_back([&, t]() {
+                    const size_t begin = std::min(count, round + t * shard);
+                    const size_t end = std::min(count, begin + shard);
+                    shards[t].clear();
+                    json_string_sink sink(shards[t]);
+                    instances_to_json(sink, values, num_variables, count, begin, end);
+                });
+            }
+            for (size_t t = 0; t < num_threads; ++t)
+            {
+                pool[t].join();
+                out.write(shards[t].data(), shards[t].size());
+            }
+        }
+    }
+    json_write(out, "]}\n");
+}
+
+// protoboard only hands out copies of its constraint system and assignment,
+// these overloads take one copy each instead of copying the whole protoboard
+template<typename FieldT>
+void r1cs_to_json(const libsnark::protoboard<FieldT> &pb, size_t input_variables, const std::string &path, size_t num_threads = 1)
+{
+    r1cs_to_json(pb.get_constraint_system(), input_variables, path, num_threads);
+}
+
+template<typename FieldT>
+void array_to_json(const libsnark::protoboard<FieldT> &pb, const std::string &path)
+{
+    array_to_json(pb.full_variable_assignment(), path);
+}
+
+#endif // R1CS_JSON_HPP_
@@ -0,0 +1,220 @@
+/**
+ * @file witness_batch.hpp
+ *
+ * Witnesses of one circuit for many input sets.
+ *
+ * Generating a test vector the usual way (new protoboard, allocate, generate
+ * the constraints, generate the witness) repeats the constraint generation
+ * for every input set although the constraint system never changes. Here
+ * the constraints are generated once, by circuitConstraintSystem, and
+ * generateWitnessBatch computes the witnesses on a pool of worker threads.
+ * Every worker allocates the circuit's variables and gadgets on a protoboard
+ * of its own, without constraints, and reuses that protoboard's assignment
+ * for all the instances it computes. Instances are handed out through an
+ * atomic counter and stored at their index, like the batch prover's proofs.
+ * As with proveBatch, libff's profiling has to be inhibited before witnesses
+ * are generated on several threads (see batch_prover.hpp); the flags are
+ * left alone here.
+ *
+ * A circuit is created by make_circuit(pb), which returns a pointer to an
+ * object with generate_r1cs_constraints() and
+ * generate_r1cs_witness(size_t instance). Both creations have to allocate
+ * the same variables in the same order. The witness of an instance must not
+ * depend on the instances computed before it on the same protoboard.
+ *
+ * The batch can be written as a multi-instance tests.json (see
+ * instances_to_json) or as a binary witness stream: a 16 byte header
+ * ("ZKWS", version, 3 reserved bytes, then the number of inputs and of
+ * variables, both without ~one, as 4 byte little endian integers), followed
+ * by one record per instance of ~one, the inputs and the auxiliary values as
+ * 32 byte big endian field elements. The first 1 + num_inputs elements of a
+ * record are the public_inputs of _generate_proof and _prove, the rest their
+ * private_inputs.
+ */
+
+#ifndef WITNESS_BATCH_HPP_
+#define WITNESS_BATCH_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libsnark/gadgetlib1/protoboard.hpp>
+#include <libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp>
+
+#include <ZoKrates/field_conversion.hpp>
+#include <ZoKrates/r1cs_check.hpp>
+#include <ZoKrates/threads.hpp>
+
+#include "r1cs_json.hpp"
+
+const char witness_stream_magic[4] = { 'Z', 'K', 'W', 'S' };
+const uint8_t witness_stream_version = 1;
+const size_t witness_stream_header_size = 16;
+// instances encoded per write
+const size_t witness_stream_chunk = 256;
+
+template<typename FieldT>
+struct witness_batch {
+    size_t num_inputs = 0;
+    // without ~one
+    size_t num_variables = 0;
+    size_t count = 0;
+    // the full assignment of instance k (without ~one) starts at
+    // values[k * num_variables]
+    std::vector<FieldT> values;
+
+    const FieldT* instance(size_t k) const { return values.data() + k * num_variables; }
+
+    libsnark::r1cs_primary_input<FieldT> primary_input(size_t k) const
+    {
+        return libsnark::r1cs_primary_input<FieldT>(instance(k), instance(k) + num_inputs);
+    }
+
+    libsnark::r1cs_auxiliary_input<FieldT> auxiliary_input(size_t k) const
+    {
+        return libsnark::r1cs_auxiliary_input<FieldT>(instance(k) + num_inputs, instance(k) + num_variables);
+    }
+};
+
+// the circuit's constraint system, generated once on a protoboard of its own
+template<typename FieldT, typename MakeCircuit>
+libsnark::r1cs_constraint_system<FieldT> circuitConstraintSystem(MakeCircuit make_circuit)
+{
+    libsnark::protoboard<FieldT> pb;
+    auto circuit = make_circuit(pb);
+    circuit->generate_r1cs_constraints();
+    return pb.get_constraint_system();
+}
+
+// Witnesses of instances 0 .. count - 1 on num_threads workers (0:
+// proverThreads()). With check, every instance is checked against cs and
+// the first one that does not satisfy it is reported as an error.
+template<typename FieldT, typename MakeCircuit>
+witness_batch<FieldT> generateWitnessBatch(const libsnark::r1cs_constraint_system<FieldT> &cs, size_t count, MakeCircuit make_circuit,
+                                           size_t num_threads = 0, bool check = true)
+{
+    witness_batch<FieldT> batch;
+    batch.num_inputs = cs.num_inputs();
+    batch.num_variables = cs.num_variables();
+    batch.count = count;
+    batch.values.resize(count * batch.num_variables);
+    if (count == 0) {
+        return batch;
+    }
+    if (num_threads == 0) {
+        num_threads = proverThreads();
+    }
+    num_threads = std::max<size_t>(1, std::min(num_threads, count));
+
+    std::atomic<size_t> next(0);
+    std::vector<std::exception_ptr> errors(num_threads);
+
+    auto worker = [&](size_t t) {
+        try {
+            libsnark::protoboard<FieldT> pb;
+            auto circuit = make_circuit(pb);
+            if (pb.num_variables() != batch.num_variables || pb.num_inputs() != batch.num_inputs) {
+                throw std::runtime_error("witness batch: the circuit allocates " + std::to_string(pb.num_variables()) +
+                                         " variables, the constraint system has " + std::to_string(batch.num_variables));
+            }
+            for (size_t k = next++; k < count; k = next++) {
+                circuit->generate_r1cs_witness(k);
+                FieldT* out = batch.values.data() + k * batch.num_variables;
+                for (size_t i = 0; i < batch.num_variables; ++i) {
+                    out[i] = pb.val(libsnark::pb_variable<FieldT>(i + 1));
+                }
+                if (check) {
+                    const r1cs_check_result<FieldT> result = checkR1csSatisfied(cs, batch.primary_input(k), batch.auxiliary_input(k), 1, 1);
+                    if (!result.satisfied) {
+                        throw std::runtime_error("witness batch: instance " + std::to_string(k) + " does not satisfy the constraint system" +
+                                                 (result.failures.empty() ? ": " + result.error
+                                                                          : " (constraint " + std::to_string(result.failures[0].index) + ")"));
+                    }
+                }
+            }
+        } catch (...) {
+            errors[t] = std::current_exception();
+            next = count;
+        }
+    };
+
+    if (num_threads == 1) {
+        worker(0);
+    } else {
+        std::vector<std::thread> pool;
+        pool.reserve(num_threads);
+        for (size_t t = 0; t < num_threads; ++t) {
+            pool.emplace_back(worker, t);
+        }
+        for (std::thread &thread : pool) {
+            thread.join();
+        }
+    }
+
+    for (const std::exception_ptr &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    return batch;
+}
+
+template<typename FieldT>
+void instances_to_json(const witness_batch<FieldT> &batch, const std::string &path, size_t num_threads = 1)
+{
+    instances_to_json(batch.values.data(), batch.num_variables, batch.count, path, num_threads);
+}
+
+inline size_t witnessStreamRecordSize(size_t num_variables)
+{
+    return field_bytes * (1 + num_variables);
+}
+
+// header and one record per instance, see above
+template<typename FieldT>
+void witnessBatchToStream(const witness_batch<FieldT> &batch, std::ostream &out)
+{
+    uint8_t header[witness_stream_header_size] = { 0 };
+    memcpy(header, witness_stream_magic, sizeof(witness_stream_magic));
+    header[4] = witness_stream_version;
+    const uint32_t num_inputs = batch.num_inputs, num_variables = batch.num_variables;
+    for (int i = 0; i < 4; ++i) {
+        header[8 + i] = uint8_t(num_inputs >> (8 * i));
+        header[12 + i] = uint8_t(num_variables >> (8 * i));
+    }
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    const size_t record_size = witnessStreamRecordSize(batch.num_variables);
+    std::vector<uint8_t> one(field_bytes);
+    bigintToBytes32(FieldT::one().as_bigint(), one.data());
+
+    std::vector<uint8_t> buffer;
+    for (size_t begin = 0; begin < batch.count; begin += witness_stream_chunk) {
+        const size_t end = std::min(batch.count, begin + witness_stream_chunk);
+        buffer.resize((end - begin) * record_size);
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static)
+#endif
+        for (size_t k = begin; k < end; ++k) {
+            uint8_t* record = buffer.data() + (k - begin) * record_size;
+            memcpy(record, one.data(), field_bytes);
+            const FieldT* values = batch.instance(k);
+            for (size_t i = 0; i < batch.num_variables; ++i) {
+                bigintToBytes32(values[i].as_bigint(), record + field_bytes * (1 + i));
+            }
+        }
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    }
+    if (!out) {
+        throw std::runtime_error("witness stream: write failed");
+    }
+}
+
+#endif // WITNESS_BATCH_HPP_